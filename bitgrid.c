@@ -0,0 +1,728 @@
+#include <dragonruby.h>
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/class.h>
+#include <mruby/data.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* bits packed LSB-first into 64-bit words, every row padded to whole words;
+ * bits past w in the last word of a row are always kept zero. a BitSet is a
+ * grid with a single row */
+typedef struct {
+  size_t w;
+  size_t h;
+  size_t stride;
+  uint64_t *words;
+} bitgrid_t;
+
+typedef enum { BITGRID_AND, BITGRID_OR, BITGRID_XOR } bitgrid_op_t;
+
+void bitgrid_free(mrb_state *mrb, bitgrid_t *g) {
+  if (g == nullptr)
+    return;
+
+  mrb_free(mrb, g->words);
+  mrb_free(mrb, g);
+}
+
+static const mrb_data_type bitgrid_datatype = {
+    .struct_name = "BitGrid",
+    .dfree = (void (*)(mrb_state *, void *))bitgrid_free};
+
+bitgrid_t *bitgrid_new(mrb_state *mrb, mrb_int w, mrb_int h) {
+  if (w < 0 || h < 0)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "negative size (%i:%i)", w, h);
+
+  const size_t stride = ((size_t)w + 63) / 64;
+  if (h != 0 && stride > SIZE_MAX / sizeof(uint64_t) / (size_t)h)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "size too large (%i:%i)", w, h);
+
+  bitgrid_t *g = mrb_malloc(mrb, sizeof(bitgrid_t));
+  *g = (bitgrid_t){.w = w, .h = h, .stride = stride, .words = nullptr};
+
+  if (stride * h != 0) {
+    g->words = mrb_calloc(mrb, stride * h, sizeof(uint64_t));
+    if (g->words == nullptr) {
+      mrb_free(mrb, g);
+      mrb_raisef(mrb, E_RUNTIME_ERROR,
+                 "oom: not enough memory for a %i:%i grid", w, h);
+    }
+  }
+
+  return g;
+}
+
+bitgrid_t *bitgrid_get(mrb_state *mrb, mrb_value self) {
+  bitgrid_t *g = mrb_data_get_ptr(mrb, self, &bitgrid_datatype);
+
+  if (g == nullptr)
+    mrb_raisef(mrb, E_RUNTIME_ERROR, "uninitialized %T", self);
+
+  return g;
+}
+
+/* wraps a fresh zeroed grid in an object of self's class */
+mrb_value bitgrid_wrap_new(mrb_state *mrb, mrb_value self, size_t w, size_t h,
+                           bitgrid_t **out) {
+  struct RData *data = mrb_data_object_alloc(mrb, mrb_obj_class(mrb, self),
+                                             nullptr, &bitgrid_datatype);
+  *out = bitgrid_new(mrb, w, h);
+  data->data = *out;
+  return mrb_obj_value(data);
+}
+
+[[clang::always_inline]] uint64_t *bitgrid_row(const bitgrid_t *g, size_t y) {
+  return g->words + y * g->stride;
+}
+
+[[clang::always_inline]] uint64_t bitgrid_tail_mask(const bitgrid_t *g) {
+  return g->w % 64 ? (UINT64_C(1) << (g->w % 64)) - 1 : ~UINT64_C(0);
+}
+
+void bitgrid_mask_tails(bitgrid_t *g) {
+  if (g->stride == 0)
+    return;
+
+  const uint64_t mask = bitgrid_tail_mask(g);
+  for (size_t y = 0; y < g->h; ++y)
+    bitgrid_row(g, y)[g->stride - 1] &= mask;
+}
+
+[[clang::always_inline]] mrb_bool bitgrid_at(const bitgrid_t *g, size_t x,
+                                             size_t y) {
+  return (bitgrid_row(g, y)[x / 64] >> (x % 64)) & 1;
+}
+
+[[clang::always_inline]] void bitgrid_put(bitgrid_t *g, size_t x, size_t y,
+                                          mrb_bool v) {
+  uint64_t *word = &bitgrid_row(g, y)[x / 64];
+  const uint64_t bit = UINT64_C(1) << (x % 64);
+  *word = v ? *word | bit : *word & ~bit;
+}
+
+/* [x0, x1) of every row in [y0, y1), already clipped */
+void bitgrid_fill_span(bitgrid_t *g, size_t x0, size_t x1, size_t y0,
+                       size_t y1, mrb_bool v) {
+  if (x0 >= x1)
+    return;
+
+  const size_t w0 = x0 / 64;
+  const size_t w1 = (x1 - 1) / 64;
+  const uint64_t head = ~UINT64_C(0) << (x0 % 64);
+  const uint64_t tail = ~UINT64_C(0) >> (63 - (x1 - 1) % 64);
+
+  for (size_t y = y0; y < y1; ++y) {
+    uint64_t *row = bitgrid_row(g, y);
+    for (size_t i = w0; i <= w1; ++i) {
+      uint64_t mask = ~UINT64_C(0);
+      if (i == w0)
+        mask &= head;
+      if (i == w1)
+        mask &= tail;
+      row[i] = v ? row[i] | mask : row[i] & ~mask;
+    }
+  }
+}
+
+/* the end of [p, p + n) clipped to size. p + n is only formed when it
+ * can't overflow: for p < 0 the signs differ, otherwise n is compared
+ * against size - p first */
+mrb_int bitgrid_clip_end(mrb_int p, mrb_int n, size_t size) {
+  if (n <= 0 || p >= (mrb_int)size)
+    return p < 0 ? 0 : p;
+  if (p >= 0 && n > (mrb_int)size - p)
+    return size;
+
+  const mrb_int end = p + n;
+  return end > (mrb_int)size ? (mrb_int)size : end;
+}
+
+void bitgrid_fill_rect(bitgrid_t *g, mrb_int x, mrb_int y, mrb_int w,
+                       mrb_int h, mrb_bool v) {
+  mrb_int x0 = x < 0 ? 0 : x;
+  mrb_int y0 = y < 0 ? 0 : y;
+  mrb_int x1 = bitgrid_clip_end(x, w, g->w);
+  mrb_int y1 = bitgrid_clip_end(y, h, g->h);
+
+  if (x0 < x1 && y0 < y1)
+    bitgrid_fill_span(g, x0, x1, y0, y1, v);
+}
+
+size_t bitgrid_popcount(const bitgrid_t *g) {
+  size_t count = 0;
+  for (size_t i = 0; i < g->stride * g->h; ++i)
+    count += __builtin_popcountll(g->words[i]);
+  return count;
+}
+
+/* dst may alias a or b */
+void bitgrid_binop(bitgrid_t *dst, const bitgrid_t *a, const bitgrid_t *b,
+                   bitgrid_op_t op) {
+  const size_t n = dst->stride * dst->h;
+  uint64_t *d = dst->words;
+  const uint64_t *pa = a->words;
+  const uint64_t *pb = b->words;
+
+  switch (op) {
+  case BITGRID_AND:
+    for (size_t i = 0; i < n; ++i)
+      d[i] = pa[i] & pb[i];
+    break;
+  case BITGRID_OR:
+    for (size_t i = 0; i < n; ++i)
+      d[i] = pa[i] | pb[i];
+    break;
+  case BITGRID_XOR:
+    for (size_t i = 0; i < n; ++i)
+      d[i] = pa[i] ^ pb[i];
+    break;
+  }
+}
+
+void bitgrid_invert(bitgrid_t *dst, const bitgrid_t *src) {
+  for (size_t i = 0; i < dst->stride * dst->h; ++i)
+    dst->words[i] = ~src->words[i];
+  bitgrid_mask_tails(dst);
+}
+
+/* dst bit x = src bit x - k, zeros shifted in; safe in place. the caller
+ * masks the tail word */
+void bitgrid_row_shift(uint64_t *dst, const uint64_t *src, size_t stride,
+                       mrb_int k) {
+  if (k >= 0) {
+    const size_t q = (size_t)k / 64;
+    const unsigned r = k % 64;
+    for (size_t i = stride; i-- > 0;) {
+      uint64_t v = 0;
+      if (i >= q) {
+        v = src[i - q] << r;
+        if (r && i > q)
+          v |= src[i - q - 1] >> (64 - r);
+      }
+      dst[i] = v;
+    }
+  } else {
+    const size_t q = (size_t)-k / 64;
+    const unsigned r = (size_t)-k % 64;
+    for (size_t i = 0; i < stride; ++i) {
+      uint64_t v = 0;
+      if (q < stride - i) {
+        v = src[i + q] >> r;
+        if (r && q + 1 < stride - i)
+          v |= src[i + q + 1] << (64 - r);
+      }
+      dst[i] = v;
+    }
+  }
+}
+
+/* dst must not alias src */
+void bitgrid_shift(bitgrid_t *dst, const bitgrid_t *src, mrb_int dx,
+                   mrb_int dy) {
+  for (size_t y = 0; y < dst->h; ++y) {
+    const mrb_int sy = (mrb_int)y - dy;
+    if (sy < 0 || sy >= (mrb_int)src->h)
+      memset(bitgrid_row(dst, y), 0, dst->stride * sizeof(uint64_t));
+    else
+      bitgrid_row_shift(bitgrid_row(dst, y), bitgrid_row(src, sy),
+                        dst->stride, dx);
+  }
+  bitgrid_mask_tails(dst);
+}
+
+/* row x-neighbourhood: dst = row op (row << 1) op (row >> 1) */
+void bitgrid_morph_row(uint64_t *dst, const uint64_t *row, uint64_t *scratch,
+                       size_t stride, uint64_t mask, mrb_bool erode) {
+  uint64_t *left = scratch;
+  uint64_t *right = scratch + stride;
+
+  bitgrid_row_shift(left, row, stride, 1);
+  bitgrid_row_shift(right, row, stride, -1);
+
+  if (erode)
+    for (size_t i = 0; i < stride; ++i)
+      dst[i] = row[i] & left[i] & right[i];
+  else
+    for (size_t i = 0; i < stride; ++i)
+      dst[i] = row[i] | left[i] | right[i];
+
+  dst[stride - 1] &= mask;
+}
+
+/* n steps with a 3x3 square (3x1 when !two_d), in place; cells outside the
+ * grid count as unset */
+void bitgrid_morph(mrb_state *mrb, bitgrid_t *g, mrb_int n, mrb_bool erode,
+                   mrb_bool two_d) {
+  if (n <= 0 || g->stride * g->h == 0)
+    return;
+
+  const size_t stride = g->stride;
+  const uint64_t mask = bitgrid_tail_mask(g);
+  uint64_t *buf = mrb_malloc(mrb, 5 * stride * sizeof(uint64_t));
+  uint64_t *scratch = buf + 3 * stride;
+
+  for (mrb_int step = 0; step < n; ++step) {
+    if (!two_d) {
+      for (size_t y = 0; y < g->h; ++y) {
+        bitgrid_morph_row(buf, bitgrid_row(g, y), scratch, stride, mask, erode);
+        memcpy(bitgrid_row(g, y), buf, stride * sizeof(uint64_t));
+      }
+      continue;
+    }
+
+    /* rolling rows y - 1, y, y + 1 of the x pass; row y is overwritten only
+     * once row y + 1 has been read */
+    uint64_t *above = buf;
+    uint64_t *cur = buf + stride;
+    uint64_t *below = buf + 2 * stride;
+
+    memset(above, 0, stride * sizeof(uint64_t));
+    bitgrid_morph_row(cur, bitgrid_row(g, 0), scratch, stride, mask, erode);
+
+    for (size_t y = 0; y < g->h; ++y) {
+      if (y + 1 < g->h)
+        bitgrid_morph_row(below, bitgrid_row(g, y + 1), scratch, stride, mask,
+                          erode);
+      else
+        memset(below, 0, stride * sizeof(uint64_t));
+
+      uint64_t *out = bitgrid_row(g, y);
+      if (erode)
+        for (size_t i = 0; i < stride; ++i)
+          out[i] = above[i] & cur[i] & below[i];
+      else
+        for (size_t i = 0; i < stride; ++i)
+          out[i] = above[i] | cur[i] | below[i];
+
+      uint64_t *recycled = above;
+      above = cur;
+      cur = below;
+      below = recycled;
+    }
+  }
+
+  mrb_free(mrb, buf);
+}
+
+bitgrid_t *bitgrid_get_same(mrb_state *mrb, mrb_value self, mrb_value other) {
+  const bitgrid_t *g = bitgrid_get(mrb, self);
+  bitgrid_t *o = bitgrid_get(mrb, other);
+
+  if (mrb_obj_class(mrb, self) != mrb_obj_class(mrb, other) || g->w != o->w ||
+      g->h != o->h)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "size mismatch between %v and %v", self,
+               other);
+
+  return o;
+}
+
+mrb_value bitgrid_dup_of(mrb_state *mrb, mrb_value self, bitgrid_t **out) {
+  const bitgrid_t *g = bitgrid_get(mrb, self);
+  mrb_value res = bitgrid_wrap_new(mrb, self, g->w, g->h, out);
+  memcpy((*out)->words, g->words, g->stride * g->h * sizeof(uint64_t));
+  return res;
+}
+
+void bitgrid_init(mrb_state *mrb, mrb_value self, mrb_int w, mrb_int h) {
+  bitgrid_t *g = DATA_PTR(self);
+  if (g != nullptr && DATA_TYPE(self) == &bitgrid_datatype)
+    bitgrid_free(mrb, g);
+  mrb_data_init(self, nullptr, &bitgrid_datatype);
+
+  mrb_data_init(self, bitgrid_new(mrb, w, h), &bitgrid_datatype);
+}
+
+mrb_value bitgrid_r_init(mrb_state *mrb, mrb_value self) {
+  mrb_int w, h;
+  mrb_get_args(mrb, "ii", &w, &h);
+
+  bitgrid_init(mrb, self, w, h);
+  return self;
+}
+
+mrb_value bitset_r_init(mrb_state *mrb, mrb_value self) {
+  mrb_int n;
+  mrb_get_args(mrb, "i", &n);
+
+  bitgrid_init(mrb, self, n, 1);
+  return self;
+}
+
+mrb_value bitgrid_r_init_copy(mrb_state *mrb, mrb_value self) {
+  mrb_value other;
+  mrb_get_args(mrb, "o", &other);
+
+  if (mrb_obj_equal(mrb, self, other))
+    return self;
+
+  const bitgrid_t *o = bitgrid_get(mrb, other);
+  bitgrid_init(mrb, self, o->w, o->h);
+  memcpy(bitgrid_get(mrb, self)->words, o->words,
+         o->stride * o->h * sizeof(uint64_t));
+
+  return self;
+}
+
+void bitgrid_check_bounds(mrb_state *mrb, const bitgrid_t *g, mrb_int x,
+                          mrb_int y) {
+  if (x < 0 || x >= (mrb_int)g->w || y < 0 || y >= (mrb_int)g->h)
+    mrb_raisef(mrb, E_INDEX_ERROR, "bit (%i:%i) out of bounds (%i:%i)", x, y,
+               (mrb_int)g->w, (mrb_int)g->h);
+}
+
+/* reads outside the grid are false, so neighbour lookups need no checks */
+mrb_value bitgrid_r_get(mrb_state *mrb, mrb_value self) {
+  mrb_int x, y;
+  mrb_get_args(mrb, "ii", &x, &y);
+
+  const bitgrid_t *g = bitgrid_get(mrb, self);
+  if (x < 0 || x >= (mrb_int)g->w || y < 0 || y >= (mrb_int)g->h)
+    return mrb_false_value();
+
+  return mrb_bool_value(bitgrid_at(g, x, y));
+}
+
+mrb_value bitset_r_get(mrb_state *mrb, mrb_value self) {
+  mrb_int i;
+  mrb_get_args(mrb, "i", &i);
+
+  const bitgrid_t *g = bitgrid_get(mrb, self);
+  if (i < 0 || i >= (mrb_int)g->w)
+    return mrb_false_value();
+
+  return mrb_bool_value(bitgrid_at(g, i, 0));
+}
+
+mrb_value bitgrid_r_set(mrb_state *mrb, mrb_value self) {
+  mrb_int x, y;
+  mrb_bool v = true;
+  mrb_get_args(mrb, "ii|b", &x, &y, &v);
+
+  bitgrid_t *g = bitgrid_get(mrb, self);
+  bitgrid_check_bounds(mrb, g, x, y);
+  bitgrid_put(g, x, y, v);
+
+  return self;
+}
+
+mrb_value bitgrid_r_aset(mrb_state *mrb, mrb_value self) {
+  mrb_int x, y;
+  mrb_bool v;
+  mrb_get_args(mrb, "iib", &x, &y, &v);
+
+  bitgrid_t *g = bitgrid_get(mrb, self);
+  bitgrid_check_bounds(mrb, g, x, y);
+  bitgrid_put(g, x, y, v);
+
+  return mrb_bool_value(v);
+}
+
+mrb_value bitset_r_set(mrb_state *mrb, mrb_value self) {
+  mrb_int i;
+  mrb_bool v = true;
+  mrb_get_args(mrb, "i|b", &i, &v);
+
+  bitgrid_t *g = bitgrid_get(mrb, self);
+  bitgrid_check_bounds(mrb, g, i, 0);
+  bitgrid_put(g, i, 0, v);
+
+  return self;
+}
+
+mrb_value bitset_r_aset(mrb_state *mrb, mrb_value self) {
+  mrb_int i;
+  mrb_bool v;
+  mrb_get_args(mrb, "ib", &i, &v);
+
+  bitgrid_t *g = bitgrid_get(mrb, self);
+  bitgrid_check_bounds(mrb, g, i, 0);
+  bitgrid_put(g, i, 0, v);
+
+  return mrb_bool_value(v);
+}
+
+/* clipped to the grid */
+mrb_value bitgrid_r_fill_rect(mrb_state *mrb, mrb_value self) {
+  mrb_int x, y, w, h;
+  mrb_bool v = true;
+  mrb_get_args(mrb, "iiii|b", &x, &y, &w, &h, &v);
+
+  bitgrid_fill_rect(bitgrid_get(mrb, self), x, y, w, h, v);
+  return self;
+}
+
+mrb_value bitset_r_fill_range(mrb_state *mrb, mrb_value self) {
+  mrb_int start, n;
+  mrb_bool v = true;
+  mrb_get_args(mrb, "ii|b", &start, &n, &v);
+
+  bitgrid_fill_rect(bitgrid_get(mrb, self), start, 0, n, 1, v);
+  return self;
+}
+
+mrb_value bitgrid_r_fill(mrb_state *mrb, mrb_value self) {
+  mrb_bool v = true;
+  mrb_get_args(mrb, "|b", &v);
+
+  bitgrid_t *g = bitgrid_get(mrb, self);
+  memset(g->words, v ? 0xff : 0, g->stride * g->h * sizeof(uint64_t));
+  if (v)
+    bitgrid_mask_tails(g);
+
+  return self;
+}
+
+mrb_value bitgrid_r_width(mrb_state *mrb, mrb_value self) {
+  return mrb_int_value(mrb, bitgrid_get(mrb, self)->w);
+}
+
+mrb_value bitgrid_r_height(mrb_state *mrb, mrb_value self) {
+  return mrb_int_value(mrb, bitgrid_get(mrb, self)->h);
+}
+
+mrb_value bitgrid_r_popcount(mrb_state *mrb, mrb_value self) {
+  return mrb_int_value(mrb, bitgrid_popcount(bitgrid_get(mrb, self)));
+}
+
+mrb_value bitgrid_r_eq(mrb_state *mrb, mrb_value self) {
+  mrb_value other;
+  mrb_get_args(mrb, "o", &other);
+
+  if (mrb_obj_class(mrb, self) != mrb_obj_class(mrb, other))
+    return mrb_false_value();
+
+  const bitgrid_t *g = bitgrid_get(mrb, self);
+  const bitgrid_t *o = bitgrid_get(mrb, other);
+
+  return mrb_bool_value(g->w == o->w && g->h == o->h &&
+                        memcmp(g->words, o->words,
+                               g->stride * g->h * sizeof(uint64_t)) == 0);
+}
+
+#define bitgrid_binop_methods(name, op)                                        \
+  mrb_value bitgrid_r_##name(mrb_state *mrb, mrb_value self) {                 \
+    mrb_value other;                                                           \
+    mrb_get_args(mrb, "o", &other);                                            \
+                                                                               \
+    const bitgrid_t *o = bitgrid_get_same(mrb, self, other);                   \
+    bitgrid_t *res;                                                            \
+    mrb_value vres = bitgrid_dup_of(mrb, self, &res);                          \
+    bitgrid_binop(res, res, o, op);                                            \
+    return vres;                                                               \
+  }                                                                            \
+                                                                               \
+  mrb_value bitgrid_r_##name##_b(mrb_state *mrb, mrb_value self) {             \
+    mrb_value other;                                                           \
+    mrb_get_args(mrb, "o", &other);                                            \
+                                                                               \
+    const bitgrid_t *o = bitgrid_get_same(mrb, self, other);                   \
+    bitgrid_t *g = bitgrid_get(mrb, self);                                     \
+    bitgrid_binop(g, g, o, op);                                                \
+    return self;                                                               \
+  }
+
+bitgrid_binop_methods(and, BITGRID_AND);
+bitgrid_binop_methods(or, BITGRID_OR);
+bitgrid_binop_methods(xor, BITGRID_XOR);
+
+#undef bitgrid_binop_methods
+
+mrb_value bitgrid_r_invert(mrb_state *mrb, mrb_value self) {
+  bitgrid_t *res;
+  mrb_value vres = bitgrid_dup_of(mrb, self, &res);
+  bitgrid_invert(res, res);
+  return vres;
+}
+
+mrb_value bitgrid_r_invert_b(mrb_state *mrb, mrb_value self) {
+  bitgrid_t *g = bitgrid_get(mrb, self);
+  bitgrid_invert(g, g);
+  return self;
+}
+
+mrb_value bitgrid_shifted(mrb_state *mrb, mrb_value self, mrb_int dx,
+                          mrb_int dy) {
+  const bitgrid_t *g = bitgrid_get(mrb, self);
+  bitgrid_t *res;
+  mrb_value vres = bitgrid_wrap_new(mrb, self, g->w, g->h, &res);
+  bitgrid_shift(res, g, dx, dy);
+
+  return vres;
+}
+
+/* +dx moves bits towards higher x, +dy towards higher y */
+mrb_value bitgrid_r_shift(mrb_state *mrb, mrb_value self) {
+  mrb_int dx, dy = 0;
+  mrb_get_args(mrb, "i|i", &dx, &dy);
+
+  return bitgrid_shifted(mrb, self, dx, dy);
+}
+
+/* +n moves bits towards higher indices */
+mrb_value bitset_r_shift(mrb_state *mrb, mrb_value self) {
+  mrb_int n;
+  mrb_get_args(mrb, "i", &n);
+
+  return bitgrid_shifted(mrb, self, n, 0);
+}
+
+#define bitgrid_morph_methods(name, erode)                                     \
+  mrb_value bitgrid_r_##name(mrb_state *mrb, mrb_value self) {                 \
+    mrb_int n = 1;                                                             \
+    mrb_get_args(mrb, "|i", &n);                                               \
+                                                                               \
+    bitgrid_t *res;                                                            \
+    mrb_value vres = bitgrid_dup_of(mrb, self, &res);                          \
+    bitgrid_morph(mrb, res, n, erode,                                          \
+                  mrb_obj_class(mrb, self) != bitset_class);                   \
+    return vres;                                                               \
+  }                                                                            \
+                                                                               \
+  mrb_value bitgrid_r_##name##_b(mrb_state *mrb, mrb_value self) {             \
+    mrb_int n = 1;                                                             \
+    mrb_get_args(mrb, "|i", &n);                                               \
+                                                                               \
+    bitgrid_morph(mrb, bitgrid_get(mrb, self), n, erode,                       \
+                  mrb_obj_class(mrb, self) != bitset_class);                   \
+    return self;                                                               \
+  }
+
+static struct RClass *bitset_class;
+
+bitgrid_morph_methods(dilate, false);
+bitgrid_morph_methods(erode, true);
+
+#undef bitgrid_morph_methods
+
+/* yields x, y (i for a BitSet) of every set bit, row by row; without a
+ * block returns them as a flat array. a block that resizes the grid ends the
+ * walk */
+mrb_value bitgrid_r_each_set_bit(mrb_state *mrb, mrb_value self) {
+  mrb_value blk = mrb_nil_value();
+  mrb_get_args(mrb, "&", &blk);
+
+  const bitgrid_t *g = bitgrid_get(mrb, self);
+  const size_t w = g->w;
+  const size_t h = g->h;
+  const mrb_bool is_set = mrb_obj_class(mrb, self) == bitset_class;
+  const mrb_bool yield = !mrb_nil_p(blk);
+  mrb_value res = yield ? self : mrb_ary_new(mrb);
+
+  int arena = mrb_gc_arena_save(mrb);
+  for (size_t y = 0; y < g->h; ++y) {
+    for (size_t i = 0; i < g->stride; ++i) {
+      /* a snapshot of the word, the block may change the grid */
+      uint64_t word = bitgrid_row(g, y)[i];
+      while (word) {
+        const mrb_int x = i * 64 + __builtin_ctzll(word);
+        word &= word - 1;
+
+        if (!yield) {
+          mrb_ary_push(mrb, res, mrb_int_value(mrb, x));
+          if (!is_set)
+            mrb_ary_push(mrb, res, mrb_int_value(mrb, y));
+          continue;
+        }
+
+        if (is_set)
+          mrb_yield(mrb, blk, mrb_int_value(mrb, x));
+        else
+          mrb_yield_argv(mrb, blk, 2,
+                         (mrb_value[]){mrb_int_value(mrb, x),
+                                       mrb_int_value(mrb, y)});
+        mrb_gc_arena_restore(mrb, arena);
+
+        /* initialize or initialize_copy in the block frees the words */
+        g = bitgrid_get(mrb, self);
+        if (g->w != w || g->h != h)
+          return res;
+      }
+    }
+  }
+
+  return res;
+}
+
+void bitgrid_define_common(mrb_state *mrb, struct RClass *cls) {
+  MRB_SET_INSTANCE_TT(cls, MRB_TT_DATA);
+
+  mrb_define_method_id(mrb, cls, mrb_intern_lit(mrb, "initialize_copy"),
+                       bitgrid_r_init_copy, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, cls, mrb_intern_lit(mrb, "fill"), bitgrid_r_fill,
+                       MRB_ARGS_OPT(1));
+  mrb_define_method_id(mrb, cls, mrb_intern_lit(mrb, "popcount"),
+                       bitgrid_r_popcount, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, cls, mrb_intern_lit(mrb, "=="), bitgrid_r_eq,
+                       MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, cls, mrb_intern_lit(mrb, "&"), bitgrid_r_and,
+                       MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, cls, mrb_intern_lit(mrb, "|"), bitgrid_r_or,
+                       MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, cls, mrb_intern_lit(mrb, "^"), bitgrid_r_xor,
+                       MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, cls, mrb_intern_lit(mrb, "~"), bitgrid_r_invert,
+                       MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, cls, mrb_intern_lit(mrb, "and!"), bitgrid_r_and_b,
+                       MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, cls, mrb_intern_lit(mrb, "or!"), bitgrid_r_or_b,
+                       MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, cls, mrb_intern_lit(mrb, "xor!"), bitgrid_r_xor_b,
+                       MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, cls, mrb_intern_lit(mrb, "invert!"),
+                       bitgrid_r_invert_b, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, cls, mrb_intern_lit(mrb, "dilate"),
+                       bitgrid_r_dilate, MRB_ARGS_OPT(1));
+  mrb_define_method_id(mrb, cls, mrb_intern_lit(mrb, "dilate!"),
+                       bitgrid_r_dilate_b, MRB_ARGS_OPT(1));
+  mrb_define_method_id(mrb, cls, mrb_intern_lit(mrb, "erode"),
+                       bitgrid_r_erode, MRB_ARGS_OPT(1));
+  mrb_define_method_id(mrb, cls, mrb_intern_lit(mrb, "erode!"),
+                       bitgrid_r_erode_b, MRB_ARGS_OPT(1));
+  mrb_define_method_id(mrb, cls, mrb_intern_lit(mrb, "each_set_bit"),
+                       bitgrid_r_each_set_bit, MRB_ARGS_BLOCK());
+}
+
+void drb_register_c_extensions_with_api(mrb_state *mrb, struct drb_api_t *) {
+  struct RClass *bitgrid = mrb_define_class_id(
+      mrb, mrb_intern_lit(mrb, "BitGrid"), mrb->object_class);
+  bitgrid_define_common(mrb, bitgrid);
+
+  mrb_define_method_id(mrb, bitgrid, mrb_intern_lit(mrb, "initialize"),
+                       bitgrid_r_init, MRB_ARGS_REQ(2));
+  mrb_define_method_id(mrb, bitgrid, mrb_intern_lit(mrb, "width"),
+                       bitgrid_r_width, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, bitgrid, mrb_intern_lit(mrb, "height"),
+                       bitgrid_r_height, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, bitgrid, mrb_intern_lit(mrb, "[]"), bitgrid_r_get,
+                       MRB_ARGS_REQ(2));
+  mrb_define_method_id(mrb, bitgrid, mrb_intern_lit(mrb, "[]="),
+                       bitgrid_r_aset, MRB_ARGS_REQ(3));
+  mrb_define_method_id(mrb, bitgrid, mrb_intern_lit(mrb, "set"), bitgrid_r_set,
+                       MRB_ARGS_ARG(2, 1));
+  mrb_define_method_id(mrb, bitgrid, mrb_intern_lit(mrb, "fill_rect"),
+                       bitgrid_r_fill_rect, MRB_ARGS_ARG(4, 1));
+  mrb_define_method_id(mrb, bitgrid, mrb_intern_lit(mrb, "shift"),
+                       bitgrid_r_shift, MRB_ARGS_ARG(1, 1));
+
+  bitset_class = mrb_define_class_id(mrb, mrb_intern_lit(mrb, "BitSet"),
+                                     mrb->object_class);
+  bitgrid_define_common(mrb, bitset_class);
+
+  mrb_define_method_id(mrb, bitset_class, mrb_intern_lit(mrb, "initialize"),
+                       bitset_r_init, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, bitset_class, mrb_intern_lit(mrb, "size"),
+                       bitgrid_r_width, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, bitset_class, mrb_intern_lit(mrb, "[]"),
+                       bitset_r_get, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, bitset_class, mrb_intern_lit(mrb, "[]="),
+                       bitset_r_aset, MRB_ARGS_REQ(2));
+  mrb_define_method_id(mrb, bitset_class, mrb_intern_lit(mrb, "set"),
+                       bitset_r_set, MRB_ARGS_ARG(1, 1));
+  mrb_define_method_id(mrb, bitset_class, mrb_intern_lit(mrb, "fill_range"),
+                       bitset_r_fill_range, MRB_ARGS_ARG(2, 1));
+  mrb_define_method_id(mrb, bitset_class, mrb_intern_lit(mrb, "shift"),
+                       bitset_r_shift, MRB_ARGS_REQ(1));
+}
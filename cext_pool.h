@@ -0,0 +1,222 @@
+/* size-class pool for the extensions' short-lived buffers
+ *
+ * blocks are rounded up to a power of two between 64 bytes and 2 MiB and
+ * freed blocks are kept on a per-class free list, so heaps, noise layers and
+ * scratch grids that are created and dropped every frame reuse the same
+ * memory instead of going back to malloc. larger requests go straight to
+ * mrb_malloc / mrb_free. callers pass the size they asked for when freeing:
+ *
+ *   uint32_t *buf = cext_pool_alloc(mrb, n * sizeof(uint32_t));
+ *   ...
+ *   cext_pool_free(mrb, buf, n * sizeof(uint32_t));
+ *
+ * each extension calls cext_pool_init(mrb, "foo") from its register function.
+ * ruby sees CExtPool.stats (per extension hit counts) and CExtPool.trim,
+ * which hands every cached block back to mruby. the pool is only touched
+ * from the mruby thread */
+
+#ifndef CEXT_POOL_H
+#define CEXT_POOL_H
+
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/hash.h>
+#include <mruby/string.h>
+#include <mruby/variable.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cext_sources.h"
+
+#define CEXT_POOL_MIN_SHIFT 6
+#define CEXT_POOL_MAX_SHIFT 21
+#define CEXT_POOL_NCLASSES (CEXT_POOL_MAX_SHIFT - CEXT_POOL_MIN_SHIFT + 1)
+
+/* free blocks kept per class, and in total across classes */
+#define CEXT_POOL_KEEP 8
+#define CEXT_POOL_BUDGET ((size_t)16 << 20)
+
+typedef struct {
+  void *free[CEXT_POOL_NCLASSES][CEXT_POOL_KEEP];
+  uint32_t nfree[CEXT_POOL_NCLASSES];
+  size_t cached;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t oversize;
+  uint64_t releases;
+  _Bool closing; /* drained at mrb_close, frees go straight to mruby */
+} cext_pool_t;
+
+/* bump when cext_pool_source_t or cext_pool_t changes */
+#define CEXT_POOL_ABI 2
+
+typedef struct {
+  cext_source_t head;
+  cext_pool_t *pool;
+} cext_pool_source_t;
+
+static cext_pool_t cext_pool;
+
+/* CEXT_POOL_NCLASSES for sizes past the largest class */
+[[gnu::always_inline]] static inline int cext_pool_class(size_t n) {
+  if (n <= (size_t)1 << CEXT_POOL_MIN_SHIFT)
+    return 0;
+  if (n > (size_t)1 << CEXT_POOL_MAX_SHIFT)
+    return CEXT_POOL_NCLASSES;
+  return 64 - __builtin_clzll((unsigned long long)n - 1) - CEXT_POOL_MIN_SHIFT;
+}
+
+/* the usable size of a block asked for with n bytes */
+[[gnu::always_inline]] static inline size_t cext_pool_class_size(size_t n) {
+  const int c = cext_pool_class(n);
+  return c == CEXT_POOL_NCLASSES ? n : (size_t)1 << (c + CEXT_POOL_MIN_SHIFT);
+}
+
+/* raises like mrb_malloc when out of memory */
+static void *cext_pool_alloc(mrb_state *mrb, size_t n) {
+  const int c = cext_pool_class(n);
+
+  if (c == CEXT_POOL_NCLASSES) {
+    ++cext_pool.oversize;
+    return mrb_malloc(mrb, n);
+  }
+
+  if (cext_pool.nfree[c] > 0) {
+    ++cext_pool.hits;
+    cext_pool.cached -= (size_t)1 << (c + CEXT_POOL_MIN_SHIFT);
+    return cext_pool.free[c][--cext_pool.nfree[c]];
+  }
+
+  ++cext_pool.misses;
+  return mrb_malloc(mrb, (size_t)1 << (c + CEXT_POOL_MIN_SHIFT));
+}
+
+static void cext_pool_free(mrb_state *mrb, void *p, size_t n) {
+  if (p == nullptr)
+    return;
+
+  const int c = cext_pool_class(n);
+  const size_t size = cext_pool_class_size(n);
+
+  if (c == CEXT_POOL_NCLASSES || cext_pool.closing ||
+      cext_pool.nfree[c] == CEXT_POOL_KEEP ||
+      cext_pool.cached + size > CEXT_POOL_BUDGET) {
+    ++cext_pool.releases;
+    mrb_free(mrb, p);
+    return;
+  }
+
+  cext_pool.free[c][cext_pool.nfree[c]++] = p;
+  cext_pool.cached += size;
+}
+
+/* keeps the block when both sizes share a class. not every extension grows
+ * its buffers, hence maybe_unused */
+[[maybe_unused]] static void *cext_pool_realloc(mrb_state *mrb, void *p,
+                                                size_t old, size_t n) {
+  if (p == nullptr)
+    return cext_pool_alloc(mrb, n);
+
+  const int from = cext_pool_class(old);
+  const int to = cext_pool_class(n);
+
+  if (from == to && to != CEXT_POOL_NCLASSES)
+    return p;
+  if (from == CEXT_POOL_NCLASSES && to == CEXT_POOL_NCLASSES)
+    return mrb_realloc(mrb, p, n);
+
+  void *q = cext_pool_alloc(mrb, n);
+  memcpy(q, p, old < n ? old : n);
+  cext_pool_free(mrb, p, old);
+  return q;
+}
+
+static size_t cext_pool_drain(mrb_state *mrb, cext_pool_t *pool) {
+  const size_t cached = pool->cached;
+
+  for (int c = 0; c < CEXT_POOL_NCLASSES; ++c) {
+    while (pool->nfree[c] > 0)
+      mrb_free(mrb, pool->free[c][--pool->nfree[c]]);
+  }
+
+  pool->cached = 0;
+  return cached;
+}
+
+/* mrb_close runs this before the GC is torn down, so finalizers still free
+ * blocks afterwards; those must not be cached for the next mrb_state */
+static void cext_pool_atexit(mrb_state *mrb) {
+  cext_pool_drain(mrb, &cext_pool);
+  cext_pool.closing = true;
+}
+
+static mrb_value cext_pool_stats_m(mrb_state *mrb, mrb_value self) {
+  mrb_value sources = cext_sources_of(mrb, mrb_class_ptr(self));
+  mrb_value out = mrb_hash_new(mrb);
+  const mrb_sym fields[] = {
+      mrb_intern_lit(mrb, "hits"),     mrb_intern_lit(mrb, "misses"),
+      mrb_intern_lit(mrb, "oversize"), mrb_intern_lit(mrb, "releases"),
+      mrb_intern_lit(mrb, "cached_bytes"),
+  };
+
+  for (mrb_int i = 0; i < RARRAY_LEN(sources); ++i) {
+    const cext_pool_source_t *src = mrb_cptr(RARRAY_PTR(sources)[i]);
+    if (src->head.abi != CEXT_POOL_ABI)
+      continue;
+
+    const int ai = mrb_gc_arena_save(mrb);
+    const cext_pool_t *pool = src->pool;
+    const uint64_t vals[] = {pool->hits, pool->misses, pool->oversize,
+                             pool->releases, pool->cached};
+    const uint64_t total = pool->hits + pool->misses;
+
+    mrb_value ext = mrb_hash_new_capa(mrb, 6);
+    for (size_t f = 0; f < sizeof(fields) / sizeof(*fields); ++f)
+      mrb_hash_set(mrb, ext, mrb_symbol_value(fields[f]),
+                   mrb_int_value(mrb, (mrb_int)vals[f]));
+    mrb_hash_set(mrb, ext, mrb_symbol_value(mrb_intern_lit(mrb, "hit_rate")),
+                 mrb_float_value(mrb, total ? (mrb_float)pool->hits / total
+                                            : 0.0));
+
+    mrb_hash_set(mrb, out, mrb_str_new_cstr(mrb, src->head.ext), ext);
+    mrb_gc_arena_restore(mrb, ai);
+  }
+
+  return out;
+}
+
+/* the number of bytes handed back */
+static mrb_value cext_pool_trim_m(mrb_state *mrb, mrb_value self) {
+  mrb_value sources = cext_sources_of(mrb, mrb_class_ptr(self));
+  size_t released = 0;
+
+  for (mrb_int i = 0; i < RARRAY_LEN(sources); ++i) {
+    const cext_pool_source_t *src = mrb_cptr(RARRAY_PTR(sources)[i]);
+    if (src->head.abi == CEXT_POOL_ABI)
+      released += cext_pool_drain(mrb, src->pool);
+  }
+
+  return mrb_int_value(mrb, (mrb_int)released);
+}
+
+static void cext_pool_init(mrb_state *mrb, const char *ext) {
+  struct RClass *mod = mrb_define_module(mrb, "CExtPool");
+  mrb_define_module_function(mrb, mod, "stats", cext_pool_stats_m,
+                             MRB_ARGS_NONE());
+  mrb_define_module_function(mrb, mod, "trim", cext_pool_trim_m,
+                             MRB_ARGS_NONE());
+
+  static cext_pool_source_t src;
+  src = (cext_pool_source_t){
+      .head = {.abi = CEXT_POOL_ABI, .ext = ext}, .pool = &cext_pool};
+
+  /* cached blocks go back to mruby when the state is closed */
+  cext_pool.closing = false;
+  mrb_state_atexit(mrb, cext_pool_atexit);
+
+  cext_sources_add(mrb, mod, &src.head);
+}
+
+#endif
@@ -0,0 +1,191 @@
+/* runtime cpu feature dispatch shared by the extensions
+ *
+ * the extensions are built without -march, so SIMD kernels are compiled per
+ * function with CEXT_TARGET_SSE2 / CEXT_TARGET_AVX2 and picked at load time.
+ * each extension keeps function pointers to its kernels and a select
+ * callback that repoints them:
+ *
+ *   static void foo_simd_select(enum cext_isa isa) {
+ *     foo_kernel = CEXT_SIMD_PICK(isa, foo_scalar, foo_sse2, foo_avx2);
+ *   }
+ *
+ * and calls cext_simd_init(mrb, "foo", foo_simd_select) from its register
+ * function. ruby sees CExtSimd.isa, CExtSimd.isa = :scalar|:sse2|:avx2 and
+ * CExtSimd.supported; the CEXT_ISA environment variable caps the detected
+ * level before anything runs. the callbacks of every loaded extension are
+ * linked together through the module, see cext_sources.h */
+
+#ifndef CEXT_SIMD_H
+#define CEXT_SIMD_H
+
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/variable.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cext_sources.h"
+
+enum cext_isa {
+  CEXT_ISA_SCALAR,
+  CEXT_ISA_SSE2,
+  CEXT_ISA_AVX2,
+  CEXT_NISA,
+};
+
+static const char *const cext_isa_names[CEXT_NISA] = {"scalar", "sse2",
+                                                      "avx2"};
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CEXT_SIMD_X86
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define CEXT_TARGET_SSE2 [[gnu::target("sse2")]]
+#define CEXT_TARGET_AVX2 [[gnu::target("avx2")]]
+
+/* unavailable levels fall back to the next lower one */
+#define CEXT_SIMD_PICK(isa, scalar, sse2, avx2)                                \
+  ((isa) >= CEXT_ISA_AVX2 ? (avx2) : (isa) >= CEXT_ISA_SSE2 ? (sse2) : (scalar))
+#else
+#define CEXT_SIMD_PICK(isa, scalar, sse2, avx2) (scalar)
+#endif
+
+/* keeps the scalar kernels scalar, so forcing them measures something */
+#ifdef __clang__
+#define CEXT_SCALAR_LOOP _Pragma("clang loop vectorize(disable)")
+#else
+#define CEXT_SCALAR_LOOP
+#endif
+
+typedef void (*cext_simd_select_fn)(enum cext_isa isa);
+
+/* bump when cext_simd_source_t changes */
+#define CEXT_SIMD_ABI 1
+
+typedef struct {
+  cext_source_t head;
+  cext_simd_select_fn select;
+} cext_simd_source_t;
+
+static enum cext_isa cext_isa_detect(void) {
+  enum cext_isa isa = CEXT_ISA_SCALAR;
+
+#ifdef CEXT_SIMD_X86
+  unsigned a, b, c, d;
+
+  if (__get_cpuid(1, &a, &b, &c, &d) && (d & bit_SSE2)) {
+    isa = CEXT_ISA_SSE2;
+
+    /* avx state must also be enabled by the os, see xgetbv */
+    if ((c & bit_OSXSAVE) && (c & bit_AVX)) {
+      uint32_t lo, hi;
+      __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+
+      if ((lo & 0x6) == 0x6 && __get_cpuid_count(7, 0, &a, &b, &c, &d) &&
+          (b & bit_AVX2))
+        isa = CEXT_ISA_AVX2;
+    }
+  }
+#endif
+
+  const char *cap = getenv("CEXT_ISA");
+  if (cap != nullptr)
+    for (int i = 0; i < isa; ++i)
+      if (strcmp(cap, cext_isa_names[i]) == 0)
+        return i;
+
+  return isa;
+}
+
+/* the level in use, shared by every extension through the module */
+static enum cext_isa cext_simd_current(mrb_state *mrb, struct RClass *mod) {
+  mrb_value isa = mrb_iv_get(mrb, mrb_obj_value(mod),
+                             mrb_intern_lit(mrb, "__isa__"));
+
+  if (mrb_integer_p(isa))
+    return mrb_integer(isa);
+
+  const enum cext_isa detected = cext_isa_detect();
+  mrb_iv_set(mrb, mrb_obj_value(mod), mrb_intern_lit(mrb, "__isa__"),
+             mrb_int_value(mrb, detected));
+  mrb_iv_set(mrb, mrb_obj_value(mod), mrb_intern_lit(mrb, "__detected__"),
+             mrb_int_value(mrb, detected));
+  return detected;
+}
+
+static enum cext_isa cext_simd_detected(mrb_state *mrb, struct RClass *mod) {
+  cext_simd_current(mrb, mod);
+  return mrb_integer(mrb_iv_get(mrb, mrb_obj_value(mod),
+                                mrb_intern_lit(mrb, "__detected__")));
+}
+
+static mrb_value cext_simd_isa_m(mrb_state *mrb, mrb_value self) {
+  return mrb_symbol_value(mrb_intern_cstr(
+      mrb, cext_isa_names[cext_simd_current(mrb, mrb_class_ptr(self))]));
+}
+
+static mrb_value cext_simd_supported_m(mrb_state *mrb, mrb_value self) {
+  const enum cext_isa detected =
+      cext_simd_detected(mrb, mrb_class_ptr(self));
+  mrb_value res = mrb_ary_new_capa(mrb, detected + 1);
+
+  for (int i = 0; i <= detected; ++i)
+    mrb_ary_push(mrb, res,
+                 mrb_symbol_value(mrb_intern_cstr(mrb, cext_isa_names[i])));
+
+  return res;
+}
+
+static mrb_value cext_simd_isa_set_m(mrb_state *mrb, mrb_value self) {
+  mrb_sym name;
+  mrb_get_args(mrb, "n", &name);
+
+  struct RClass *mod = mrb_class_ptr(self);
+  const enum cext_isa detected = cext_simd_detected(mrb, mod);
+  const char *str = mrb_sym_name(mrb, name);
+
+  int isa = 0;
+  while (isa < CEXT_NISA && strcmp(str, cext_isa_names[isa]) != 0)
+    ++isa;
+
+  if (isa == CEXT_NISA)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "unknown isa %n", name);
+  if (isa > detected)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "isa %n not supported by this cpu",
+               name);
+
+  mrb_value sources = cext_sources_of(mrb, mod);
+  for (mrb_int i = 0; i < RARRAY_LEN(sources); ++i) {
+    const cext_simd_source_t *src = mrb_cptr(RARRAY_PTR(sources)[i]);
+    if (src->head.abi == CEXT_SIMD_ABI)
+      src->select(isa);
+  }
+
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__isa__"),
+             mrb_int_value(mrb, isa));
+  return mrb_symbol_value(name);
+}
+
+static void cext_simd_init(mrb_state *mrb, const char *ext,
+                           cext_simd_select_fn select) {
+  struct RClass *mod = mrb_define_module(mrb, "CExtSimd");
+  mrb_define_module_function(mrb, mod, "isa", cext_simd_isa_m,
+                             MRB_ARGS_NONE());
+  mrb_define_module_function(mrb, mod, "isa=", cext_simd_isa_set_m,
+                             MRB_ARGS_REQ(1));
+  mrb_define_module_function(mrb, mod, "supported", cext_simd_supported_m,
+                             MRB_ARGS_NONE());
+
+  select(cext_simd_current(mrb, mod));
+
+  static cext_simd_source_t src;
+  src = (cext_simd_source_t){
+      .head = {.abi = CEXT_SIMD_ABI, .ext = ext}, .select = select};
+
+  cext_sources_add(mrb, mod, &src.head);
+}
+
+#endif
@@ -0,0 +1,57 @@
+/* per-extension tables linked together through a shared module
+ *
+ * every extension is its own shared object, so CExtStats, CExtPool and
+ * CExtSimd can't reach each other's tables through a common symbol. instead
+ * each extension pushes a pointer to its table into the module's
+ * __sources__ array, and the module methods walk that array. the methods
+ * themselves are defined again by every extension; they are identical, so
+ * whichever was loaded last serves them.
+ *
+ * a table starts with a cext_source_t whose abi is the owning header's
+ * layout version, so tables built against another version are skipped
+ * instead of misread */
+
+#ifndef CEXT_SOURCES_H
+#define CEXT_SOURCES_H
+
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/variable.h>
+
+#include <stdint.h>
+#include <string.h>
+
+typedef struct {
+  uint32_t abi;
+  const char *ext;
+} cext_source_t;
+
+static mrb_value cext_sources_of(mrb_state *mrb, struct RClass *mod) {
+  const mrb_sym id = mrb_intern_lit(mrb, "__sources__");
+  mrb_value sources = mrb_iv_get(mrb, mrb_obj_value(mod), id);
+
+  if (!mrb_array_p(sources)) {
+    sources = mrb_ary_new(mrb);
+    mrb_iv_set(mrb, mrb_obj_value(mod), id, sources);
+  }
+
+  return sources;
+}
+
+/* a reloaded extension replaces its stale entry rather than adding one */
+static void cext_sources_add(mrb_state *mrb, struct RClass *mod,
+                             cext_source_t *src) {
+  mrb_value sources = cext_sources_of(mrb, mod);
+
+  for (mrb_int i = 0; i < RARRAY_LEN(sources); ++i) {
+    const cext_source_t *old = mrb_cptr(RARRAY_PTR(sources)[i]);
+    if (old->abi == src->abi && strcmp(old->ext, src->ext) == 0) {
+      mrb_ary_set(mrb, sources, i, mrb_cptr_value(mrb, src));
+      return;
+    }
+  }
+
+  mrb_ary_push(mrb, sources, mrb_cptr_value(mrb, src));
+}
+
+#endif
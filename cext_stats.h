@@ -0,0 +1,187 @@
+/* opt-in hot path counters shared by the extensions, exposed to ruby as
+ * CExtStats.snapshot / CExtStats.reset / CExtStats.enabled?
+ *
+ * build with -DCEXT_STATS -D_POSIX_C_SOURCE=199309L to turn them on; the
+ * second flag exposes CLOCK_MONOTONIC under -std=c2x. without CEXT_STATS every
+ * CEXT_STAT* macro expands to nothing and only the (empty) CExtStats module
+ * is left.
+ *
+ * each extension declares its sites once:
+ *
+ *   enum { FOO_STAT_BAR, FOO_NSTATS };
+ *   CEXT_STATS_DEFINE(FOO_NSTATS, [FOO_STAT_BAR] = {.name = "bar"});
+ *
+ * bumps them with CEXT_STAT(FOO_STAT_BAR, calls, 1) and calls
+ * CEXT_STATS_INIT(mrb, "foo") from its register function. the tables of
+ * every loaded extension are linked together through the CExtStats module,
+ * see cext_sources.h */
+
+#ifndef CEXT_STATS_H
+#define CEXT_STATS_H
+
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/hash.h>
+#include <mruby/string.h>
+#include <mruby/variable.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cext_sources.h"
+
+#ifdef CEXT_STATS
+#include <time.h>
+#endif
+
+typedef struct {
+  const char *name;
+  uint64_t calls;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t comparisons;
+  uint64_t bytes;
+  uint64_t ns;
+} cext_stat_t;
+
+/* bump the layout version whenever cext_stat_t changes, tables of another
+ * version are skipped instead of misread */
+#define CEXT_STATS_ABI 1
+
+typedef struct {
+  cext_source_t head;
+  cext_stat_t *sites;
+  size_t nsites;
+} cext_stats_source_t;
+
+#ifdef CEXT_STATS
+
+#define CEXT_STATS_DEFINE(n, ...)                                              \
+  static cext_stat_t cext_stats[n] = {__VA_ARGS__}
+
+/* plain add, for counters only touched from the mruby thread */
+#define CEXT_STAT(site, field, n) ((void)(cext_stats[site].field += (n)))
+
+/* for counters also bumped from worker threads */
+#define CEXT_STAT_ATOMIC(site, field, n)                                       \
+  ((void)__atomic_fetch_add(&cext_stats[site].field, (n), __ATOMIC_RELAXED))
+
+#define CEXT_STAT_CLOCK(var) const uint64_t var = cext_stats_now()
+#define CEXT_STAT_ELAPSED(site, var) CEXT_STAT(site, ns, cext_stats_since(var))
+#define CEXT_STAT_ELAPSED_ATOMIC(site, var)                                    \
+  CEXT_STAT_ATOMIC(site, ns, cext_stats_since(var))
+
+#define CEXT_STATS_INIT(mrb, ext)                                              \
+  cext_stats_init(mrb, ext, cext_stats, sizeof(cext_stats) / sizeof(*cext_stats))
+
+[[gnu::always_inline]] static inline uint64_t cext_stats_now(void) {
+  struct timespec ts;
+#ifdef CLOCK_MONOTONIC
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+  /* realtime, built without _POSIX_C_SOURCE; it can step backwards */
+  timespec_get(&ts, TIME_UTC);
+#endif
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* 0 rather than a wrapped delta if the clock stepped back */
+[[gnu::always_inline]] static inline uint64_t cext_stats_since(uint64_t start) {
+  const uint64_t now = cext_stats_now();
+  return now > start ? now - start : 0;
+}
+
+#else
+
+#define CEXT_STATS_DEFINE(n, ...) static_assert(n >= 0)
+#define CEXT_STAT(site, field, n) ((void)0)
+#define CEXT_STAT_ATOMIC(site, field, n) ((void)0)
+#define CEXT_STAT_CLOCK(var) ((void)0)
+#define CEXT_STAT_ELAPSED(site, var) ((void)0)
+#define CEXT_STAT_ELAPSED_ATOMIC(site, var) ((void)0)
+#define CEXT_STATS_INIT(mrb, ext) cext_stats_init(mrb, ext, nullptr, 0)
+
+#endif
+
+static mrb_value cext_stats_snapshot_m(mrb_state *mrb, mrb_value self) {
+  mrb_value sources = cext_sources_of(mrb, mrb_class_ptr(self));
+  mrb_value out = mrb_hash_new(mrb);
+  const mrb_sym fields[] = {
+      mrb_intern_lit(mrb, "calls"),       mrb_intern_lit(mrb, "hits"),
+      mrb_intern_lit(mrb, "misses"),      mrb_intern_lit(mrb, "comparisons"),
+      mrb_intern_lit(mrb, "bytes"),       mrb_intern_lit(mrb, "ns"),
+  };
+
+  for (mrb_int i = 0; i < RARRAY_LEN(sources); ++i) {
+    const cext_stats_source_t *src = mrb_cptr(RARRAY_PTR(sources)[i]);
+    if (src->head.abi != CEXT_STATS_ABI)
+      continue;
+
+    for (size_t s = 0; s < src->nsites; ++s) {
+      const int ai = mrb_gc_arena_save(mrb);
+      const cext_stat_t *st = &src->sites[s];
+      const uint64_t vals[] = {st->calls,       st->hits,  st->misses,
+                               st->comparisons, st->bytes, st->ns};
+
+      mrb_value site = mrb_hash_new_capa(mrb, 6);
+      for (size_t f = 0; f < sizeof(fields) / sizeof(*fields); ++f)
+        mrb_hash_set(mrb, site, mrb_symbol_value(fields[f]),
+                     mrb_int_value(mrb, (mrb_int)vals[f]));
+
+      mrb_value key = mrb_str_new_cstr(mrb, src->head.ext);
+      mrb_str_cat_lit(mrb, key, ".");
+      mrb_str_cat_cstr(mrb, key, st->name);
+      mrb_hash_set(mrb, out, key, site);
+      mrb_gc_arena_restore(mrb, ai);
+    }
+  }
+
+  return out;
+}
+
+static mrb_value cext_stats_reset_m(mrb_state *mrb, mrb_value self) {
+  mrb_value sources = cext_sources_of(mrb, mrb_class_ptr(self));
+
+  for (mrb_int i = 0; i < RARRAY_LEN(sources); ++i) {
+    const cext_stats_source_t *src = mrb_cptr(RARRAY_PTR(sources)[i]);
+    if (src->head.abi != CEXT_STATS_ABI)
+      continue;
+
+    for (size_t s = 0; s < src->nsites; ++s) {
+      const char *name = src->sites[s].name;
+      src->sites[s] = (cext_stat_t){.name = name};
+    }
+  }
+
+  return mrb_nil_value();
+}
+
+static mrb_value cext_stats_enabled_p_m(mrb_state *mrb, mrb_value self) {
+  mrb_value sources = cext_sources_of(mrb, mrb_class_ptr(self));
+  return mrb_bool_value(RARRAY_LEN(sources) > 0);
+}
+
+static void cext_stats_init(mrb_state *mrb, const char *ext,
+                            cext_stat_t *sites, size_t nsites) {
+  struct RClass *mod = mrb_define_module(mrb, "CExtStats");
+  mrb_define_module_function(mrb, mod, "snapshot", cext_stats_snapshot_m,
+                             MRB_ARGS_NONE());
+  mrb_define_module_function(mrb, mod, "reset", cext_stats_reset_m,
+                             MRB_ARGS_NONE());
+  mrb_define_module_function(mrb, mod, "enabled?", cext_stats_enabled_p_m,
+                             MRB_ARGS_NONE());
+
+  if (sites == nullptr)
+    return;
+
+  static cext_stats_source_t src;
+  src = (cext_stats_source_t){
+      .head = {.abi = CEXT_STATS_ABI, .ext = ext},
+      .sites = sites,
+      .nsites = nsites};
+
+  cext_sources_add(mrb, mod, &src.head);
+}
+
+#endif
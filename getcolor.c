@@ -1,6 +1,16 @@
 #include "dragonruby.h"
+#include <mruby/array.h>
+#include <mruby/hash.h>
+#include <mruby/string.h>
+#include <mruby/variable.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cext_simd.h"
+#include "cext_stats.h"
 
 #define typeof_field(STRUCT, FIELD) typeof(((STRUCT *)0)->FIELD)
 
@@ -15,6 +25,12 @@ sym_gd(r);
 sym_gd(g);
 sym_gd(b);
 sym_gd(a);
+sym_gd(as);
+sym_gd(string);
+sym_gd(ints);
+sym_gd(palette);
+sym_gd(default);
+sym_gd(threshold);
 
 #undef sym_gd
 
@@ -37,10 +53,26 @@ struct imgdata_t {
 
 static_assert(sizeof(*(typeof_field(struct imgdata_t, as))0) == 4);
 
+enum {
+  GETCOLOR_STAT_DECODE,
+  GETCOLOR_STAT_CACHE,
+  GETCOLOR_NSTATS,
+};
+
+CEXT_STATS_DEFINE(GETCOLOR_NSTATS,
+                  [GETCOLOR_STAT_DECODE] = {.name = "decode"},
+                  [GETCOLOR_STAT_CACHE] = {.name = "cache"});
+
+/* also runs on the preload worker, hence the atomic counters */
 struct imgdata_t imgdata_cons(const char *fname) {
   int w;
   int h;
+  CEXT_STAT_CLOCK(started);
   void *imgdata = drb->drb_load_image(fname, &w, &h);
+  CEXT_STAT_ATOMIC(GETCOLOR_STAT_DECODE, calls, 1);
+  CEXT_STAT_ELAPSED_ATOMIC(GETCOLOR_STAT_DECODE, started);
+  if (imgdata)
+    CEXT_STAT_ATOMIC(GETCOLOR_STAT_DECODE, bytes, (uint64_t)w * h * 4);
   return (struct imgdata_t){
       .as = (typeof_field(struct imgdata_t, as))imgdata, .w = w, .h = h};
 }
@@ -49,39 +81,1331 @@ void imgdata_dtor(mrb_state *_, struct imgdata_t *ptr) {
   drb->drb_free_image((void *)ptr->as);
 }
 
+typedef typeof(*(typeof_field(struct imgdata_t, as))0) color_t;
+
+color_t imgdata_at(const struct imgdata_t *img, uint32_t x, uint32_t y) {
+  return img->as[(img->h - y - 1) * img->w + x];
+}
+
+mrb_value getcolor_color_hash(mrb_state *mrb, color_t color) {
+  mrb_value vhash = mrb_hash_new_capa(mrb, 4);
+
+  mrb_hash_set(mrb, vhash, usym_val(r), mrb_int_value(mrb, color.r));
+  mrb_hash_set(mrb, vhash, usym_val(g), mrb_int_value(mrb, color.g));
+  mrb_hash_set(mrb, vhash, usym_val(b), mrb_int_value(mrb, color.b));
+  mrb_hash_set(mrb, vhash, usym_val(a), mrb_int_value(mrb, color.a));
+
+  return vhash;
+}
+
+void imgdata_check_bounds(mrb_state *mrb, const struct imgdata_t *img,
+                          const char *fpath, mrb_int x, mrb_int y) {
+  if (x < 0 || x >= img->w || y < 0 || y >= img->h) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR,
+               "pixel out of bounds: tried to get pixel at (%i:%i) of texture "
+               "%s with size (%i:%i)",
+               x, y, fpath, (mrb_int)img->w - 1, (mrb_int)img->h - 1);
+  }
+}
+
+/* decoded images, shared between the path-keyed LRU cache and
+ * ColorPicker::Image objects; an entry lives while either holds it */
+struct imgcache_entry_t {
+  struct imgdata_t img;
+  char *path;
+  size_t refct;
+  _Bool cached;
+  struct imgcache_entry_t *prev;
+  struct imgcache_entry_t *next;
+};
+
+struct imgcache_t {
+  struct imgcache_entry_t *head;
+  struct imgcache_entry_t *tail;
+  size_t bytes;
+  size_t budget;
+};
+
+static struct imgcache_t imgcache = {.budget = 64 << 20};
+
+size_t imgcache_entry_bytes(const struct imgcache_entry_t *e) {
+  return (size_t)e->img.w * e->img.h * sizeof(*e->img.as);
+}
+
+void imgcache_release(mrb_state *mrb, struct imgcache_entry_t *e) {
+  if (e == nullptr || --e->refct > 0)
+    return;
+
+  imgdata_dtor(mrb, &e->img);
+  mrb_free(mrb, e->path);
+  mrb_free(mrb, e);
+}
+
+void imgcache_unlink(struct imgcache_entry_t *e) {
+  if (e->prev)
+    e->prev->next = e->next;
+  else
+    imgcache.head = e->next;
+
+  if (e->next)
+    e->next->prev = e->prev;
+  else
+    imgcache.tail = e->prev;
+
+  e->prev = e->next = nullptr;
+}
+
+void imgcache_push_front(struct imgcache_entry_t *e) {
+  e->prev = nullptr;
+  e->next = imgcache.head;
+
+  if (imgcache.head)
+    imgcache.head->prev = e;
+  else
+    imgcache.tail = e;
+
+  imgcache.head = e;
+}
+
+void imgcache_evict(mrb_state *mrb, struct imgcache_entry_t *e) {
+  imgcache_unlink(e);
+  imgcache.bytes -= imgcache_entry_bytes(e);
+  e->cached = false;
+  imgcache_release(mrb, e);
+}
+
+/* the most recently used entry is kept even when it alone exceeds the
+ * budget, so the caller's borrowed pointer stays valid */
+void imgcache_trim(mrb_state *mrb) {
+  while (imgcache.bytes > imgcache.budget && imgcache.tail != imgcache.head)
+    imgcache_evict(mrb, imgcache.tail);
+}
+
+struct imgcache_entry_t *imgcache_find(const char *fpath) {
+  for (struct imgcache_entry_t *e = imgcache.head; e; e = e->next)
+    if (strcmp(e->path, fpath) == 0)
+      return e;
+  return nullptr;
+}
+
+/* background decoding: a single worker thread decodes queued paths with
+ * drb_load_image; finished jobs are moved into the cache on the main thread
+ * by poll or by any access to their path */
+enum preload_state_t { PRELOAD_QUEUED, PRELOAD_DECODING, PRELOAD_DONE };
+
+struct preload_job_t {
+  char *path;
+  struct imgdata_t img;
+  enum preload_state_t state;
+  struct preload_job_t *next;
+};
+
+struct preload_t {
+  pthread_mutex_t lock;
+  pthread_cond_t wake; /* worker side, a job was queued */
+  pthread_cond_t done; /* main side, a job was decoded */
+  struct preload_job_t *head;
+  struct preload_job_t *tail;
+  _Bool started;
+  pthread_t worker;
+};
+
+static struct preload_t preload = {.lock = PTHREAD_MUTEX_INITIALIZER,
+                                   .wake = PTHREAD_COND_INITIALIZER,
+                                   .done = PTHREAD_COND_INITIALIZER};
+
+/* callbacks are kept in hidden ivars of ColorPicker so the GC sees them:
+ * path => [blocks] while queued, [block, path, ok] triples once finished */
+static struct RClass *getcolor_module;
+static mrb_sym preload_callbacks_sym;
+static mrb_sym preload_finished_sym;
+
+static void *preload_worker(void *_) {
+  pthread_mutex_lock(&preload.lock);
+
+  for (;;) {
+    struct preload_job_t *job = preload.head;
+    while (job && job->state != PRELOAD_QUEUED)
+      job = job->next;
+
+    if (!job) {
+      pthread_cond_wait(&preload.wake, &preload.lock);
+      continue;
+    }
+
+    job->state = PRELOAD_DECODING;
+    pthread_mutex_unlock(&preload.lock);
+
+    struct imgdata_t img = imgdata_cons(job->path);
+
+    pthread_mutex_lock(&preload.lock);
+    job->img = img;
+    job->state = PRELOAD_DONE;
+    pthread_cond_broadcast(&preload.done);
+  }
+
+  return nullptr;
+}
+
+/* must hold preload.lock */
+struct preload_job_t *preload_find(const char *fpath) {
+  for (struct preload_job_t *job = preload.head; job; job = job->next)
+    if (strcmp(job->path, fpath) == 0)
+      return job;
+  return nullptr;
+}
+
+/* must hold preload.lock */
+void preload_unlink(struct preload_job_t *job) {
+  struct preload_job_t **link = &preload.head;
+  struct preload_job_t *prev = nullptr;
+
+  while (*link != job) {
+    prev = *link;
+    link = &(*link)->next;
+  }
+
+  *link = job->next;
+  if (preload.tail == job)
+    preload.tail = prev;
+}
+
+void preload_notify(mrb_state *mrb, mrb_value path, _Bool ok) {
+  mrb_value mod = mrb_obj_value(getcolor_module);
+  mrb_value callbacks = mrb_iv_get(mrb, mod, preload_callbacks_sym);
+
+  if (!mrb_hash_p(callbacks) || !mrb_hash_key_p(mrb, callbacks, path))
+    return;
+
+  mrb_value blocks = mrb_hash_delete_key(mrb, callbacks, path);
+  mrb_value finished = mrb_iv_get(mrb, mod, preload_finished_sym);
+
+  for (mrb_int i = 0; i < RARRAY_LEN(blocks); ++i) {
+    mrb_value triple[] = {RARRAY_PTR(blocks)[i], path, mrb_bool_value(ok)};
+    mrb_ary_push(mrb, finished, mrb_ary_new_from_values(mrb, 3, triple));
+  }
+}
+
+/* jobs left at mrb_close hold memory of the closing state. one still being
+ * decoded is waited for, since the worker writes to it when done */
+static void preload_atexit(mrb_state *mrb) {
+  pthread_mutex_lock(&preload.lock);
+
+  for (;;) {
+    struct preload_job_t *job = preload.head;
+    while (job && job->state != PRELOAD_DECODING)
+      job = job->next;
+    if (!job)
+      break;
+    pthread_cond_wait(&preload.done, &preload.lock);
+  }
+
+  struct preload_job_t *job = preload.head;
+  preload.head = preload.tail = nullptr;
+  pthread_mutex_unlock(&preload.lock);
+
+  while (job) {
+    struct preload_job_t *next = job->next;
+    if (job->img.as)
+      imgdata_dtor(mrb, &job->img);
+    mrb_free(mrb, job->path);
+    mrb_free(mrb, job);
+    job = next;
+  }
+}
+
+/* hands over the decoded image of a queued path, waiting for the worker if
+ * it hasn't got to it yet; false if the path was never queued. the caller
+ * owns the image and runs preload_notify once it is stored */
+_Bool preload_take(mrb_state *mrb, const char *fpath, struct imgdata_t *img) {
+  pthread_mutex_lock(&preload.lock);
+
+  struct preload_job_t *job = preload_find(fpath);
+  if (!job) {
+    pthread_mutex_unlock(&preload.lock);
+    return false;
+  }
+
+  while (job->state != PRELOAD_DONE)
+    pthread_cond_wait(&preload.done, &preload.lock);
+
+  preload_unlink(job);
+  pthread_mutex_unlock(&preload.lock);
+
+  *img = job->img;
+  mrb_free(mrb, job->path);
+  mrb_free(mrb, job);
+
+  return true;
+}
+
+/* takes ownership of img */
+struct imgcache_entry_t *imgcache_insert(mrb_state *mrb, const char *fpath,
+                                         struct imgdata_t img) {
+  size_t len = strlen(fpath);
+  char *path = mrb_malloc_simple(mrb, len + 1);
+  struct imgcache_entry_t *e =
+      mrb_malloc_simple(mrb, sizeof(struct imgcache_entry_t));
+
+  if (!path || !e) {
+    mrb_free(mrb, path);
+    mrb_free(mrb, e);
+    imgdata_dtor(mrb, &img);
+    mrb_raisef(mrb, E_RUNTIME_ERROR, "oom: not enough memory to cache %s",
+               fpath);
+  }
+
+  memcpy(path, fpath, len + 1);
+  *e = (struct imgcache_entry_t){
+      .img = img, .path = path, .refct = 1, .cached = true};
+
+  imgcache_push_front(e);
+  imgcache.bytes += imgcache_entry_bytes(e);
+  imgcache_trim(mrb);
+
+  return e;
+}
+
+/* returns a borrowed entry, valid until the next cache operation */
+struct imgcache_entry_t *imgcache_get(mrb_state *mrb, const char *fpath) {
+  struct imgcache_entry_t *e = imgcache_find(fpath);
+
+  CEXT_STAT(GETCOLOR_STAT_CACHE, calls, 1);
+
+  if (e) {
+    CEXT_STAT(GETCOLOR_STAT_CACHE, hits, 1);
+    if (e != imgcache.head) {
+      imgcache_unlink(e);
+      imgcache_push_front(e);
+    }
+    return e;
+  }
+
+  CEXT_STAT(GETCOLOR_STAT_CACHE, misses, 1);
+
+  struct imgdata_t img;
+  const _Bool preloaded = preload_take(mrb, fpath, &img);
+  if (!preloaded)
+    img = imgdata_cons(fpath);
+
+  if (!img.as) {
+    if (preloaded)
+      preload_notify(mrb, mrb_str_new_cstr(mrb, fpath), false);
+    mrb_raisef(mrb, E_RUNTIME_ERROR, "imgdata of %s doesn't exist", fpath);
+  }
+
+  e = imgcache_insert(mrb, fpath, img);
+  if (preloaded)
+    preload_notify(mrb, mrb_str_new_cstr(mrb, fpath), true);
+  return e;
+}
+
 mrb_value getcolor_getpixel_ncache(mrb_state *mrb, mrb_value _) {
   char *fpath;
   mrb_int x;
   mrb_int y;
   mrb_get_args(mrb, "zii", &fpath, &x, &y);
 
-  struct imgdata_t imgdata = imgdata_cons(fpath);
+  const struct imgdata_t *img = &imgcache_get(mrb, fpath)->img;
+  imgdata_check_bounds(mrb, img, fpath, x, y);
 
-  if (!imgdata.as) {
-    mrb_raisef(mrb, E_RUNTIME_ERROR, "imgdata of %s doesn't exist", fpath);
+  return getcolor_color_hash(mrb, imgdata_at(img, x, y));
+}
+
+mrb_value getcolor_evict(mrb_state *mrb, mrb_value _) {
+  char *fpath;
+  mrb_get_args(mrb, "z", &fpath);
+
+  struct imgcache_entry_t *e = imgcache_find(fpath);
+  if (!e)
+    return mrb_false_value();
+
+  imgcache_evict(mrb, e);
+  return mrb_true_value();
+}
+
+mrb_value getcolor_clear(mrb_state *mrb, mrb_value self) {
+  while (imgcache.head)
+    imgcache_evict(mrb, imgcache.head);
+  return self;
+}
+
+mrb_value getcolor_cache_budget(mrb_state *mrb, mrb_value _) {
+  return mrb_int_value(mrb, imgcache.budget);
+}
+
+mrb_value getcolor_cache_budget_set(mrb_state *mrb, mrb_value _) {
+  mrb_int budget;
+  mrb_get_args(mrb, "i", &budget);
+
+  if (budget < 0)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "negative cache budget (%i)", budget);
+
+  imgcache.budget = budget;
+  imgcache_trim(mrb);
+
+  return mrb_int_value(mrb, budget);
+}
+
+mrb_value getcolor_cache_bytes(mrb_state *mrb, mrb_value _) {
+  return mrb_int_value(mrb, imgcache.bytes);
+}
+
+void preload_queue(mrb_state *mrb, mrb_value path, mrb_value blk) {
+  const char *fpath = mrb_string_cstr(mrb, path);
+  mrb_value mod = mrb_obj_value(getcolor_module);
+
+  if (imgcache_find(fpath)) {
+    if (!mrb_nil_p(blk)) {
+      mrb_value triple[] = {blk, path, mrb_true_value()};
+      mrb_ary_push(mrb, mrb_iv_get(mrb, mod, preload_finished_sym),
+                   mrb_ary_new_from_values(mrb, 3, triple));
+    }
+    return;
+  }
+
+  pthread_mutex_lock(&preload.lock);
+  _Bool queued = preload_find(fpath) != nullptr;
+  pthread_mutex_unlock(&preload.lock);
+
+  if (!queued) {
+    size_t len = strlen(fpath);
+    struct preload_job_t *job = mrb_malloc(mrb, sizeof(struct preload_job_t));
+    job->path = mrb_malloc_simple(mrb, len + 1);
+    if (!job->path) {
+      mrb_free(mrb, job);
+      mrb_raisef(mrb, E_RUNTIME_ERROR, "oom: not enough memory to queue %s",
+                 fpath);
+    }
+    memcpy(job->path, fpath, len + 1);
+    job->img = (struct imgdata_t){0};
+    job->state = PRELOAD_QUEUED;
+    job->next = nullptr;
+
+    pthread_mutex_lock(&preload.lock);
+    if (preload.tail)
+      preload.tail->next = job;
+    else
+      preload.head = job;
+    preload.tail = job;
+    pthread_cond_signal(&preload.wake);
+    pthread_mutex_unlock(&preload.lock);
+  }
+
+  /* registered once the job exists, so no block is left without one to run
+   * it; every caller of a path already queued gets called back too */
+  if (!mrb_nil_p(blk)) {
+    mrb_value callbacks = mrb_iv_get(mrb, mod, preload_callbacks_sym);
+    mrb_value blocks = mrb_hash_get(mrb, callbacks, path);
+    if (!mrb_array_p(blocks)) {
+      blocks = mrb_ary_new(mrb);
+      mrb_hash_set(mrb, callbacks, path, blocks);
+    }
+    mrb_ary_push(mrb, blocks, blk);
+  }
+}
+
+mrb_value getcolor_preload(mrb_state *mrb, mrb_value self) {
+  mrb_value paths;
+  mrb_value blk = mrb_nil_value();
+  mrb_get_args(mrb, "o&", &paths, &blk);
+
+  if (!preload.started) {
+    if (pthread_create(&preload.worker, nullptr, preload_worker, nullptr))
+      mrb_raise(mrb, E_RUNTIME_ERROR, "couldn't start the preload thread");
+    pthread_detach(preload.worker);
+    preload.started = true;
+  }
+
+  if (mrb_array_p(paths)) {
+    for (mrb_int i = 0; i < RARRAY_LEN(paths); ++i)
+      preload_queue(mrb, mrb_ensure_string_type(mrb, RARRAY_PTR(paths)[i]),
+                    blk);
+  } else {
+    preload_queue(mrb, mrb_ensure_string_type(mrb, paths), blk);
+  }
+
+  return self;
+}
+
+/* true once reading path won't block on decoding */
+mrb_value getcolor_ready_p(mrb_state *mrb, mrb_value _) {
+  char *fpath;
+  mrb_get_args(mrb, "z", &fpath);
+
+  if (imgcache_find(fpath))
+    return mrb_true_value();
+
+  pthread_mutex_lock(&preload.lock);
+  struct preload_job_t *job = preload_find(fpath);
+  _Bool ready = job && job->state == PRELOAD_DONE;
+  pthread_mutex_unlock(&preload.lock);
+
+  return mrb_bool_value(ready);
+}
+
+mrb_value getcolor_await(mrb_state *mrb, mrb_value _) {
+  char *fpath;
+  mrb_get_args(mrb, "z", &fpath);
+
+  imgcache_get(mrb, fpath);
+  return mrb_true_value();
+}
+
+/* moves finished jobs into the cache and runs their callbacks with
+ * (path, ok); returns the number of jobs still pending. callbacks stay in the
+ * ivar until they run, so one that raises leaves the rest for the next poll */
+mrb_value getcolor_poll(mrb_state *mrb, mrb_value _) {
+  mrb_int pending = 0;
+
+  for (;;) {
+    pthread_mutex_lock(&preload.lock);
+    struct preload_job_t *job = preload.head;
+    pending = 0;
+    for (struct preload_job_t *it = preload.head; it; it = it->next)
+      pending += it->state != PRELOAD_DONE;
+    while (job && job->state != PRELOAD_DONE)
+      job = job->next;
+    pthread_mutex_unlock(&preload.lock);
+
+    if (!job)
+      break;
+
+    /* the job is freed by preload_take, keep its path */
+    int arena = mrb_gc_arena_save(mrb);
+    mrb_value path = mrb_str_new_cstr(mrb, job->path);
+    const char *fpath = RSTRING_PTR(path);
+
+    struct imgdata_t img;
+    preload_take(mrb, fpath, &img);
+    const _Bool ok = img.as != nullptr;
+    if (ok && !imgcache_find(fpath))
+      imgcache_insert(mrb, fpath, img);
+    else if (ok)
+      imgdata_dtor(mrb, &img);
+    preload_notify(mrb, path, ok);
+
+    mrb_gc_arena_restore(mrb, arena);
+  }
+
+  mrb_value finished =
+      mrb_iv_get(mrb, mrb_obj_value(getcolor_module), preload_finished_sym);
+
+  /* callbacks queued by a callback wait for the next poll */
+  const mrb_int n = RARRAY_LEN(finished);
+  int arena = mrb_gc_arena_save(mrb);
+  for (mrb_int i = 0; i < n && RARRAY_LEN(finished) > 0; ++i) {
+    mrb_value entry = mrb_ary_shift(mrb, finished);
+    mrb_gc_protect(mrb, entry);
+    const mrb_value *triple = RARRAY_PTR(entry);
+    mrb_funcall_id(mrb, triple[0], mrb_intern_lit(mrb, "call"), 2, triple[1],
+                   triple[2]);
+    mrb_gc_arena_restore(mrb, arena);
   }
 
-  if (x < 0 || x >= imgdata.w || y < 0 || y >= imgdata.h) {
-    imgdata_dtor(mrb, &imgdata); // this only invalidates imgdata::as
+  return mrb_int_value(mrb, pending);
+}
+
+/* bulk reads: either a packed RGBA String (4 bytes per pixel, in memory
+ * order) or an Array of uint32 ABGR Integers */
+enum getcolor_format { GETCOLOR_STRING, GETCOLOR_INTS };
+
+enum getcolor_format getcolor_format_of(mrb_state *mrb, mrb_value as) {
+  if (mrb_undef_p(as) || (mrb_symbol_p(as) && mrb_symbol(as) == usym(string)))
+    return GETCOLOR_STRING;
+  if (mrb_symbol_p(as) && mrb_symbol(as) == usym(ints))
+    return GETCOLOR_INTS;
+
+  mrb_raisef(mrb, E_ARGUMENT_ERROR, "as: must be :string or :ints, got %v",
+             as);
+}
+
+mrb_value getcolor_pixels_of(mrb_state *mrb, const struct imgcache_entry_t *e,
+                             const mrb_value *coords, mrb_int ncoords,
+                             enum getcolor_format fmt) {
+  if (ncoords % 2 != 0)
     mrb_raisef(mrb, E_ARGUMENT_ERROR,
-               "pixel out of bounds: tried to get pixel at (%i:%i) of texture "
-               "%s with size (%i:%i)",
-               x, y, fpath, imgdata.w - 1, imgdata.h - 1);
+               "coordinate list of odd length %i, expected x/y pairs", ncoords);
+
+  const mrb_int n = ncoords / 2;
+  mrb_value res = fmt == GETCOLOR_STRING
+                      ? mrb_str_new(mrb, nullptr, n * sizeof(color_t))
+                      : mrb_ary_new_capa(mrb, n);
+  color_t *out = fmt == GETCOLOR_STRING ? (color_t *)RSTRING_PTR(res) : nullptr;
+
+  for (mrb_int i = 0; i < n; ++i) {
+    mrb_int x = mrb_as_int(mrb, coords[i * 2]);
+    mrb_int y = mrb_as_int(mrb, coords[i * 2 + 1]);
+    imgdata_check_bounds(mrb, &e->img, e->path, x, y);
+
+    color_t color = imgdata_at(&e->img, x, y);
+    if (out)
+      out[i] = color;
+    else
+      mrb_ary_push(mrb, res, mrb_int_value(mrb, color.abgr));
+  }
+
+  return res;
+}
+
+mrb_value getcolor_region_of(mrb_state *mrb, const struct imgcache_entry_t *e,
+                             mrb_int x, mrb_int y, mrb_int w, mrb_int h,
+                             enum getcolor_format fmt) {
+  const struct imgdata_t *img = &e->img;
+
+  if (w < 0 || h < 0 || x < 0 || y < 0 || x + w > img->w || y + h > img->h)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR,
+               "region (%i:%i %ix%i) out of bounds of texture %s with size "
+               "(%i:%i)",
+               x, y, w, h, e->path, (mrb_int)img->w, (mrb_int)img->h);
+
+  /* rows go bottom to top, like the y axis */
+  if (fmt == GETCOLOR_STRING) {
+    mrb_value res = mrb_str_new(mrb, nullptr, w * h * sizeof(color_t));
+    color_t *out = (color_t *)RSTRING_PTR(res);
+
+    for (mrb_int row = 0; row < h; ++row)
+      memcpy(out + row * w, &img->as[(img->h - (y + row) - 1) * img->w + x],
+             w * sizeof(color_t));
+
+    return res;
   }
 
-  typeof(*(typeof_field(struct imgdata_t, as))0) color =
-      imgdata.as[(imgdata.h - y - 1) * imgdata.w + x + 1];
+  mrb_value res = mrb_ary_new_capa(mrb, w * h);
+  for (mrb_int row = 0; row < h; ++row) {
+    const color_t *src = &img->as[(img->h - (y + row) - 1) * img->w + x];
+    for (mrb_int col = 0; col < w; ++col)
+      mrb_ary_push(mrb, res, mrb_int_value(mrb, src[col].abgr));
+  }
 
-  imgdata_dtor(mrb, &imgdata);
+  return res;
+}
 
-  mrb_value vhash = mrb_hash_new_capa(mrb, 4);
+mrb_value getcolor_pixels(mrb_state *mrb, mrb_value _) {
+  char *fpath;
+  const mrb_value *coords;
+  mrb_int ncoords;
+  mrb_value as = mrb_undef_value();
+  const mrb_kwargs kwargs = {1, 0, &usym(as), &as, NULL};
+  mrb_get_args(mrb, "za:", &fpath, &coords, &ncoords, &kwargs);
 
-  mrb_hash_set(mrb, vhash, usym_val(r), mrb_int_value(mrb, color.r));
-  mrb_hash_set(mrb, vhash, usym_val(g), mrb_int_value(mrb, color.g));
-  mrb_hash_set(mrb, vhash, usym_val(b), mrb_int_value(mrb, color.b));
-  mrb_hash_set(mrb, vhash, usym_val(a), mrb_int_value(mrb, color.a));
+  return getcolor_pixels_of(mrb, imgcache_get(mrb, fpath), coords, ncoords,
+                            getcolor_format_of(mrb, as));
+}
 
-  return vhash;
+mrb_value getcolor_region(mrb_state *mrb, mrb_value _) {
+  char *fpath;
+  mrb_int x, y, w, h;
+  mrb_value as = mrb_undef_value();
+  const mrb_kwargs kwargs = {1, 0, &usym(as), &as, NULL};
+  mrb_get_args(mrb, "ziiii:", &fpath, &x, &y, &w, &h, &kwargs);
+
+  return getcolor_region_of(mrb, imgcache_get(mrb, fpath), x, y, w, h,
+                            getcolor_format_of(mrb, as));
+}
+
+/* colour -> tile id table, open addressing over abgr; slots with used == 0
+ * are free */
+struct palette_t {
+  uint32_t *keys;
+  mrb_int *ids;
+  _Bool *used;
+  uint32_t mask;
+};
+
+static inline uint32_t palette_hash(uint32_t abgr) {
+  return (abgr * UINT32_C(0x9e3779b1)) >> 7;
+}
+
+mrb_int *palette_slot(struct palette_t *pal, uint32_t abgr, _Bool insert) {
+  for (uint32_t h = palette_hash(abgr);; ++h) {
+    uint32_t i = h & pal->mask;
+    if (!pal->used[i]) {
+      if (!insert)
+        return nullptr;
+      pal->used[i] = 1;
+      pal->keys[i] = abgr;
+      return &pal->ids[i];
+    }
+    if (pal->keys[i] == abgr)
+      return &pal->ids[i];
+  }
+}
+
+/* keys are [r, g, b] / [r, g, b, a] arrays or abgr Integers */
+uint32_t palette_key_of(mrb_state *mrb, mrb_value key) {
+  if (mrb_integer_p(key)) {
+    const mrb_int abgr = mrb_integer(key);
+    if (abgr < 0 || abgr > 0xffffffff)
+      mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid palette colour %v", key);
+    return (uint32_t)abgr;
+  }
+
+  if (!mrb_array_p(key) || RARRAY_LEN(key) < 3 || RARRAY_LEN(key) > 4)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid palette colour %v", key);
+
+  color_t color = {.a = 255};
+  for (mrb_int i = 0; i < RARRAY_LEN(key); ++i) {
+    mrb_int c = mrb_as_int(mrb, RARRAY_PTR(key)[i]);
+    if (c < 0 || c > 255)
+      mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid palette colour %v", key);
+    color.array[i] = c;
+  }
+
+  return color.abgr;
+}
+
+struct palette_build_t {
+  struct palette_t *pal;
+  mrb_int max_id;
+  mrb_int min_id;
+};
+
+/* called once with pal == nullptr to validate (and possibly raise) before
+ * anything is allocated, then again to fill the table */
+static int palette_build_i(mrb_state *mrb, mrb_value key, mrb_value val,
+                           void *data) {
+  struct palette_build_t *b = data;
+  mrb_int id = mrb_as_int(mrb, val);
+  uint32_t abgr = palette_key_of(mrb, key);
+
+  if (b->pal)
+    *palette_slot(b->pal, abgr, 1) = id;
+  b->max_id = id > b->max_id ? id : b->max_id;
+  b->min_id = id < b->min_id ? id : b->min_id;
+
+  return 0;
+}
+
+mrb_value getcolor_to_grid_of(mrb_state *mrb, const struct imgcache_entry_t *e,
+                              mrb_value palette, mrb_value dflt,
+                              mrb_value as) {
+  if (!mrb_hash_p(palette))
+    mrb_raisef(mrb, E_TYPE_ERROR, "palette: must be a Hash, got %T", palette);
+
+  /* one byte per tile, so :string here packs ids rather than colours */
+  const _Bool bytes = getcolor_format_of(mrb, as) == GETCOLOR_STRING;
+
+  mrb_int default_id = mrb_undef_p(dflt) ? 0 : mrb_as_int(mrb, dflt);
+
+  struct palette_build_t build = {
+      .pal = nullptr, .max_id = default_id, .min_id = default_id};
+  mrb_hash_foreach(mrb, mrb_hash_ptr(palette), palette_build_i, &build);
+
+  if (bytes && (build.min_id < 0 || build.max_id > 255))
+    mrb_raise(mrb, E_ARGUMENT_ERROR,
+              "tile ids outside of 0..255 need as: :ints");
+
+  uint32_t capa = 16;
+  while (capa < (uint32_t)mrb_hash_size(mrb, palette) * 2)
+    capa *= 2;
+
+  /* a String, so a raise can't leak it */
+  const size_t block_bytes =
+      capa * (sizeof(uint32_t) + sizeof(mrb_int) + sizeof(_Bool));
+  mrb_value vblock = mrb_str_new(mrb, nullptr, block_bytes);
+  void *block = RSTRING_PTR(vblock);
+  memset(block, 0, block_bytes);
+  struct palette_t pal = {
+      .ids = block,
+      .keys = (uint32_t *)((mrb_int *)block + capa),
+      .used = (_Bool *)((uint32_t *)((mrb_int *)block + capa) + capa),
+      .mask = capa - 1,
+  };
+  build.pal = &pal;
+  mrb_hash_foreach(mrb, mrb_hash_ptr(palette), palette_build_i, &build);
+
+  const struct imgdata_t *img = &e->img;
+  const size_t n = (size_t)img->w * img->h;
+  mrb_value res =
+      bytes ? mrb_str_new(mrb, nullptr, n) : mrb_ary_new_capa(mrb, n);
+  uint8_t *out = bytes ? (uint8_t *)RSTRING_PTR(res) : nullptr;
+
+  /* runs of one colour are common, so the last lookup is memoized */
+  uint32_t last_key = 0;
+  mrb_int last_id = default_id;
+  _Bool have_last = 0;
+
+  for (uint32_t y = 0; y < img->h; ++y) {
+    const color_t *row = &img->as[(img->h - y - 1) * img->w];
+
+    for (uint32_t x = 0; x < img->w; ++x) {
+      const uint32_t key = row[x].abgr;
+
+      if (!have_last || key != last_key) {
+        mrb_int *id = palette_slot(&pal, key, 0);
+        last_id = id ? *id : default_id;
+        last_key = key;
+        have_last = 1;
+      }
+
+      if (out)
+        out[(size_t)y * img->w + x] = last_id;
+      else
+        mrb_ary_push(mrb, res, mrb_int_value(mrb, last_id));
+    }
+  }
+
+  return res;
+}
+
+/* LSB-first bitset over rows bottom to top, bit y * w + x set where
+ * alpha >= threshold */
+mrb_value getcolor_to_mask_of(mrb_state *mrb, const struct imgcache_entry_t *e,
+                              mrb_int threshold) {
+  const struct imgdata_t *img = &e->img;
+  const size_t n = (size_t)img->w * img->h;
+  mrb_value res = mrb_str_new(mrb, nullptr, (n + 7) / 8);
+  uint8_t *out = (uint8_t *)RSTRING_PTR(res);
+  memset(out, 0, (n + 7) / 8);
+
+  size_t bit = 0;
+  for (uint32_t y = 0; y < img->h; ++y) {
+    const color_t *row = &img->as[(img->h - y - 1) * img->w];
+    for (uint32_t x = 0; x < img->w; ++x, ++bit)
+      out[bit >> 3] |= (uint8_t)(row[x].a >= threshold) << (bit & 7);
+  }
+
+  return res;
+}
+
+mrb_value getcolor_to_grid(mrb_state *mrb, mrb_value _) {
+  char *fpath;
+  const mrb_sym kws[] = {usym(palette), usym(default), usym(as)};
+  mrb_value kwvals[3];
+  const mrb_kwargs kwargs = {3, 1, kws, kwvals, NULL};
+  mrb_get_args(mrb, "z:", &fpath, &kwargs);
+
+  return getcolor_to_grid_of(mrb, imgcache_get(mrb, fpath), kwvals[0],
+                             kwvals[1], kwvals[2]);
+}
+
+mrb_value getcolor_to_mask(mrb_state *mrb, mrb_value _) {
+  char *fpath;
+  mrb_value threshold = mrb_undef_value();
+  const mrb_kwargs kwargs = {1, 0, &usym(threshold), &threshold, NULL};
+  mrb_get_args(mrb, "z:", &fpath, &kwargs);
+
+  return getcolor_to_mask_of(
+      mrb, imgcache_get(mrb, fpath),
+      mrb_undef_p(threshold) ? 128 : mrb_as_int(mrb, threshold));
+}
+
+/* colour -> count table, open addressing over abgr. keys and counts share
+ * one String, so a raise can't leak them */
+struct colorcount_t {
+  uint32_t *keys;
+  uint32_t *counts;
+  size_t size;
+  size_t mask;
+};
+
+void colorcount_grow(mrb_state *mrb, struct colorcount_t *cc) {
+  size_t capa = cc->keys ? (cc->mask + 1) * 2 : 256;
+  mrb_value block = mrb_str_new(mrb, nullptr, capa * 2 * sizeof(uint32_t));
+  uint32_t *keys = (uint32_t *)RSTRING_PTR(block);
+  uint32_t *counts = keys + capa;
+  memset(counts, 0, capa * sizeof(uint32_t));
+
+  for (size_t i = 0; cc->keys && i <= cc->mask; ++i) {
+    if (cc->counts[i] == 0)
+      continue;
+    for (uint32_t h = palette_hash(cc->keys[i]);; ++h) {
+      if (counts[h & (capa - 1)] == 0) {
+        keys[h & (capa - 1)] = cc->keys[i];
+        counts[h & (capa - 1)] = cc->counts[i];
+        break;
+      }
+    }
+  }
+
+  cc->keys = keys;
+  cc->counts = counts;
+  cc->mask = capa - 1;
+}
+
+/* a zero count marks a free slot */
+void colorcount_add(mrb_state *mrb, struct colorcount_t *cc, uint32_t abgr,
+                    uint32_t n) {
+  if (!cc->keys || (cc->size + 1) * 2 > cc->mask + 1)
+    colorcount_grow(mrb, cc);
+
+  for (uint32_t h = palette_hash(abgr);; ++h) {
+    size_t i = h & cc->mask;
+    if (cc->counts[i] == 0) {
+      cc->keys[i] = abgr;
+      cc->counts[i] = n;
+      ++cc->size;
+      return;
+    }
+    if (cc->keys[i] == abgr) {
+      cc->counts[i] += n;
+      return;
+    }
+  }
+}
+
+/* the end of the run of key starting at px[from], at most n; dispatched on
+ * the cpu like getcolor_match_row below */
+static size_t getcolor_run_end_scalar(const uint32_t *px, size_t from,
+                                      size_t n, uint32_t key) {
+  size_t j = from;
+
+  CEXT_SCALAR_LOOP
+  while (j < n && px[j] == key)
+    ++j;
+
+  return j;
+}
+
+#ifdef CEXT_SIMD_X86
+/* four pixels per compare, the first clear bit of the mask ends the run */
+CEXT_TARGET_SSE2 static size_t getcolor_run_end_sse2(const uint32_t *px,
+                                                     size_t from, size_t n,
+                                                     uint32_t key) {
+  const __m128i needle = _mm_set1_epi32((int32_t)key);
+  size_t j = from;
+
+  for (; j + 4 <= n; j += 4) {
+    const __m128i v = _mm_loadu_si128((const __m128i *)&px[j]);
+    const uint32_t mask =
+        _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, needle)));
+    if (mask != 0xf)
+      return j + __builtin_ctz(~mask);
+  }
+
+  return getcolor_run_end_scalar(px, j, n, key);
+}
+
+/* eight pixels per compare */
+CEXT_TARGET_AVX2 static size_t getcolor_run_end_avx2(const uint32_t *px,
+                                                     size_t from, size_t n,
+                                                     uint32_t key) {
+  const __m256i needle = _mm256_set1_epi32((int32_t)key);
+  size_t j = from;
+
+  for (; j + 8 <= n; j += 8) {
+    const __m256i v = _mm256_loadu_si256((const __m256i *)&px[j]);
+    const uint32_t mask = _mm256_movemask_ps(
+        _mm256_castsi256_ps(_mm256_cmpeq_epi32(v, needle)));
+    if (mask != 0xff)
+      return j + __builtin_ctz(~mask);
+  }
+
+  return getcolor_run_end_scalar(px, j, n, key);
+}
+#endif
+
+static size_t (*getcolor_run_end)(const uint32_t *px, size_t from, size_t n,
+                                  uint32_t key) = getcolor_run_end_scalar;
+
+struct colorcount_t colorcount_of(mrb_state *mrb, const struct imgdata_t *img) {
+  struct colorcount_t cc = {0};
+  const size_t n = (size_t)img->w * img->h;
+
+  /* count runs instead of single pixels, flat areas are the common case */
+  size_t i = 0;
+  while (i < n) {
+    const uint32_t key = img->as[i].abgr;
+    const size_t j =
+        getcolor_run_end((const uint32_t *)img->as, i + 1, n, key);
+    colorcount_add(mrb, &cc, key, j - i);
+    i = j;
+  }
+
+  return cc;
+}
+
+mrb_value getcolor_histogram_of(mrb_state *mrb,
+                                const struct imgcache_entry_t *e) {
+  struct colorcount_t cc = colorcount_of(mrb, &e->img);
+
+  /* a zero-pixel image never allocated the table */
+  if (cc.size == 0)
+    return mrb_hash_new(mrb);
+
+  mrb_value res = mrb_hash_new_capa(mrb, cc.size);
+
+  for (size_t i = 0; i <= cc.mask; ++i)
+    if (cc.counts[i])
+      mrb_hash_set(mrb, res, mrb_int_value(mrb, cc.keys[i]),
+                   mrb_int_value(mrb, cc.counts[i]));
+
+  return res;
+}
+
+/* median cut over the distinct colours, weighted by their counts */
+struct colorbin_t {
+  color_t color;
+  uint32_t count;
+};
+
+#define colorbin_cmp_channel(ch)                                               \
+  static int colorbin_cmp_##ch(const void *a, const void *b) {                 \
+    return (int)((const struct colorbin_t *)a)->color.array[ch] -              \
+           (int)((const struct colorbin_t *)b)->color.array[ch];               \
+  }
+
+colorbin_cmp_channel(0);
+colorbin_cmp_channel(1);
+colorbin_cmp_channel(2);
+colorbin_cmp_channel(3);
+
+#undef colorbin_cmp_channel
+
+static int (*const colorbin_cmp[4])(const void *, const void *) = {
+    colorbin_cmp_0, colorbin_cmp_1, colorbin_cmp_2, colorbin_cmp_3};
+
+struct colorbox_t {
+  size_t start;
+  size_t end;
+  uint64_t population;
+  uint8_t channel;
+  uint8_t range;
+};
+
+void colorbox_measure(const struct colorbin_t *bins, struct colorbox_t *box) {
+  uint8_t lo[4] = {255, 255, 255, 255};
+  uint8_t hi[4] = {0, 0, 0, 0};
+  box->population = 0;
+
+  for (size_t i = box->start; i < box->end; ++i) {
+    for (int ch = 0; ch < 4; ++ch) {
+      const uint8_t c = bins[i].color.array[ch];
+      lo[ch] = c < lo[ch] ? c : lo[ch];
+      hi[ch] = c > hi[ch] ? c : hi[ch];
+    }
+    box->population += bins[i].count;
+  }
+
+  box->range = 0;
+  box->channel = 0;
+  for (int ch = 0; ch < 4; ++ch) {
+    if (hi[ch] - lo[ch] > box->range) {
+      box->range = hi[ch] - lo[ch];
+      box->channel = ch;
+    }
+  }
+}
+
+static int colorbox_cmp_population(const void *a, const void *b) {
+  const uint64_t pa = ((const struct colorbox_t *)a)->population;
+  const uint64_t pb = ((const struct colorbox_t *)b)->population;
+  return pa < pb ? 1 : pa > pb ? -1 : 0;
+}
+
+mrb_value getcolor_dominant_colors_of(mrb_state *mrb,
+                                      const struct imgcache_entry_t *e,
+                                      mrb_int k) {
+  if (k <= 0)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "non-positive colour count (%i)", k);
+
+  struct colorcount_t cc = colorcount_of(mrb, &e->img);
+  if (cc.size == 0)
+    return mrb_ary_new(mrb);
+
+  /* Strings, so a raise can't leak them */
+  mrb_value vbins =
+      mrb_str_new(mrb, nullptr, cc.size * sizeof(struct colorbin_t));
+  struct colorbin_t *bins = (struct colorbin_t *)RSTRING_PTR(vbins);
+
+  size_t nbins = 0;
+  for (size_t i = 0; i <= cc.mask; ++i)
+    if (cc.counts[i])
+      bins[nbins++] = (struct colorbin_t){.color.abgr = cc.keys[i],
+                                          .count = cc.counts[i]};
+
+  if ((size_t)k > nbins)
+    k = nbins;
+
+  mrb_value vboxes = mrb_str_new(mrb, nullptr, k * sizeof(struct colorbox_t));
+  struct colorbox_t *boxes = (struct colorbox_t *)RSTRING_PTR(vboxes);
+  size_t nboxes = 1;
+  boxes[0] = (struct colorbox_t){.start = 0, .end = nbins};
+  colorbox_measure(bins, &boxes[0]);
+
+  while (nboxes < (size_t)k) {
+    /* split the box with the widest channel range */
+    size_t pick = nboxes;
+    for (size_t i = 0; i < nboxes; ++i)
+      if (boxes[i].end - boxes[i].start > 1 &&
+          (pick == nboxes || boxes[i].range > boxes[pick].range))
+        pick = i;
+    if (pick == nboxes)
+      break;
+
+    struct colorbox_t *box = &boxes[pick];
+    qsort(bins + box->start, box->end - box->start, sizeof(struct colorbin_t),
+          colorbin_cmp[box->channel]);
+
+    /* weighted median, leaving at least one bin on each side */
+    uint64_t acc = 0;
+    size_t mid = box->start + 1;
+    for (size_t i = box->start; i < box->end - 1; ++i) {
+      acc += bins[i].count;
+      mid = i + 1;
+      if (acc * 2 >= box->population)
+        break;
+    }
+
+    boxes[nboxes] = (struct colorbox_t){.start = mid, .end = box->end};
+    box->end = mid;
+    colorbox_measure(bins, box);
+    colorbox_measure(bins, &boxes[nboxes]);
+    ++nboxes;
+  }
+
+  qsort(boxes, nboxes, sizeof(struct colorbox_t), colorbox_cmp_population);
+
+  mrb_value res = mrb_ary_new_capa(mrb, nboxes);
+  for (size_t b = 0; b < nboxes; ++b) {
+    uint64_t sum[4] = {0};
+    for (size_t i = boxes[b].start; i < boxes[b].end; ++i)
+      for (int ch = 0; ch < 4; ++ch)
+        sum[ch] += (uint64_t)bins[i].color.array[ch] * bins[i].count;
+
+    color_t avg;
+    for (int ch = 0; ch < 4; ++ch)
+      avg.array[ch] = (sum[ch] + boxes[b].population / 2) / boxes[b].population;
+
+    mrb_ary_push(mrb, res, mrb_int_value(mrb, avg.abgr));
+  }
+
+  return res;
+}
+
+/* writes the x of every pixel equal to abgr in row[from, w) to xs, returns
+ * the count */
+static uint32_t getcolor_match_tail(const uint32_t *row, uint32_t from,
+                                    uint32_t w, uint32_t abgr, uint32_t *xs) {
+  uint32_t n = 0;
+
+  CEXT_SCALAR_LOOP
+  for (uint32_t x = from; x < w; ++x)
+    if (row[x] == abgr)
+      xs[n++] = x;
+
+  return n;
+}
+
+/* the same over the whole row, dispatched on the cpu at load time */
+typedef uint32_t (*getcolor_match_row_fn)(const uint32_t *row, uint32_t w,
+                                          uint32_t abgr, uint32_t *xs);
+
+static uint32_t getcolor_match_row_scalar(const uint32_t *row, uint32_t w,
+                                          uint32_t abgr, uint32_t *xs) {
+  return getcolor_match_tail(row, 0, w, abgr, xs);
+}
+
+#ifdef CEXT_SIMD_X86
+/* four pixels per compare, the bits of the match mask give the xs */
+CEXT_TARGET_SSE2 static uint32_t getcolor_match_row_sse2(const uint32_t *row,
+                                                         uint32_t w,
+                                                         uint32_t abgr,
+                                                         uint32_t *xs) {
+  const __m128i needle = _mm_set1_epi32((int32_t)abgr);
+  uint32_t n = 0;
+  uint32_t x = 0;
+
+  for (; x + 4 <= w; x += 4) {
+    const __m128i v = _mm_loadu_si128((const __m128i *)&row[x]);
+    uint32_t mask =
+        _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, needle)));
+
+    for (; mask; mask &= mask - 1)
+      xs[n++] = x + __builtin_ctz(mask);
+  }
+
+  return n + getcolor_match_tail(row, x, w, abgr, xs + n);
+}
+
+/* eight pixels per compare */
+CEXT_TARGET_AVX2 static uint32_t getcolor_match_row_avx2(const uint32_t *row,
+                                                         uint32_t w,
+                                                         uint32_t abgr,
+                                                         uint32_t *xs) {
+  const __m256i needle = _mm256_set1_epi32((int32_t)abgr);
+  uint32_t n = 0;
+  uint32_t x = 0;
+
+  for (; x + 8 <= w; x += 8) {
+    const __m256i v = _mm256_loadu_si256((const __m256i *)&row[x]);
+    uint32_t mask = _mm256_movemask_ps(
+        _mm256_castsi256_ps(_mm256_cmpeq_epi32(v, needle)));
+
+    for (; mask; mask &= mask - 1)
+      xs[n++] = x + __builtin_ctz(mask);
+  }
+
+  return n + getcolor_match_tail(row, x, w, abgr, xs + n);
+}
+#endif
+
+static getcolor_match_row_fn getcolor_match_row = getcolor_match_row_scalar;
+
+static void getcolor_simd_select(enum cext_isa isa) {
+  getcolor_match_row =
+      CEXT_SIMD_PICK(isa, getcolor_match_row_scalar, getcolor_match_row_sse2,
+                     getcolor_match_row_avx2);
+  getcolor_run_end =
+      CEXT_SIMD_PICK(isa, getcolor_run_end_scalar, getcolor_run_end_sse2,
+                     getcolor_run_end_avx2);
+}
+
+/* flat [x0, y0, x1, y1, ...], rows bottom to top */
+mrb_value getcolor_find_color_of(mrb_state *mrb,
+                                 const struct imgcache_entry_t *e,
+                                 mrb_value rgba) {
+  const struct imgdata_t *img = &e->img;
+  const uint32_t abgr = palette_key_of(mrb, rgba);
+  mrb_value res = mrb_ary_new(mrb);
+
+  /* a String, so a raise can't leak it */
+  mrb_value vxs = mrb_str_new(mrb, nullptr, img->w * sizeof(uint32_t));
+  uint32_t *xs = (uint32_t *)RSTRING_PTR(vxs);
+
+  for (uint32_t y = 0; y < img->h; ++y) {
+    const color_t *row = &img->as[(img->h - y - 1) * img->w];
+    const uint32_t n =
+        getcolor_match_row((const uint32_t *)row, img->w, abgr, xs);
+
+    for (uint32_t i = 0; i < n; ++i) {
+      mrb_ary_push(mrb, res, mrb_int_value(mrb, xs[i]));
+      mrb_ary_push(mrb, res, mrb_int_value(mrb, y));
+    }
+  }
+
+  return res;
+}
+
+mrb_value getcolor_histogram(mrb_state *mrb, mrb_value _) {
+  char *fpath;
+  mrb_get_args(mrb, "z", &fpath);
+  return getcolor_histogram_of(mrb, imgcache_get(mrb, fpath));
+}
+
+mrb_value getcolor_dominant_colors(mrb_state *mrb, mrb_value _) {
+  char *fpath;
+  mrb_int k;
+  mrb_get_args(mrb, "zi", &fpath, &k);
+  return getcolor_dominant_colors_of(mrb, imgcache_get(mrb, fpath), k);
+}
+
+mrb_value getcolor_find_color(mrb_state *mrb, mrb_value _) {
+  char *fpath;
+  mrb_value rgba;
+  mrb_get_args(mrb, "zo", &fpath, &rgba);
+  return getcolor_find_color_of(mrb, imgcache_get(mrb, fpath), rgba);
+}
+
+static const mrb_data_type getcolor_image_datatype = {
+    .struct_name = "ColorPicker::Image",
+    .dfree = (void (*)(mrb_state *, void *))imgcache_release};
+
+struct imgcache_entry_t *getcolor_image_get(mrb_state *mrb, mrb_value self) {
+  struct imgcache_entry_t *e =
+      mrb_data_get_ptr(mrb, self, &getcolor_image_datatype);
+
+  if (!e)
+    mrb_raisef(mrb, E_RUNTIME_ERROR, "uninitialized %T", self);
+
+  return e;
+}
+
+mrb_value getcolor_image_init(mrb_state *mrb, mrb_value self) {
+  char *fpath;
+  mrb_get_args(mrb, "z", &fpath);
+
+  struct imgcache_entry_t *e = DATA_PTR(self);
+  if (e && DATA_TYPE(self) == &getcolor_image_datatype)
+    imgcache_release(mrb, e);
+  mrb_data_init(self, nullptr, &getcolor_image_datatype);
+
+  e = imgcache_get(mrb, fpath);
+  ++e->refct;
+  mrb_data_init(self, e, &getcolor_image_datatype);
+
+  return self;
+}
+
+mrb_value getcolor_image_pixel(mrb_state *mrb, mrb_value self) {
+  mrb_int x;
+  mrb_int y;
+  mrb_get_args(mrb, "ii", &x, &y);
+
+  const struct imgcache_entry_t *e = getcolor_image_get(mrb, self);
+  imgdata_check_bounds(mrb, &e->img, e->path, x, y);
+
+  return getcolor_color_hash(mrb, imgdata_at(&e->img, x, y));
+}
+
+mrb_value getcolor_image_pixels(mrb_state *mrb, mrb_value self) {
+  const mrb_value *coords;
+  mrb_int ncoords;
+  mrb_value as = mrb_undef_value();
+  const mrb_kwargs kwargs = {1, 0, &usym(as), &as, NULL};
+  mrb_get_args(mrb, "a:", &coords, &ncoords, &kwargs);
+
+  return getcolor_pixels_of(mrb, getcolor_image_get(mrb, self), coords,
+                            ncoords, getcolor_format_of(mrb, as));
+}
+
+mrb_value getcolor_image_region(mrb_state *mrb, mrb_value self) {
+  mrb_int x, y, w, h;
+  mrb_value as = mrb_undef_value();
+  const mrb_kwargs kwargs = {1, 0, &usym(as), &as, NULL};
+  mrb_get_args(mrb, "iiii:", &x, &y, &w, &h, &kwargs);
+
+  return getcolor_region_of(mrb, getcolor_image_get(mrb, self), x, y, w, h,
+                            getcolor_format_of(mrb, as));
+}
+
+mrb_value getcolor_image_to_grid(mrb_state *mrb, mrb_value self) {
+  const mrb_sym kws[] = {usym(palette), usym(default), usym(as)};
+  mrb_value kwvals[3];
+  const mrb_kwargs kwargs = {3, 1, kws, kwvals, NULL};
+  mrb_get_args(mrb, ":", &kwargs);
+
+  return getcolor_to_grid_of(mrb, getcolor_image_get(mrb, self), kwvals[0],
+                             kwvals[1], kwvals[2]);
+}
+
+mrb_value getcolor_image_to_mask(mrb_state *mrb, mrb_value self) {
+  mrb_value threshold = mrb_undef_value();
+  const mrb_kwargs kwargs = {1, 0, &usym(threshold), &threshold, NULL};
+  mrb_get_args(mrb, ":", &kwargs);
+
+  return getcolor_to_mask_of(
+      mrb, getcolor_image_get(mrb, self),
+      mrb_undef_p(threshold) ? 128 : mrb_as_int(mrb, threshold));
+}
+
+mrb_value getcolor_image_histogram(mrb_state *mrb, mrb_value self) {
+  return getcolor_histogram_of(mrb, getcolor_image_get(mrb, self));
+}
+
+mrb_value getcolor_image_dominant_colors(mrb_state *mrb, mrb_value self) {
+  mrb_int k;
+  mrb_get_args(mrb, "i", &k);
+  return getcolor_dominant_colors_of(mrb, getcolor_image_get(mrb, self), k);
+}
+
+mrb_value getcolor_image_find_color(mrb_state *mrb, mrb_value self) {
+  mrb_value rgba;
+  mrb_get_args(mrb, "o", &rgba);
+  return getcolor_find_color_of(mrb, getcolor_image_get(mrb, self), rgba);
+}
+
+mrb_value getcolor_image_width(mrb_state *mrb, mrb_value self) {
+  return mrb_int_value(mrb, getcolor_image_get(mrb, self)->img.w);
+}
+
+mrb_value getcolor_image_height(mrb_state *mrb, mrb_value self) {
+  return mrb_int_value(mrb, getcolor_image_get(mrb, self)->img.h);
+}
+
+mrb_value getcolor_image_path(mrb_state *mrb, mrb_value self) {
+  return mrb_str_new_cstr(mrb, getcolor_image_get(mrb, self)->path);
 }
 
 #define init_sym(mrb, name)                                                    \
@@ -95,9 +1419,58 @@ void drb_register_c_extensions_with_api(mrb_state *mrb, struct drb_api_t *api) {
   init_sym(mrb, g);
   init_sym(mrb, b);
   init_sym(mrb, a);
+  init_sym(mrb, as);
+  init_sym(mrb, string);
+  init_sym(mrb, ints);
+  init_sym(mrb, palette);
+  init_sym(mrb, default);
+  init_sym(mrb, threshold);
 
   struct RClass *ColorPicker =
     mrb_define_module_id(mrb, mrb_intern_lit(mrb, "ColorPicker"));
 
+  getcolor_module = ColorPicker;
+  preload_callbacks_sym = mrb_intern_lit(mrb, "__preload_callbacks__");
+  preload_finished_sym = mrb_intern_lit(mrb, "__preload_finished__");
+  mrb_iv_set(mrb, mrb_obj_value(ColorPicker), preload_callbacks_sym, mrb_hash_new(mrb));
+  mrb_iv_set(mrb, mrb_obj_value(ColorPicker), preload_finished_sym, mrb_ary_new(mrb));
+  mrb_state_atexit(mrb, preload_atexit);
+
   mrb_define_module_function_id(mrb, ColorPicker, mrb_intern_lit(mrb, "pixel"), getcolor_getpixel_ncache, MRB_ARGS_REQ(3));
+  mrb_define_module_function_id(mrb, ColorPicker, mrb_intern_lit(mrb, "pixels"), getcolor_pixels, MRB_ARGS_REQ(2) | MRB_ARGS_KEY(1, 0));
+  mrb_define_module_function_id(mrb, ColorPicker, mrb_intern_lit(mrb, "region"), getcolor_region, MRB_ARGS_REQ(5) | MRB_ARGS_KEY(1, 0));
+  mrb_define_module_function_id(mrb, ColorPicker, mrb_intern_lit(mrb, "to_grid"), getcolor_to_grid, MRB_ARGS_REQ(1) | MRB_ARGS_KEY(3, 0));
+  mrb_define_module_function_id(mrb, ColorPicker, mrb_intern_lit(mrb, "to_mask"), getcolor_to_mask, MRB_ARGS_REQ(1) | MRB_ARGS_KEY(1, 0));
+  mrb_define_module_function_id(mrb, ColorPicker, mrb_intern_lit(mrb, "histogram"), getcolor_histogram, MRB_ARGS_REQ(1));
+  mrb_define_module_function_id(mrb, ColorPicker, mrb_intern_lit(mrb, "dominant_colors"), getcolor_dominant_colors, MRB_ARGS_REQ(2));
+  mrb_define_module_function_id(mrb, ColorPicker, mrb_intern_lit(mrb, "find_color"), getcolor_find_color, MRB_ARGS_REQ(2));
+  mrb_define_module_function_id(mrb, ColorPicker, mrb_intern_lit(mrb, "preload"), getcolor_preload, MRB_ARGS_REQ(1) | MRB_ARGS_BLOCK());
+  mrb_define_module_function_id(mrb, ColorPicker, mrb_intern_lit(mrb, "ready?"), getcolor_ready_p, MRB_ARGS_REQ(1));
+  mrb_define_module_function_id(mrb, ColorPicker, mrb_intern_lit(mrb, "await"), getcolor_await, MRB_ARGS_REQ(1));
+  mrb_define_module_function_id(mrb, ColorPicker, mrb_intern_lit(mrb, "poll"), getcolor_poll, MRB_ARGS_NONE());
+  mrb_define_module_function_id(mrb, ColorPicker, mrb_intern_lit(mrb, "evict"), getcolor_evict, MRB_ARGS_REQ(1));
+  mrb_define_module_function_id(mrb, ColorPicker, mrb_intern_lit(mrb, "clear"), getcolor_clear, MRB_ARGS_NONE());
+  mrb_define_module_function_id(mrb, ColorPicker, mrb_intern_lit(mrb, "cache_budget"), getcolor_cache_budget, MRB_ARGS_NONE());
+  mrb_define_module_function_id(mrb, ColorPicker, mrb_intern_lit(mrb, "cache_budget="), getcolor_cache_budget_set, MRB_ARGS_REQ(1));
+  mrb_define_module_function_id(mrb, ColorPicker, mrb_intern_lit(mrb, "cache_bytes"), getcolor_cache_bytes, MRB_ARGS_NONE());
+
+  struct RClass *Image = mrb_define_class_under_id(
+      mrb, ColorPicker, mrb_intern_lit(mrb, "Image"), mrb->object_class);
+  MRB_SET_INSTANCE_TT(Image, MRB_TT_DATA);
+
+  mrb_define_method_id(mrb, Image, mrb_intern_lit(mrb, "initialize"), getcolor_image_init, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, Image, mrb_intern_lit(mrb, "pixel"), getcolor_image_pixel, MRB_ARGS_REQ(2));
+  mrb_define_method_id(mrb, Image, mrb_intern_lit(mrb, "pixels"), getcolor_image_pixels, MRB_ARGS_REQ(1) | MRB_ARGS_KEY(1, 0));
+  mrb_define_method_id(mrb, Image, mrb_intern_lit(mrb, "region"), getcolor_image_region, MRB_ARGS_REQ(4) | MRB_ARGS_KEY(1, 0));
+  mrb_define_method_id(mrb, Image, mrb_intern_lit(mrb, "to_grid"), getcolor_image_to_grid, MRB_ARGS_KEY(3, 0));
+  mrb_define_method_id(mrb, Image, mrb_intern_lit(mrb, "to_mask"), getcolor_image_to_mask, MRB_ARGS_KEY(1, 0));
+  mrb_define_method_id(mrb, Image, mrb_intern_lit(mrb, "histogram"), getcolor_image_histogram, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, Image, mrb_intern_lit(mrb, "dominant_colors"), getcolor_image_dominant_colors, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, Image, mrb_intern_lit(mrb, "find_color"), getcolor_image_find_color, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, Image, mrb_intern_lit(mrb, "width"), getcolor_image_width, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, Image, mrb_intern_lit(mrb, "height"), getcolor_image_height, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, Image, mrb_intern_lit(mrb, "path"), getcolor_image_path, MRB_ARGS_NONE());
+
+  CEXT_STATS_INIT(mrb, "getcolor");
+  cext_simd_init(mrb, "getcolor", getcolor_simd_select);
 }
@@ -7,6 +7,9 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "cext_pool.h"
+#include "cext_stats.h"
+
 typedef struct {
   size_t size;
   size_t capa;
@@ -15,17 +18,28 @@ typedef struct {
 
 #define MAX_SENSIBLE_SHIFT_OF_1 63
 
+enum {
+  MINHEAP_STAT_ALLOC,
+  MINHEAP_STAT_INSERT,
+  MINHEAP_STAT_POP,
+  MINHEAP_NSTATS,
+};
+
+CEXT_STATS_DEFINE(MINHEAP_NSTATS, [MINHEAP_STAT_ALLOC] = {.name = "alloc"},
+                  [MINHEAP_STAT_INSERT] = {.name = "insert"},
+                  [MINHEAP_STAT_POP] = {.name = "pop"});
+
 minheap_t *minheap_new(mrb_state *mrb, uint8_t layers) {
   assert(layers <= MAX_SENSIBLE_SHIFT_OF_1);
   size_t size = (((size_t)(1)) << layers) - 1;
-  minheap_t *minheap = mrb_malloc(mrb, sizeof(minheap_t));
+  minheap_t *minheap = cext_pool_alloc(mrb, sizeof(minheap_t));
 
   if (minheap == nullptr) {
     mrb_raisef(mrb, mrb->eStandardError_class, "failed to alloc minheap");
     __builtin_unreachable();
   }
 
-  mrb_value *data = mrb_calloc(mrb, size, sizeof(mrb_value));
+  mrb_value *data = cext_pool_alloc(mrb, size * sizeof(mrb_value));
 
   if (data == nullptr) {
     mrb_raisef(mrb, mrb->eStandardError_class,
@@ -33,9 +47,17 @@ minheap_t *minheap_new(mrb_state *mrb, uint8_t layers) {
     __builtin_unreachable();
   }
 
+  /* the pool rounds up, so the heap gets the whole block */
+  const size_t capa =
+      cext_pool_class_size(size * sizeof(mrb_value)) / sizeof(mrb_value);
+
+  CEXT_STAT(MINHEAP_STAT_ALLOC, calls, 1);
+  CEXT_STAT(MINHEAP_STAT_ALLOC, bytes,
+            sizeof(minheap_t) + capa * sizeof(mrb_value));
+
   *minheap = (minheap_t){
       .size = 0,
-      .capa = size,
+      .capa = capa,
       .data = data,
   };
   return minheap;
@@ -48,8 +70,38 @@ void minheap_free(mrb_state *mrb, minheap_t *minheap) {
   for (size_t i = 0; i < minheap->size; ++i)
     mrb_gc_unregister(mrb, minheap->data[i]);
 
-  mrb_free(mrb, minheap->data);
-  mrb_free(mrb, minheap);
+  cext_pool_free(mrb, minheap->data, minheap->capa * sizeof(mrb_value));
+  cext_pool_free(mrb, minheap, sizeof(minheap_t));
+}
+
+/* grows the buffer to hold at least capa values */
+void minheap_reserve(mrb_state *mrb, minheap_t *minheap, size_t capa) {
+  if (capa <= minheap->capa)
+    return;
+
+  mrb_value *new_data =
+      cext_pool_realloc(mrb, minheap->data, minheap->capa * sizeof(mrb_value),
+                        capa * sizeof(mrb_value));
+  if (new_data == nullptr) {
+    mrb_raisef(mrb, mrb->eStandardError_class,
+               "oom: not enough memory to grow a heap to %i values",
+               (mrb_int)capa);
+    __builtin_unreachable();
+  }
+
+  capa = cext_pool_class_size(capa * sizeof(mrb_value)) / sizeof(mrb_value);
+  CEXT_STAT(MINHEAP_STAT_ALLOC, bytes,
+            (capa - minheap->capa) * sizeof(mrb_value));
+  minheap->capa = capa;
+  minheap->data = new_data;
+}
+
+/* drops every value but keeps the buffer for reuse */
+void minheap_clear(mrb_state *mrb, minheap_t *minheap) {
+  for (size_t i = 0; i < minheap->size; ++i)
+    mrb_gc_unregister(mrb, minheap->data[i]);
+
+  minheap->size = 0;
 }
 
 [[clang::always_inline]] mrb_value minheap_get_top(const minheap_t *minheap) {
@@ -96,6 +148,7 @@ mrb_value minheap_get_right_child_of(const minheap_t *minheap, size_t idx) {
 
 [[clang::always_inline]] mrb_bool
 minheap_mrb_value_gtcmp(mrb_state *mrb, mrb_value left, mrb_value right) {
+  CEXT_STAT(MINHEAP_STAT_INSERT, comparisons, 1);
   mrb_int cmp = mrb_cmp(mrb, left, right);
   if (cmp == -2)
     mrb_raisef(mrb, E_TYPE_ERROR, "comparison of %Y and %Y failed", left,
@@ -105,6 +158,7 @@ minheap_mrb_value_gtcmp(mrb_state *mrb, mrb_value left, mrb_value right) {
 
 [[clang::always_inline]] mrb_bool
 minheap_mrb_value_ltcmp(mrb_state *mrb, mrb_value left, mrb_value right) {
+  CEXT_STAT(MINHEAP_STAT_POP, comparisons, 1);
   mrb_int cmp = mrb_cmp(mrb, left, right);
   if (cmp == -2)
     mrb_raisef(mrb, E_TYPE_ERROR, "comparison of %Y and %Y failed", left,
@@ -113,18 +167,10 @@ minheap_mrb_value_ltcmp(mrb_state *mrb, mrb_value left, mrb_value right) {
 }
 
 minheap_t *minheap_insert(mrb_state *mrb, minheap_t *minheap, mrb_value val) {
-  if (minheap->size == minheap->capa) {
-    mrb_value *new_data = mrb_realloc(
-        mrb, minheap->data, (minheap->capa * 2 + 1) * sizeof(mrb_value));
-    if (new_data == nullptr) {
-      mrb_raisef(mrb, mrb->eStandardError_class,
-                 "oom: not enough memory to reallocate a %d-layer heap",
-                 __builtin_ctz(minheap->capa + 1));
-      __builtin_unreachable();
-    }
-    minheap->capa *= 2;
-    minheap->data = new_data;
-  }
+  if (minheap->size == minheap->capa)
+    minheap_reserve(mrb, minheap, minheap->capa * 2);
+
+  CEXT_STAT(MINHEAP_STAT_INSERT, calls, 1);
 
   size_t curr = minheap->size++;
   minheap->data[curr] = val;
@@ -226,12 +272,40 @@ mrb_value minheap_peek_m(mrb_state *mrb, mrb_value self) {
 
 mrb_value minheap_pop_m(mrb_state *mrb, mrb_value self) {
   minheap_t *minheap = mrb_data_check_get_ptr(mrb, self, &minheap_datatype);
+  CEXT_STAT_CLOCK(started);
   const mrb_value top = minheap_get_top(minheap);
   minheap_delete_min(mrb, minheap);
+  CEXT_STAT(MINHEAP_STAT_POP, calls, 1);
+  CEXT_STAT_ELAPSED(MINHEAP_STAT_POP, started);
 
   return top;
 }
 
+mrb_value minheap_clear_m(mrb_state *mrb, mrb_value self) {
+  minheap_clear(mrb, mrb_data_check_get_ptr(mrb, self, &minheap_datatype));
+  return self;
+}
+
+mrb_value minheap_reserve_m(mrb_state *mrb, mrb_value self) {
+  mrb_int capa;
+  mrb_get_args(mrb, "i", &capa);
+
+  if (capa < 0)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "negative capacity %i", capa);
+  if ((size_t)capa > PTRDIFF_MAX / sizeof(mrb_value))
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "capacity %i too large", capa);
+
+  minheap_reserve(mrb, mrb_data_check_get_ptr(mrb, self, &minheap_datatype),
+                  capa);
+  return self;
+}
+
+mrb_value minheap_capacity_m(mrb_state *mrb, mrb_value self) {
+  const minheap_t *minheap =
+      mrb_data_check_get_ptr(mrb, self, &minheap_datatype);
+  return mrb_int_value(mrb, minheap->capa);
+}
+
 mrb_value minheap_to_a(mrb_state *mrb, const minheap_t *minheap) {
   return mrb_ary_new_from_values(mrb, minheap->size, minheap->data);
 }
@@ -269,10 +343,19 @@ void drb_register_c_extensions_with_api(mrb_state *mrb, struct drb_api_t *) {
   mrb_define_method(mrb, minheap_cls, "<<", minheap_insert_m, MRB_ARGS_REQ(1));
   mrb_define_method(mrb, minheap_cls, "peek", minheap_peek_m, MRB_ARGS_NONE());
   mrb_define_method(mrb, minheap_cls, "pop", minheap_pop_m, MRB_ARGS_NONE());
+  mrb_define_method(mrb, minheap_cls, "clear", minheap_clear_m,
+                    MRB_ARGS_NONE());
+  mrb_define_method(mrb, minheap_cls, "reserve", minheap_reserve_m,
+                    MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, minheap_cls, "capacity", minheap_capacity_m,
+                    MRB_ARGS_NONE());
   mrb_define_method(mrb, minheap_cls, "to_a", minheap_to_a_m, MRB_ARGS_NONE());
   mrb_define_method(mrb, minheap_cls, "size", minheap_size_m, MRB_ARGS_NONE());
   mrb_define_method(mrb, minheap_cls, "length", minheap_size_m,
                     MRB_ARGS_NONE());
   mrb_define_method(mrb, minheap_cls, "empty?", minheap_empty_p_m,
                     MRB_ARGS_NONE());
+
+  CEXT_STATS_INIT(mrb, "minheap");
+  cext_pool_init(mrb, "minheap");
 }
@@ -1,8 +1,10 @@
 #include <math.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "mruby.h"
+#include "mruby/array.h"
 #include "mruby/class.h"
 #include "mruby/data.h"
 #include "mruby/istruct.h"
@@ -11,6 +13,10 @@
 #include "mruby/value.h"
 #include "mruby/variable.h"
 
+#include "cext_pool.h"
+#include "cext_simd.h"
+#include "cext_stats.h"
+
 /* taken from mruby at rev f99e9963b2145812b6f2bd7f0dd3d8228c503c82 */
 
 const struct mrb_data_type *rand_state_type;
@@ -47,6 +53,64 @@ static mrb_value random_default(mrb_state *mrb) {
 
 /* end random */
 
+/* taken from xoroshiro_rand.c, so Xoroshiro128 instances can be used without
+ * linking against it */
+
+struct xoroshiro128p_st {
+  uint64_t lo;
+  uint64_t hi;
+};
+
+static inline uint64_t rotl(const uint64_t x, const uint8_t k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+static uint64_t xoroshiro128p_next(struct xoroshiro128p_st *st) {
+  const uint64_t s0 = st->lo;
+  uint64_t s1 = st->hi;
+
+  const uint64_t res = rotl(s0 + s1, 17) + s0;
+
+  s1 ^= s0;
+  st->lo = rotl(s0, 49) ^ s1 ^ (s1 << 21);
+  st->hi = rotl(s1, 28);
+
+  return res;
+}
+
+static void xoroshiro128p_init(struct xoroshiro128p_st *st, uint64_t seed) {
+  *st = (struct xoroshiro128p_st){
+      .hi = rotl(seed ^ UINT64_C(0xfac1e04741dab55a), seed & 0x1f),
+      .lo = rotl(seed, 12) ^ UINT64_C(0xf01e46382d57cab9)};
+}
+
+static uint64_t xoroshiro128p_next_bounded(struct xoroshiro128p_st *st,
+                                           uint64_t n) {
+  unsigned __int128 m = (unsigned __int128)xoroshiro128p_next(st) * n;
+  uint64_t l = (uint64_t)m;
+
+  if (l < n) {
+    const uint64_t t = -n % n;
+    while (l < t) {
+      m = (unsigned __int128)xoroshiro128p_next(st) * n;
+      l = (uint64_t)m;
+    }
+  }
+
+  return m >> 64;
+}
+
+/* looked up per call, a cached RClass would dangle across mrb_states */
+static struct RClass *xoroshiro128p_class(mrb_state *mrb) {
+  const mrb_sym id = mrb_intern_lit(mrb, "Xoroshiro128");
+
+  if (!mrb_class_defined_id(mrb, id))
+    return nullptr;
+  return mrb_class_get_id(mrb, id);
+}
+
+/* end xoroshiro128+ */
+
 #define as_u64(exp) __builtin_bit_cast(uint64_t, (exp))
 
 static const mrb_float empty_nan =
@@ -97,11 +161,29 @@ mrb_float grad2(uint8_t h, mrb_float x, mrb_float y) {
   }
 }
 
+enum {
+  PNOISE_STAT_ALLOC,
+  PNOISE_STAT_CELL,
+  PNOISE_STAT_ROW,
+  PNOISE_NSTATS,
+};
+
+CEXT_STATS_DEFINE(PNOISE_NSTATS, [PNOISE_STAT_ALLOC] = {.name = "alloc"},
+                  [PNOISE_STAT_CELL] = {.name = "cell"},
+                  [PNOISE_STAT_ROW] = {.name = "row"});
+
 struct pnoise_state_t *pnoise_alloc(mrb_state *mrb, size_t w, size_t h) {
-  struct pnoise_state_t *p = mrb_calloc(mrb, 1, sizeof(struct pnoise_state_t));
+  struct pnoise_state_t *p =
+      cext_pool_alloc(mrb, sizeof(struct pnoise_state_t));
 
-  mrb_float *data = mrb_malloc(mrb, w * h * sizeof(mrb_float));
-  uint32_t *ptbl = mrb_calloc(mrb, (w > h ? w : h) * 2, sizeof(uint32_t));
+  mrb_float *data = cext_pool_alloc(mrb, w * h * sizeof(mrb_float));
+  uint32_t *ptbl = cext_pool_alloc(mrb, (w > h ? w : h) * 2 * sizeof(uint32_t));
+  memset(ptbl, 0, (w > h ? w : h) * 2 * sizeof(uint32_t));
+
+  CEXT_STAT(PNOISE_STAT_ALLOC, calls, 1);
+  CEXT_STAT(PNOISE_STAT_ALLOC, bytes,
+            sizeof(struct pnoise_state_t) + w * h * sizeof(mrb_float) +
+                (w > h ? w : h) * 2 * sizeof(uint32_t));
 
   *p = (struct pnoise_state_t){
       .data = data,
@@ -128,7 +210,18 @@ static void shuffle__uint32_t(rand_state *r, uint32_t *ary, size_t size) {
   for (size_t i = size - 1; i > 0; --i) {
     size_t j = rand_uint32(r) % (i + 1);
 
-    uint8_t t = ary[i];
+    uint32_t t = ary[i];
+    ary[i] = ary[j];
+    ary[j] = t;
+  }
+}
+
+static void shuffle__uint32_t_xoro(struct xoroshiro128p_st *st, uint32_t *ary,
+                                   size_t size) {
+  for (size_t i = size - 1; i > 0; --i) {
+    size_t j = xoroshiro128p_next_bounded(st, i + 1);
+
+    uint32_t t = ary[i];
     ary[i] = ary[j];
     ary[j] = t;
   }
@@ -141,6 +234,22 @@ void memset_64(void *data, uint64_t v, size_t count) {
   }
 }
 
+/* the rand: kinds pnoise_init takes, checked before the state is allocated
+ * so a bad one can't leak it */
+void pnoise_check_rand(mrb_state *mrb, mrb_value rand) {
+  if (mrb_integer_p(rand) || mrb_nil_p(rand) || mrb_undef_p(rand))
+    return;
+
+  struct RClass *xoroshiro128p = xoroshiro128p_class(mrb);
+  if (xoroshiro128p != nullptr &&
+      mrb_obj_is_instance_of(mrb, rand, xoroshiro128p))
+    return;
+
+  if (mrb_data_check_get_ptr(mrb, rand, rand_state_type) == nullptr)
+    mrb_raisef(mrb, E_TYPE_ERROR,
+               "rand: expected Random or Xoroshiro128, got %T", rand);
+}
+
 void pnoise_init(mrb_state *mrb, struct pnoise_state_t *p, mrb_int octaves,
                  mrb_float persistence, mrb_float lacunarity,
                  mrb_float frequency, mrb_value rand) {
@@ -149,18 +258,35 @@ void pnoise_init(mrb_state *mrb, struct pnoise_state_t *p, mrb_int octaves,
   p->lacunarity = lacunarity;
   p->frequency = frequency;
 
-  rand_state *r = nullptr;
+  size_t ptbl_size = (p->w > p->h ? p->w : p->h) * 2;
+
+  prepare_ptbl(p->ptbl, ptbl_size);
+
+  struct RClass *xoroshiro128p = xoroshiro128p_class(mrb);
 
-  if (!(mrb_nil_p(rand) || mrb_undef_p(rand))) {
-    r = mrb_data_check_get_ptr(mrb, rand, rand_state_type);
+  if (mrb_integer_p(rand)) {
+    struct xoroshiro128p_st st;
+    xoroshiro128p_init(&st, mrb_integer(rand));
+    shuffle__uint32_t_xoro(&st, p->ptbl, ptbl_size);
+  } else if (xoroshiro128p != nullptr &&
+             mrb_obj_is_instance_of(mrb, rand, xoroshiro128p)) {
+    shuffle__uint32_t_xoro((struct xoroshiro128p_st *)ISTRUCT_PTR(rand),
+                           p->ptbl, ptbl_size);
   } else {
-    r = mrb_data_check_get_ptr(mrb, random_default(mrb), rand_state_type);
-  }
+    rand_state *r = nullptr;
 
-  size_t ptbl_size = (p->w > p->h ? p->w : p->h) * 2;
+    if (!(mrb_nil_p(rand) || mrb_undef_p(rand))) {
+      r = mrb_data_check_get_ptr(mrb, rand, rand_state_type);
+    } else {
+      r = mrb_data_check_get_ptr(mrb, random_default(mrb), rand_state_type);
+    }
 
-  prepare_ptbl(p->ptbl, ptbl_size);
-  shuffle__uint32_t(r, p->ptbl, ptbl_size);
+    if (r == nullptr)
+      mrb_raisef(mrb, E_TYPE_ERROR,
+                 "rand: expected Random or Xoroshiro128, got %T", rand);
+
+    shuffle__uint32_t(r, p->ptbl, ptbl_size);
+  }
 
   memset_64(p->data, as_u64(empty_nan), p->w * p->h);
 }
@@ -171,9 +297,10 @@ void pnoise_free(mrb_state *mrb, struct pnoise_state_t *p) {
 #ifdef PNOISE2D_SHARE_STATE
   if ((--p->refct) == 0) {
 #endif
-    mrb_free(mrb, p->ptbl);
-    mrb_free(mrb, p->data);
-    mrb_free(mrb, p);
+    cext_pool_free(mrb, p->ptbl, (p->w > p->h ? p->w : p->h) * 2 *
+                                     sizeof(uint32_t));
+    cext_pool_free(mrb, p->data, p->w * p->h * sizeof(mrb_float));
+    cext_pool_free(mrb, p, sizeof(struct pnoise_state_t));
 #ifdef PNOISE2D_SHARE_STATE
   }
 #endif
@@ -187,8 +314,8 @@ void pnoise_free(mrb_state *mrb, struct pnoise_state_t *p) {
   return b;
 }
 
-mrb_float noise_cell_unchecked1(struct pnoise_state_t *p, size_t x, size_t y,
-                                mrb_int octave, mrb_float freq) {
+mrb_float noise_cell_unchecked1(const struct pnoise_state_t *p, size_t x,
+                                size_t y, mrb_int octave, mrb_float freq) {
   mrb_int period = 1 << octave;
 
   freq = freq / (mrb_float)period;
@@ -225,10 +352,16 @@ mrb_float noise_cell_unchecked(struct pnoise_state_t *p, size_t x, size_t y) {
   size_t idx = y * p->w + x;
   mrb_float *data = p->data;
 
+  CEXT_STAT(PNOISE_STAT_CELL, calls, 1);
+
   if (as_u64(data[idx]) != as_u64(empty_nan)) {
+    CEXT_STAT(PNOISE_STAT_CELL, hits, 1);
     return data[idx];
   }
 
+  CEXT_STAT(PNOISE_STAT_CELL, misses, 1);
+  CEXT_STAT_CLOCK(started);
+
   mrb_float sum = 0.0;
   mrb_float amp = 1.0;
   mrb_float freq = p->frequency;
@@ -242,6 +375,7 @@ mrb_float noise_cell_unchecked(struct pnoise_state_t *p, size_t x, size_t y) {
   }
 
   sum = clamp(sum, 0.0, 1.0);
+  CEXT_STAT_ELAPSED(PNOISE_STAT_CELL, started);
 
   data[idx] = sum;
   return sum;
@@ -253,8 +387,276 @@ mrb_float noise_cell(struct pnoise_state_t *p, size_t x, size_t y) {
   return noise_cell_unchecked(p, x, y);
 }
 
+/* one octave over a whole row, out[x] += noise * amp. the vector kernels
+ * follow noise_cell_unchecked1 operation for operation: x * freq stays below
+ * 2 * wfreq, so fmod is a single exact subtraction, and modf a truncation */
+typedef void (*pnoise_row_fn)(const struct pnoise_state_t *p, size_t y,
+                              mrb_int octave, mrb_float freq, mrb_float amp,
+                              mrb_float *out);
+
+static void pnoise_row_scalar(const struct pnoise_state_t *p, size_t y,
+                              mrb_int octave, mrb_float freq, mrb_float amp,
+                              mrb_float *out) {
+  CEXT_SCALAR_LOOP
+  for (size_t x = 0; x < p->w; ++x)
+    out[x] += noise_cell_unchecked1(p, x, y, octave, freq) * amp;
+}
+
+#ifdef CEXT_SIMD_X86
+/* the y half of noise_cell_unchecked1, constant over a row */
+struct pnoise_row_t {
+  mrb_float freq;
+  mrb_float wfreq;
+  mrb_float yf;
+  mrb_float yb;
+  uint32_t y1;
+  uint32_t y2;
+};
+
+static struct pnoise_row_t pnoise_row_setup(const struct pnoise_state_t *p,
+                                            size_t y, mrb_int octave,
+                                            mrb_float freq) {
+  freq = freq / (mrb_float)(1 << octave);
+  mrb_float hfreq = p->h * freq;
+
+  mrb_float ya = fmod(y * freq, hfreq);
+  mrb_float y1;
+  mrb_float yf = modf(ya, &y1);
+  mrb_int y2 = fmod(y1 + 1.0, hfreq);
+
+  return (struct pnoise_row_t){.freq = freq,
+                               .wfreq = p->w * freq,
+                               .yf = yf,
+                               .yb = fade(yf),
+                               .y1 = y1,
+                               .y2 = y2};
+}
+
+/* the exact fmod shortcut needs wfreq >= 1, int32 lanes need w < 2^31 */
+static _Bool pnoise_row_vectorizable(const struct pnoise_state_t *p,
+                                     const struct pnoise_row_t *r) {
+  return r->wfreq >= 1.0 && p->w <= INT32_MAX && p->h <= INT32_MAX;
+}
+
+static const double pnoise_grad_x[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+static const double pnoise_grad_y[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+
+CEXT_TARGET_SSE2 static inline __m128d pnoise_blend_sse2(__m128d mask,
+                                                        __m128d a, __m128d b) {
+  return _mm_or_pd(_mm_and_pd(mask, b), _mm_andnot_pd(mask, a));
+}
+
+CEXT_TARGET_SSE2 static inline __m128d pnoise_lerp_sse2(__m128d t, __m128d a,
+                                                       __m128d b) {
+  return _mm_add_pd(_mm_mul_pd(b, t),
+                    _mm_mul_pd(a, _mm_sub_pd(_mm_set1_pd(1.0), t)));
+}
+
+CEXT_TARGET_SSE2 static inline __m128d pnoise_fade_sse2(__m128d t) {
+  __m128d v = _mm_sub_pd(_mm_mul_pd(t, _mm_set1_pd(6.0)), _mm_set1_pd(15.0));
+  v = _mm_add_pd(_mm_mul_pd(v, t), _mm_set1_pd(10.0));
+  return _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(v, t), t), t);
+}
+
+CEXT_TARGET_SSE2 static inline __m128d
+pnoise_grad_sse2(const uint32_t h[2], __m128d x, __m128d y) {
+  const __m128d gx =
+      _mm_set_pd(pnoise_grad_x[h[1] & 7], pnoise_grad_x[h[0] & 7]);
+  const __m128d gy =
+      _mm_set_pd(pnoise_grad_y[h[1] & 7], pnoise_grad_y[h[0] & 7]);
+  return _mm_add_pd(_mm_mul_pd(gx, x), _mm_mul_pd(gy, y));
+}
+
+/* two cells per step, sse2 has no gather so the table reads stay scalar */
+CEXT_TARGET_SSE2 static void
+pnoise_row_sse2(const struct pnoise_state_t *p, size_t y, mrb_int octave,
+                mrb_float freq, mrb_float amp, mrb_float *out) {
+  const struct pnoise_row_t r = pnoise_row_setup(p, y, octave, freq);
+  const uint32_t *ptbl = p->ptbl;
+  size_t x = 0;
+
+  if (pnoise_row_vectorizable(p, &r)) {
+    const __m128d f = _mm_set1_pd(r.freq);
+    const __m128d wf = _mm_set1_pd(r.wfreq);
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d yf = _mm_set1_pd(r.yf);
+    const __m128d yf1 = _mm_set1_pd(r.yf - 1.0);
+    const __m128d yb = _mm_set1_pd(r.yb);
+
+    for (; x + 2 <= p->w; x += 2) {
+      __m128d xa = _mm_mul_pd(
+          _mm_cvtepi32_pd(_mm_set_epi32(0, 0, (int32_t)x + 1, (int32_t)x)), f);
+      xa = pnoise_blend_sse2(_mm_cmpge_pd(xa, wf), xa, _mm_sub_pd(xa, wf));
+
+      const __m128i x1 = _mm_cvttpd_epi32(xa);
+      const __m128d x1f = _mm_cvtepi32_pd(x1);
+      const __m128d xf = _mm_sub_pd(xa, x1f);
+      const __m128d xf1 = _mm_sub_pd(xf, one);
+
+      __m128d t = _mm_add_pd(x1f, one);
+      t = pnoise_blend_sse2(_mm_cmpge_pd(t, wf), t, _mm_sub_pd(t, wf));
+      const __m128i x2 = _mm_cvttpd_epi32(t);
+
+      int32_t i1[4], i2[4];
+      _mm_storeu_si128((__m128i *)i1, x1);
+      _mm_storeu_si128((__m128i *)i2, x2);
+
+      uint32_t h00[2], h10[2], h01[2], h11[2];
+      for (int l = 0; l < 2; ++l) {
+        const uint32_t px1 = ptbl[i1[l]];
+        const uint32_t px2 = ptbl[i2[l]];
+        h00[l] = ptbl[px1 + r.y1];
+        h10[l] = ptbl[px2 + r.y1];
+        h01[l] = ptbl[px1 + r.y2];
+        h11[l] = ptbl[px2 + r.y2];
+      }
+
+      const __m128d xb = pnoise_fade_sse2(xf);
+      const __m128d top = pnoise_lerp_sse2(xb, pnoise_grad_sse2(h00, xf, yf),
+                                           pnoise_grad_sse2(h10, xf1, yf));
+      const __m128d bot = pnoise_lerp_sse2(xb, pnoise_grad_sse2(h01, xf, yf1),
+                                           pnoise_grad_sse2(h11, xf1, yf1));
+      const __m128d v = _mm_div_pd(
+          _mm_add_pd(pnoise_lerp_sse2(yb, top, bot), one), _mm_set1_pd(2.0));
+
+      _mm_storeu_pd(&out[x], _mm_add_pd(_mm_loadu_pd(&out[x]),
+                                        _mm_mul_pd(v, _mm_set1_pd(amp))));
+    }
+  }
+
+  for (; x < p->w; ++x)
+    out[x] += noise_cell_unchecked1(p, x, y, octave, freq) * amp;
+}
+
+CEXT_TARGET_AVX2 static inline __m256d pnoise_lerp_avx2(__m256d t, __m256d a,
+                                                       __m256d b) {
+  return _mm256_add_pd(_mm256_mul_pd(b, t),
+                       _mm256_mul_pd(a, _mm256_sub_pd(_mm256_set1_pd(1.0), t)));
+}
+
+CEXT_TARGET_AVX2 static inline __m256d pnoise_fade_avx2(__m256d t) {
+  __m256d v = _mm256_mul_pd(t, _mm256_set1_pd(6.0));
+  v = _mm256_sub_pd(v, _mm256_set1_pd(15.0));
+  v = _mm256_add_pd(_mm256_mul_pd(v, t), _mm256_set1_pd(10.0));
+  return _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(v, t), t), t);
+}
+
+CEXT_TARGET_AVX2 static inline __m256d pnoise_grad_avx2(__m128i h, __m256d x,
+                                                       __m256d y) {
+  h = _mm_and_si128(h, _mm_set1_epi32(7));
+  const __m256d gx = _mm256_i32gather_pd(pnoise_grad_x, h, 8);
+  const __m256d gy = _mm256_i32gather_pd(pnoise_grad_y, h, 8);
+  return _mm256_add_pd(_mm256_mul_pd(gx, x), _mm256_mul_pd(gy, y));
+}
+
+/* four cells per step, table reads are gathers */
+CEXT_TARGET_AVX2 static void
+pnoise_row_avx2(const struct pnoise_state_t *p, size_t y, mrb_int octave,
+                mrb_float freq, mrb_float amp, mrb_float *out) {
+  const struct pnoise_row_t r = pnoise_row_setup(p, y, octave, freq);
+  const int *ptbl = (const int *)p->ptbl;
+  size_t x = 0;
+
+  if (pnoise_row_vectorizable(p, &r)) {
+    const __m256d f = _mm256_set1_pd(r.freq);
+    const __m256d wf = _mm256_set1_pd(r.wfreq);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d yf = _mm256_set1_pd(r.yf);
+    const __m256d yf1 = _mm256_set1_pd(r.yf - 1.0);
+    const __m256d yb = _mm256_set1_pd(r.yb);
+    const __m128i y1 = _mm_set1_epi32((int32_t)r.y1);
+    const __m128i y2 = _mm_set1_epi32((int32_t)r.y2);
+    const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+
+    for (; x + 4 <= p->w; x += 4) {
+      __m256d xa = _mm256_mul_pd(
+          _mm256_cvtepi32_pd(_mm_add_epi32(_mm_set1_epi32((int32_t)x), lanes)),
+          f);
+      xa = _mm256_blendv_pd(xa, _mm256_sub_pd(xa, wf),
+                            _mm256_cmp_pd(xa, wf, _CMP_GE_OQ));
+
+      const __m128i x1 = _mm256_cvttpd_epi32(xa);
+      const __m256d x1f = _mm256_cvtepi32_pd(x1);
+      const __m256d xf = _mm256_sub_pd(xa, x1f);
+      const __m256d xf1 = _mm256_sub_pd(xf, one);
+
+      __m256d t = _mm256_add_pd(x1f, one);
+      t = _mm256_blendv_pd(t, _mm256_sub_pd(t, wf),
+                           _mm256_cmp_pd(t, wf, _CMP_GE_OQ));
+      const __m128i x2 = _mm256_cvttpd_epi32(t);
+
+      const __m128i px1 = _mm_i32gather_epi32(ptbl, x1, 4);
+      const __m128i px2 = _mm_i32gather_epi32(ptbl, x2, 4);
+      const __m128i h00 = _mm_i32gather_epi32(ptbl, _mm_add_epi32(px1, y1), 4);
+      const __m128i h10 = _mm_i32gather_epi32(ptbl, _mm_add_epi32(px2, y1), 4);
+      const __m128i h01 = _mm_i32gather_epi32(ptbl, _mm_add_epi32(px1, y2), 4);
+      const __m128i h11 = _mm_i32gather_epi32(ptbl, _mm_add_epi32(px2, y2), 4);
+
+      const __m256d xb = pnoise_fade_avx2(xf);
+      const __m256d top = pnoise_lerp_avx2(xb, pnoise_grad_avx2(h00, xf, yf),
+                                           pnoise_grad_avx2(h10, xf1, yf));
+      const __m256d bot = pnoise_lerp_avx2(xb, pnoise_grad_avx2(h01, xf, yf1),
+                                           pnoise_grad_avx2(h11, xf1, yf1));
+      const __m256d v =
+          _mm256_div_pd(_mm256_add_pd(pnoise_lerp_avx2(yb, top, bot), one),
+                        _mm256_set1_pd(2.0));
+
+      _mm256_storeu_pd(&out[x],
+                       _mm256_add_pd(_mm256_loadu_pd(&out[x]),
+                                     _mm256_mul_pd(v, _mm256_set1_pd(amp))));
+    }
+  }
+
+  for (; x < p->w; ++x)
+    out[x] += noise_cell_unchecked1(p, x, y, octave, freq) * amp;
+}
+#endif
+
+static pnoise_row_fn pnoise_row = pnoise_row_scalar;
+
+static void pnoise_simd_select(enum cext_isa isa) {
+  pnoise_row =
+      CEXT_SIMD_PICK(isa, pnoise_row_scalar, pnoise_row_sse2, pnoise_row_avx2);
+}
+
+/* fills row y of the cache unless every cell of it is there already; cached
+ * cells are recomputed to the same value */
+void noise_row_unchecked(struct pnoise_state_t *p, size_t y) {
+  mrb_float *row = p->data + y * p->w;
+
+  CEXT_STAT(PNOISE_STAT_ROW, calls, 1);
+
+  size_t x = 0;
+  while (x < p->w && as_u64(row[x]) != as_u64(empty_nan))
+    ++x;
+  if (x == p->w)
+    return;
+
+  CEXT_STAT(PNOISE_STAT_ROW, misses, 1);
+  CEXT_STAT_CLOCK(started);
+
+  for (x = 0; x < p->w; ++x)
+    row[x] = 0.0;
+
+  mrb_float amp = 1.0;
+  mrb_float freq = p->frequency;
+
+  for (mrb_int octave = 0; octave < p->octaves; ++octave) {
+    pnoise_row(p, y, octave, freq, amp, row);
+    amp *= p->persistence;
+    freq *= p->lacunarity;
+  }
+
+  for (x = 0; x < p->w; ++x)
+    row[x] = clamp(row[x], 0.0, 1.0);
+
+  CEXT_STAT_ELAPSED(PNOISE_STAT_ROW, started);
+}
+
 mrb_sym width_sym, height_sym, octaves_sym, persistence_sym, lacunarity_sym,
-    frequency_sym, rand_sym;
+    frequency_sym, rand_sym, seed_sym, radius_sym, max_radius_sym, tries_sym,
+    density_sym, fill_sym, steps_sym, birth_sym, survive_sym, noise_sym,
+    threshold_sym, keep_largest_sym;
 
 mrb_data_type pnoise_data_type = {
     .struct_name = "levi#pnoise",
@@ -269,12 +671,14 @@ mrb_value pnoise_m_init(mrb_state *mrb, mrb_value self) {
   struct pnoise_state_t *p =
       mrb_data_check_get_ptr(mrb, self, &pnoise_data_type);
 
-  if (p != nullptr)
+  if (p != nullptr) {
     pnoise_free(mrb, p);
+    DATA_PTR(self) = nullptr;
+  }
 
   const mrb_sym kws[] = {width_sym,       height_sym,     octaves_sym,
                          persistence_sym, lacunarity_sym, frequency_sym,
-                         rand_sym};
+                         rand_sym,        seed_sym};
   static const uint32_t numks = sizeof(kws) / sizeof(*kws);
   static const uint32_t reqks = 2;
   mrb_value kwvals[sizeof(kws) / sizeof(*kws)];
@@ -314,12 +718,18 @@ mrb_value pnoise_m_init(mrb_state *mrb, mrb_value self) {
     frequency = mrb_float(mrb_Float(mrb, kwvals[5]));
   }
 
-  if (mrb_undef_p(kwvals[6])) {
+  if (!mrb_undef_p(kwvals[7])) {
+    if (!mrb_undef_p(kwvals[6]))
+      mrb_raise(mrb, E_ARGUMENT_ERROR,
+                "only one of rand: and seed: may be given");
+    rand = mrb_Integer(mrb, kwvals[7]);
+  } else if (mrb_undef_p(kwvals[6])) {
     rand = random_default(mrb);
   } else {
     rand = kwvals[6];
   }
 
+  pnoise_check_rand(mrb, rand);
   p = pnoise_alloc(mrb, w, h);
   pnoise_init(mrb, p, octaves, persistence, lacunarity, frequency, rand);
 
@@ -330,7 +740,7 @@ mrb_value pnoise_m_init(mrb_state *mrb, mrb_value self) {
 mrb_value pnoise_cm_new(mrb_state *mrb, mrb_value klass) {
   const mrb_sym kws[] = {width_sym,       height_sym,     octaves_sym,
                          persistence_sym, lacunarity_sym, frequency_sym,
-                         rand_sym};
+                         rand_sym,        seed_sym};
   static const uint32_t numks = sizeof(kws) / sizeof(*kws);
   static const uint32_t reqks = 2;
   mrb_value kwvals[sizeof(kws) / sizeof(*kws)];
@@ -370,12 +780,18 @@ mrb_value pnoise_cm_new(mrb_state *mrb, mrb_value klass) {
     frequency = mrb_float(mrb_Float(mrb, kwvals[5]));
   }
 
-  if (mrb_undef_p(kwvals[6])) {
+  if (!mrb_undef_p(kwvals[7])) {
+    if (!mrb_undef_p(kwvals[6]))
+      mrb_raise(mrb, E_ARGUMENT_ERROR,
+                "only one of rand: and seed: may be given");
+    rand = mrb_Integer(mrb, kwvals[7]);
+  } else if (mrb_undef_p(kwvals[6])) {
     rand = random_default(mrb);
   } else {
     rand = kwvals[6];
   }
 
+  pnoise_check_rand(mrb, rand);
   struct pnoise_state_t *p = pnoise_alloc(mrb, w, h);
   pnoise_init(mrb, p, octaves, persistence, lacunarity, frequency, rand);
 
@@ -394,6 +810,527 @@ mrb_value pnoise_m_aref(mrb_state *mrb, mrb_value self) {
   return mrb_float_value(mrb, noise_cell(p, x, y));
 }
 
+mrb_value pnoise_m_row(mrb_state *mrb, mrb_value self) {
+  struct pnoise_state_t *p =
+      mrb_data_check_get_ptr(mrb, self, &pnoise_data_type);
+
+  mrb_int y;
+  mrb_get_args(mrb, "i", &y);
+
+  if (y < 0 || (size_t)y >= p->h)
+    mrb_raisef(mrb, E_INDEX_ERROR, "row %i outside of 0...%i", y,
+               (mrb_int)p->h);
+
+  noise_row_unchecked(p, y);
+
+  const mrb_float *row = p->data + y * p->w;
+  mrb_value ary = mrb_ary_new_capa(mrb, p->w);
+  int ai = mrb_gc_arena_save(mrb);
+
+  for (size_t x = 0; x < p->w; ++x) {
+    mrb_ary_push(mrb, ary, mrb_float_value(mrb, row[x]));
+    mrb_gc_arena_restore(mrb, ai);
+  }
+
+  return ary;
+}
+
+/* the generator state behind seed: / rand: for the bulk samplers below;
+ * local holds it unless rand is an Xoroshiro128, which is advanced in place */
+struct xoroshiro128p_st *rand_xoro_state(mrb_state *mrb, mrb_value seed,
+                                         mrb_value rand,
+                                         struct xoroshiro128p_st *local) {
+  if (!mrb_undef_p(seed)) {
+    if (!mrb_undef_p(rand))
+      mrb_raise(mrb, E_ARGUMENT_ERROR,
+                "only one of rand: and seed: may be given");
+    xoroshiro128p_init(local, mrb_integer(mrb_Integer(mrb, seed)));
+    return local;
+  }
+
+  if (mrb_integer_p(rand)) {
+    xoroshiro128p_init(local, mrb_integer(rand));
+    return local;
+  }
+
+  struct RClass *xoroshiro128p = xoroshiro128p_class(mrb);
+  if (xoroshiro128p != nullptr &&
+      mrb_obj_is_instance_of(mrb, rand, xoroshiro128p))
+    return (struct xoroshiro128p_st *)ISTRUCT_PTR(rand);
+
+  rand_state *r = mrb_data_check_get_ptr(
+      mrb, mrb_undef_p(rand) || mrb_nil_p(rand) ? random_default(mrb) : rand,
+      rand_state_type);
+
+  if (r == nullptr)
+    mrb_raisef(mrb, E_TYPE_ERROR,
+               "rand: expected Random or Xoroshiro128, got %T", rand);
+
+  const uint64_t hi = rand_uint32(r);
+  xoroshiro128p_init(local, (hi << 32) | rand_uint32(r));
+  return local;
+}
+
+[[gnu::always_inline]] mrb_float xoroshiro128p_next_float(
+    struct xoroshiro128p_st *st) {
+  return (xoroshiro128p_next(st) >> 11) * 0x1.0p-53;
+}
+
+/* Bridson's Poisson-disk sampling over a background grid of cell r / sqrt 2,
+ * so every cell holds at most one point. with a density field the radius
+ * at a point goes from max_radius where the noise is 0 down to radius where
+ * it is 1; two points keep the larger of their radii apart */
+struct poisson_t {
+  mrb_value vpts; /* Strings backing pts and active */
+  mrb_value vactive;
+  mrb_float *pts; /* x, y, r */
+  uint32_t *active;
+  size_t size;
+  size_t capa;
+  int32_t *grid;
+  size_t gw;
+  size_t gh;
+  mrb_float cell;
+  mrb_float w;
+  mrb_float h;
+  mrb_float rmin;
+  mrb_float rmax;
+  struct pnoise_state_t *density;
+};
+
+mrb_float poisson_radius_at(const struct poisson_t *ps, mrb_float x,
+                            mrb_float y) {
+  if (ps->density == nullptr)
+    return ps->rmin;
+
+  struct pnoise_state_t *p = ps->density;
+  size_t nx = x * p->w / ps->w;
+  size_t ny = y * p->h / ps->h;
+  mrb_float n = noise_cell(p, nx < p->w ? nx : p->w - 1,
+                           ny < p->h ? ny : p->h - 1);
+
+  if (isnan(n))
+    n = 0;
+
+  return ps->rmax - (ps->rmax - ps->rmin) * n;
+}
+
+_Bool poisson_fits(const struct poisson_t *ps, mrb_float x, mrb_float y,
+                   mrb_float r) {
+  const mrb_int reach = (mrb_int)ceil(ps->rmax / ps->cell);
+  const mrb_int gx = x / ps->cell;
+  const mrb_int gy = y / ps->cell;
+
+  const mrb_int x0 = gx - reach < 0 ? 0 : gx - reach;
+  const mrb_int y0 = gy - reach < 0 ? 0 : gy - reach;
+  const mrb_int x1 = gx + reach >= (mrb_int)ps->gw ? ps->gw - 1 : gx + reach;
+  const mrb_int y1 = gy + reach >= (mrb_int)ps->gh ? ps->gh - 1 : gy + reach;
+
+  for (mrb_int cy = y0; cy <= y1; ++cy) {
+    for (mrb_int cx = x0; cx <= x1; ++cx) {
+      const int32_t q = ps->grid[cy * ps->gw + cx];
+      if (q < 0)
+        continue;
+
+      const mrb_float *pt = &ps->pts[3 * q];
+      const mrb_float dx = pt[0] - x;
+      const mrb_float dy = pt[1] - y;
+      const mrb_float need = pt[2] > r ? pt[2] : r;
+
+      if (dx * dx + dy * dy < need * need)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+void poisson_push(mrb_state *mrb, struct poisson_t *ps, size_t *nactive,
+                  mrb_float x, mrb_float y, mrb_float r) {
+  if (ps->size == ps->capa) {
+    const size_t capa = ps->capa * 2;
+    mrb_str_resize(mrb, ps->vpts, 3 * capa * sizeof(mrb_float));
+    mrb_str_resize(mrb, ps->vactive, capa * sizeof(uint32_t));
+    ps->pts = (mrb_float *)RSTRING_PTR(ps->vpts);
+    ps->active = (uint32_t *)RSTRING_PTR(ps->vactive);
+    ps->capa = capa;
+  }
+
+  mrb_float *pt = &ps->pts[3 * ps->size];
+  pt[0] = x;
+  pt[1] = y;
+  pt[2] = r;
+
+  /* x / cell can round up to gw right below the edge, clamp like fits */
+  const size_t gx = x / ps->cell;
+  const size_t gy = y / ps->cell;
+  ps->grid[(gy < ps->gh ? gy : ps->gh - 1) * ps->gw +
+           (gx < ps->gw ? gx : ps->gw - 1)] = ps->size;
+  ps->active[(*nactive)++] = ps->size;
+  ++ps->size;
+}
+
+void poisson_run(mrb_state *mrb, struct poisson_t *ps, mrb_int tries,
+                 struct xoroshiro128p_st *st) {
+  size_t nactive = 0;
+
+  mrb_float x = xoroshiro128p_next_float(st) * ps->w;
+  mrb_float y = xoroshiro128p_next_float(st) * ps->h;
+  poisson_push(mrb, ps, &nactive, x, y, poisson_radius_at(ps, x, y));
+
+  while (nactive > 0) {
+    const size_t slot = xoroshiro128p_next_bounded(st, nactive);
+    const mrb_float *pt = &ps->pts[3 * ps->active[slot]];
+    const mrb_float px = pt[0];
+    const mrb_float py = pt[1];
+    const mrb_float pr = pt[2];
+    _Bool found = false;
+
+    for (mrb_int t = 0; t < tries; ++t) {
+      /* uniform over the annulus pr..2pr by rejection, no trig */
+      mrb_float dx, dy, d2;
+      do {
+        dx = (xoroshiro128p_next_float(st) * 4 - 2) * pr;
+        dy = (xoroshiro128p_next_float(st) * 4 - 2) * pr;
+        d2 = dx * dx + dy * dy;
+      } while (d2 < pr * pr || d2 > 4 * pr * pr);
+      x = px + dx;
+      y = py + dy;
+
+      if (x < 0 || x >= ps->w || y < 0 || y >= ps->h)
+        continue;
+
+      const mrb_float r = poisson_radius_at(ps, x, y);
+      if (!poisson_fits(ps, x, y, r))
+        continue;
+
+      poisson_push(mrb, ps, &nactive, x, y, r);
+      found = true;
+      break;
+    }
+
+    if (!found)
+      ps->active[slot] = ps->active[--nactive];
+  }
+}
+
+mrb_value pnoise_poisson_disk(mrb_state *mrb, mrb_value _) {
+  const mrb_sym kws[] = {width_sym,      height_sym, radius_sym,
+                         max_radius_sym, tries_sym,  density_sym,
+                         rand_sym,       seed_sym};
+  mrb_value kwvals[sizeof(kws) / sizeof(*kws)];
+  const mrb_kwargs kwargs = {sizeof(kws) / sizeof(*kws), 3, kws, kwvals, NULL};
+  mrb_get_args(mrb, ":", &kwargs);
+
+  const mrb_float w = mrb_float(mrb_Float(mrb, kwvals[0]));
+  const mrb_float h = mrb_float(mrb_Float(mrb, kwvals[1]));
+  const mrb_float rmin = mrb_float(mrb_Float(mrb, kwvals[2]));
+  const mrb_float rmax = mrb_undef_p(kwvals[3])
+                             ? rmin
+                             : mrb_float(mrb_Float(mrb, kwvals[3]));
+  const mrb_int tries =
+      mrb_undef_p(kwvals[4]) ? 30 : mrb_integer(mrb_Integer(mrb, kwvals[4]));
+
+  if (!(w > 0 && h > 0))
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid area %v:%v", kwvals[0],
+               kwvals[1]);
+  if (!(rmin > 0 && rmax >= rmin))
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid radius %v..%v", kwvals[2],
+               mrb_undef_p(kwvals[3]) ? kwvals[2] : kwvals[3]);
+  if (tries < 1)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "non-positive tries (%i)", tries);
+
+  struct pnoise_state_t *density = nullptr;
+  if (!mrb_undef_p(kwvals[5]) && !mrb_nil_p(kwvals[5])) {
+    density = mrb_data_check_get_ptr(mrb, kwvals[5], &pnoise_data_type);
+    if (density == nullptr)
+      mrb_raisef(mrb, E_TYPE_ERROR, "density: expected PerlinNoise, got %T",
+                 kwvals[5]);
+  }
+
+  struct xoroshiro128p_st local;
+  struct xoroshiro128p_st *st =
+      rand_xoro_state(mrb, kwvals[7], kwvals[6], &local);
+
+  const mrb_float cell = rmin / 1.4142135623730951;
+  const mrb_float gw = ceil(w / cell);
+  const mrb_float gh = ceil(h / cell);
+
+  if (gw * gh > (mrb_float)(INT32_MAX / 2))
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "radius %v too small for area %v:%v",
+               kwvals[2], kwvals[0], kwvals[1]);
+
+  /* the grid and point buffers are Strings, so a raise can't leak them */
+  struct poisson_t ps = {
+      .capa = 256, .gw = gw, .gh = gh, .cell = cell, .w = w, .h = h,
+      .rmin = rmin, .rmax = rmax, .density = density};
+  ps.vpts = mrb_str_new(mrb, nullptr, 3 * ps.capa * sizeof(mrb_float));
+  ps.vactive = mrb_str_new(mrb, nullptr, ps.capa * sizeof(uint32_t));
+  ps.pts = (mrb_float *)RSTRING_PTR(ps.vpts);
+  ps.active = (uint32_t *)RSTRING_PTR(ps.vactive);
+
+  mrb_value vgrid = mrb_str_new(mrb, nullptr, ps.gw * ps.gh * sizeof(int32_t));
+  ps.grid = (int32_t *)RSTRING_PTR(vgrid);
+  for (size_t i = 0; i < ps.gw * ps.gh; ++i)
+    ps.grid[i] = -1;
+
+  poisson_run(mrb, &ps, tries, st);
+
+  mrb_value res = mrb_ary_new_capa(mrb, 2 * ps.size);
+  int arena = mrb_gc_arena_save(mrb);
+  for (size_t i = 0; i < ps.size; ++i) {
+    mrb_ary_push(mrb, res, mrb_float_value(mrb, ps.pts[3 * i]));
+    mrb_ary_push(mrb, res, mrb_float_value(mrb, ps.pts[3 * i + 1]));
+    mrb_gc_arena_restore(mrb, arena);
+  }
+
+  return res;
+}
+
+/* cellular-automaton caves over a byte grid (1 wall, 0 floor) framed by a
+ * one-cell wall border, so neighbour reads need no bounds checks. a step
+ * counts the 8 neighbours of 8 cells at once, one cell per byte of a
+ * uint64_t; counts stay below 10 so bytes never carry into each other */
+struct cave_t {
+  uint8_t *cells[2]; /* front, back */
+  uint8_t *block;    /* both buffers, in one allocation */
+  size_t w;
+  size_t h;
+  size_t stride;
+};
+
+#define CAVE_BYTES(v) (UINT64_C(0x0101010101010101) * (uint8_t)(v))
+
+[[gnu::always_inline]] uint64_t cave_load(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+[[gnu::always_inline]] uint8_t *cave_at(const struct cave_t *c, int buf,
+                                        size_t x, size_t y) {
+  return &c->cells[buf][(y + 1) * c->stride + x + 1];
+}
+
+void cave_free(mrb_state *mrb, struct cave_t *c) {
+  cext_pool_free(mrb, c->block, 2 * c->stride * (c->h + 2));
+}
+
+/* rows padded to whole words plus one, so the last chunk of a row can be
+ * read and written 8 bytes wide */
+void cave_alloc(mrb_state *mrb, struct cave_t *c, size_t w, size_t h) {
+  c->w = w;
+  c->h = h;
+  c->stride = ((w + 2 + 7) & ~(size_t)7) + 8;
+
+  c->block = cext_pool_alloc(mrb, 2 * c->stride * (h + 2));
+  memset(c->block, 1, 2 * c->stride * (h + 2));
+  c->cells[0] = c->block;
+  c->cells[1] = c->block + c->stride * (h + 2);
+}
+
+/* the last chunk spills into the right border, which is restored after */
+void cave_step(struct cave_t *c, uint8_t birth, uint8_t survive) {
+  const uint64_t ones = CAVE_BYTES(1);
+  const uint64_t bias_birth = CAVE_BYTES(0x80 - birth);
+  const uint64_t bias_survive = CAVE_BYTES(0x80 - survive);
+  const size_t s = c->stride;
+
+  for (size_t y = 1; y <= c->h; ++y) {
+    const uint8_t *up = c->cells[0] + (y - 1) * s;
+    const uint8_t *mid = c->cells[0] + y * s;
+    const uint8_t *down = c->cells[0] + (y + 1) * s;
+    uint8_t *out = c->cells[1] + y * s;
+
+    for (size_t x = 1; x <= c->w; x += 8) {
+      const uint64_t self = cave_load(mid + x);
+      const uint64_t count =
+          cave_load(up + x - 1) + cave_load(up + x) + cave_load(up + x + 1) +
+          cave_load(mid + x - 1) + cave_load(mid + x + 1) +
+          cave_load(down + x - 1) + cave_load(down + x) +
+          cave_load(down + x + 1);
+
+      /* bit 7 of count + 0x80 - k is set iff count >= k; birth only
+       * applies to floor, survival only to walls */
+      const uint64_t born = ((count + bias_birth) >> 7) & ones & ~self;
+      const uint64_t stays = ((count + bias_survive) >> 7) & ones & self;
+      const uint64_t next = born | stays;
+      memcpy(out + x, &next, sizeof(next));
+    }
+
+    out[c->w + 1] = 1;
+  }
+
+  uint8_t *t = c->cells[0];
+  c->cells[0] = c->cells[1];
+  c->cells[1] = t;
+}
+
+/* 4-connected floor regions, labelled 1.. in scan order; returns the count.
+ * labels has w * h entries, 0 on walls */
+uint32_t cave_label(mrb_state *mrb, const uint8_t *grid, size_t w, size_t h,
+                    uint32_t *labels, mrb_value sizes) {
+  const size_t stack_bytes = (w * h != 0 ? w * h : 1) * sizeof(uint32_t);
+  uint32_t *stack = cext_pool_alloc(mrb, stack_bytes);
+  uint32_t count = 0;
+
+  memset(labels, 0, w * h * sizeof(uint32_t));
+
+  for (size_t start = 0; start < w * h; ++start) {
+    if (grid[start] || labels[start])
+      continue;
+
+    size_t top = 0;
+    size_t size = 0;
+    labels[start] = ++count;
+    stack[top++] = start;
+
+    while (top > 0) {
+      const size_t i = stack[--top];
+      const size_t x = i % w;
+      ++size;
+
+#define CAVE_VISIT(cond, j)                                                    \
+  if ((cond) && !grid[j] && !labels[j]) {                                      \
+    labels[j] = count;                                                         \
+    stack[top++] = j;                                                          \
+  }
+      CAVE_VISIT(x > 0, i - 1);
+      CAVE_VISIT(x + 1 < w, i + 1);
+      CAVE_VISIT(i >= w, i - w);
+      CAVE_VISIT(i + w < w * h, i + w);
+#undef CAVE_VISIT
+    }
+
+    mrb_ary_push(mrb, sizes, mrb_int_value(mrb, size));
+  }
+
+  cext_pool_free(mrb, stack, stack_bytes);
+  return count;
+}
+
+mrb_value pnoise_cave(mrb_state *mrb, mrb_value _) {
+  const mrb_sym kws[] = {width_sym,   height_sym,    fill_sym,
+                         steps_sym,   birth_sym,     survive_sym,
+                         noise_sym,   threshold_sym, keep_largest_sym,
+                         rand_sym,    seed_sym};
+  mrb_value kwvals[sizeof(kws) / sizeof(*kws)];
+  const mrb_kwargs kwargs = {sizeof(kws) / sizeof(*kws), 2, kws, kwvals, NULL};
+  mrb_get_args(mrb, ":", &kwargs);
+
+  const mrb_int w = mrb_integer(mrb_Integer(mrb, kwvals[0]));
+  const mrb_int h = mrb_integer(mrb_Integer(mrb, kwvals[1]));
+  const mrb_float fill =
+      mrb_undef_p(kwvals[2]) ? 0.45 : mrb_float(mrb_Float(mrb, kwvals[2]));
+  const mrb_int steps =
+      mrb_undef_p(kwvals[3]) ? 4 : mrb_integer(mrb_Integer(mrb, kwvals[3]));
+  const mrb_int birth =
+      mrb_undef_p(kwvals[4]) ? 5 : mrb_integer(mrb_Integer(mrb, kwvals[4]));
+  const mrb_int survive =
+      mrb_undef_p(kwvals[5]) ? 4 : mrb_integer(mrb_Integer(mrb, kwvals[5]));
+  const mrb_float threshold =
+      mrb_undef_p(kwvals[7]) ? 0.5 : mrb_float(mrb_Float(mrb, kwvals[7]));
+  const mrb_bool keep_largest =
+      !mrb_undef_p(kwvals[8]) && mrb_test(kwvals[8]);
+
+  if (w <= 0 || h <= 0 || w > UINT32_MAX / h)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid size %i:%i", w, h);
+  if (birth < 0 || birth > 9 || survive < 0 || survive > 9)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "birth and survive must be in 0..9");
+
+  struct pnoise_state_t *noise = nullptr;
+  if (!mrb_undef_p(kwvals[6]) && !mrb_nil_p(kwvals[6])) {
+    noise = mrb_data_check_get_ptr(mrb, kwvals[6], &pnoise_data_type);
+    if (noise == nullptr)
+      mrb_raisef(mrb, E_TYPE_ERROR, "noise: expected PerlinNoise, got %T",
+                 kwvals[6]);
+  }
+
+  if (noise && !(mrb_undef_p(kwvals[9]) && mrb_undef_p(kwvals[10])))
+    mrb_raise(mrb, E_ARGUMENT_ERROR,
+              "noise: can't be combined with rand: or seed:");
+
+  struct xoroshiro128p_st local;
+  struct xoroshiro128p_st *st =
+      noise ? nullptr : rand_xoro_state(mrb, kwvals[10], kwvals[9], &local);
+
+  /* the result and label buffers are Strings, so a raise can't leak them */
+  mrb_value res = mrb_str_new(mrb, nullptr, w * h);
+  uint8_t *grid = (uint8_t *)RSTRING_PTR(res);
+
+  struct cave_t c;
+  cave_alloc(mrb, &c, w, h);
+
+  for (mrb_int y = 0; y < h; ++y) {
+    uint8_t *row = cave_at(&c, 0, 0, y);
+    const mrb_float *nrow = nullptr;
+
+    if (noise) {
+      const size_t ny = y * noise->h / h;
+      noise_row_unchecked(noise, ny);
+      nrow = noise->data + ny * noise->w;
+    }
+
+    for (mrb_int x = 0; x < w; ++x) {
+      if (noise) {
+        row[x] = nrow[x * noise->w / w] >= threshold;
+      } else {
+        row[x] = xoroshiro128p_next_float(st) < fill;
+      }
+    }
+  }
+
+  for (mrb_int i = 0; i < steps; ++i)
+    cave_step(&c, birth, survive);
+
+  for (mrb_int y = 0; y < h; ++y)
+    memcpy(grid + y * w, cave_at(&c, 0, 0, y), w);
+  cave_free(mrb, &c);
+
+  if (keep_largest) {
+    mrb_value vlabels = mrb_str_new(mrb, nullptr, w * h * sizeof(uint32_t));
+    uint32_t *labels = (uint32_t *)RSTRING_PTR(vlabels);
+    mrb_value sizes = mrb_ary_new(mrb);
+    const uint32_t count = cave_label(mrb, grid, w, h, labels, sizes);
+
+    uint32_t largest = 0;
+    mrb_int largest_size = -1;
+    for (uint32_t i = 0; i < count; ++i) {
+      if (mrb_integer(RARRAY_PTR(sizes)[i]) > largest_size) {
+        largest_size = mrb_integer(RARRAY_PTR(sizes)[i]);
+        largest = i + 1;
+      }
+    }
+
+    for (mrb_int i = 0; i < w * h; ++i)
+      grid[i] |= labels[i] != largest;
+  }
+
+  return res;
+}
+
+/* [labels, sizes]: labels packs one native uint32_t per cell, 0 on walls
+ * and 1.. for the 4-connected floor regions; sizes[id - 1] is the cell
+ * count of region id */
+mrb_value pnoise_cave_regions(mrb_state *mrb, mrb_value _) {
+  mrb_value grid;
+  mrb_int w;
+  mrb_get_args(mrb, "Si", &grid, &w);
+
+  if (w <= 0 || RSTRING_LEN(grid) % w != 0)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "grid of %i bytes is not %i wide",
+               RSTRING_LEN(grid), w);
+
+  const mrb_int h = RSTRING_LEN(grid) / w;
+  mrb_value vlabels = mrb_str_new(mrb, nullptr, w * h * sizeof(uint32_t));
+  mrb_value sizes = mrb_ary_new(mrb);
+
+  cave_label(mrb, (const uint8_t *)RSTRING_PTR(grid), w, h,
+             (uint32_t *)RSTRING_PTR(vlabels), sizes);
+
+  return mrb_assoc_new(mrb, vlabels, sizes);
+}
+
 void drb_register_c_extensions_with_api(mrb_state *mrb, void *) {
   width_sym = mrb_intern_lit(mrb, "width");
   height_sym = mrb_intern_lit(mrb, "height");
@@ -402,6 +1339,18 @@ void drb_register_c_extensions_with_api(mrb_state *mrb, void *) {
   lacunarity_sym = mrb_intern_lit(mrb, "lacunarity");
   frequency_sym = mrb_intern_lit(mrb, "frequency");
   rand_sym = mrb_intern_lit(mrb, "rand");
+  seed_sym = mrb_intern_lit(mrb, "seed");
+  radius_sym = mrb_intern_lit(mrb, "radius");
+  max_radius_sym = mrb_intern_lit(mrb, "max_radius");
+  tries_sym = mrb_intern_lit(mrb, "tries");
+  density_sym = mrb_intern_lit(mrb, "density");
+  fill_sym = mrb_intern_lit(mrb, "fill");
+  steps_sym = mrb_intern_lit(mrb, "steps");
+  birth_sym = mrb_intern_lit(mrb, "birth");
+  survive_sym = mrb_intern_lit(mrb, "survive");
+  noise_sym = mrb_intern_lit(mrb, "noise");
+  threshold_sym = mrb_intern_lit(mrb, "threshold");
+  keep_largest_sym = mrb_intern_lit(mrb, "keep_largest");
 
   rand_state_type = DATA_TYPE(random_default(mrb));
 
@@ -411,11 +1360,23 @@ void drb_register_c_extensions_with_api(mrb_state *mrb, void *) {
       mrb_define_class_under(mrb, noise_mod, "PerlinNoise", mrb->object_class);
 
   mrb_define_class_method(mrb, pnoise_klass, "new", pnoise_cm_new,
-                          MRB_ARGS_KEY(2, 5));
+                          MRB_ARGS_KEY(2, 6));
   mrb_define_method(mrb, pnoise_klass, "initialize", pnoise_m_init,
-                    MRB_ARGS_KEY(2, 5));
+                    MRB_ARGS_KEY(2, 6));
 
   mrb_define_method(mrb, pnoise_klass, "[]", pnoise_m_aref, MRB_ARGS_REQ(2));
   mrb_define_method(mrb, pnoise_klass, "noise2d_value", pnoise_m_aref,
                     MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, pnoise_klass, "row", pnoise_m_row, MRB_ARGS_REQ(1));
+
+  mrb_define_module_function(mrb, noise_mod, "poisson_disk",
+                             pnoise_poisson_disk, MRB_ARGS_KEY(3, 5));
+  mrb_define_module_function(mrb, noise_mod, "cave", pnoise_cave,
+                             MRB_ARGS_KEY(2, 9));
+  mrb_define_module_function(mrb, noise_mod, "cave_regions",
+                             pnoise_cave_regions, MRB_ARGS_REQ(2));
+
+  CEXT_STATS_INIT(mrb, "pnoise");
+  cext_simd_init(mrb, "pnoise", pnoise_simd_select);
+  cext_pool_init(mrb, "pnoise");
 }
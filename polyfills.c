@@ -1,6 +1,14 @@
 #include "mruby.h"
+#include "mruby/array.h"
+#include "mruby/class.h"
+#include "mruby/data.h"
+#include "mruby/hash.h"
 #include "mruby/range.h"
+#include "mruby/string.h"
+#include "mruby/variable.h"
 #include <limits.h>
+#include <stdint.h>
+#include <string.h>
 
 static mrb_value integer_aref(mrb_state *mrb, mrb_value self) {
   mrb_value int_range;
@@ -21,9 +29,14 @@ static mrb_value integer_aref(mrb_state *mrb, mrb_value self) {
     begin = mrb_integer(mrb_to_int(mrb, range->beg));
     mrb_value endv = range->end;
     if (mrb_nil_p(endv)) {
-      span = sizeof(size_t) * CHAR_BIT - begin;
+      const mrb_int bits = sizeof(size_t) * CHAR_BIT;
+      span = begin >= bits ? 1 : begin <= -bits ? bits : bits - begin;
     } else {
-      span = mrb_integer(mrb_to_int(mrb, endv)) - begin + (range->excl ? 0 : 1);
+      /* an overflowing span is wider than 63 bits anyway */
+      const mrb_int end = mrb_integer(mrb_to_int(mrb, endv));
+      if (__builtin_sub_overflow(end, begin, &span) ||
+          __builtin_add_overflow(span, range->excl ? 0 : 1, &span))
+        span = 64;
     }
   } else {
     mrb_raisef(mrb, E_TYPE_ERROR, "%Y cannot be converted to integer nor range",
@@ -37,11 +50,277 @@ static mrb_value integer_aref(mrb_state *mrb, mrb_value self) {
   if (span > 63)
     return self;
 
-  size_t mask = ((1 << span) - 1) << begin;
+  /* bits past the top copy the sign, bits below 0 are zero */
+  if (begin >= 64)
+    return mrb_int_value(mrb, mrb_integer(self) < 0
+                                  ? (mrb_int)((((size_t)1) << span) - 1)
+                                  : 0);
+  if (begin < 0) {
+    if (begin <= -64)
+      return mrb_int_value(mrb, 0);
+    value <<= -begin;
+    begin = 0;
+  }
+  if (span > 64 - begin)
+    span = 64 - begin;
+
+  size_t mask = ((((size_t)1) << span) - 1) << begin;
   return mrb_int_value(mrb, (value & mask) >> begin);
 }
 
+/* named bit ranges of an Integer, masks and shifts resolved once */
+typedef struct {
+  mrb_value key;
+  uint64_t mask;
+  uint8_t shift;
+} bitfield_t;
+
+typedef struct {
+  mrb_int count;
+  bitfield_t *fields;
+} bitlayout_t;
+
+static void bitlayout_free(mrb_state *mrb, bitlayout_t *layout) {
+  if (layout == nullptr)
+    return;
+
+  mrb_free(mrb, layout->fields);
+  mrb_free(mrb, layout);
+}
+
+static const mrb_data_type bitlayout_datatype = {
+    .struct_name = "BitLayout",
+    .dfree = (void (*)(mrb_state *, void *))bitlayout_free};
+
+static bitlayout_t *bitlayout_get(mrb_state *mrb, mrb_value self) {
+  bitlayout_t *layout = mrb_data_get_ptr(mrb, self, &bitlayout_datatype);
+
+  if (layout == nullptr)
+    mrb_raisef(mrb, E_RUNTIME_ERROR, "uninitialized %T", self);
+
+  return layout;
+}
+
+/* a Range of bit positions or a single bit index */
+static bitfield_t bitfield_of(mrb_state *mrb, mrb_value key, mrb_value bits) {
+  mrb_int begin;
+  mrb_int span = 1;
+
+  if (mrb_integer_p(bits)) {
+    begin = mrb_integer(bits);
+  } else if (mrb_range_p(bits)) {
+    struct RRange *range = mrb_range_ptr(mrb, bits);
+    begin = mrb_integer(mrb_to_int(mrb, range->beg));
+    const mrb_int end = mrb_integer(mrb_to_int(mrb, range->end));
+    /* bounded first, so end - begin can't overflow; 0 raises below */
+    span = begin < 0 || end < 0 || end > 64
+               ? 0
+               : end - begin + (range->excl ? 0 : 1);
+  } else {
+    mrb_raisef(mrb, E_TYPE_ERROR, "%Y cannot be converted to integer nor range",
+               bits);
+  }
+
+  if (begin < 0 || begin > 63 || span < 1 || span > 64 - begin)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid bit range %v for field %v",
+               bits, key);
+
+  return (bitfield_t){
+      .key = key,
+      .mask = span == 64 ? UINT64_MAX : (UINT64_C(1) << span) - 1,
+      .shift = begin,
+  };
+}
+
+static mrb_value bitlayout_init(mrb_state *mrb, mrb_value self) {
+  mrb_value fields = mrb_nil_value();
+  const mrb_kwargs kwargs = {0, 0, nullptr, nullptr, &fields};
+  mrb_get_args(mrb, ":", &kwargs);
+
+  bitlayout_t *layout = DATA_PTR(self);
+  if (layout != nullptr && DATA_TYPE(self) == &bitlayout_datatype)
+    bitlayout_free(mrb, layout);
+  mrb_data_init(self, nullptr, &bitlayout_datatype);
+
+  if (mrb_nil_p(fields))
+    fields = mrb_hash_new(mrb);
+
+  mrb_value keys = mrb_hash_keys(mrb, fields);
+  const mrb_int count = RARRAY_LEN(keys);
+
+  /* count grows as fields decode, a raise leaves a valid partial layout */
+  layout = mrb_malloc(mrb, sizeof(bitlayout_t));
+  *layout = (bitlayout_t){.count = 0, .fields = nullptr};
+  mrb_data_init(self, layout, &bitlayout_datatype);
+  layout->fields = mrb_malloc(mrb, (count ? count : 1) * sizeof(bitfield_t));
+
+  for (mrb_int i = 0; i < count; ++i) {
+    mrb_value key = RARRAY_PTR(keys)[i];
+    layout->fields[i] = bitfield_of(mrb, key, mrb_hash_get(mrb, fields, key));
+    layout->count = i + 1;
+  }
+
+  /* keeps the field keys alive */
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__keys__"), keys);
+
+  return self;
+}
+
+static mrb_int bitfield_get(const bitfield_t *field, uint64_t value) {
+  return (mrb_int)((value >> field->shift) & field->mask);
+}
+
+static uint64_t bitfield_put(mrb_state *mrb, const bitfield_t *field,
+                             mrb_value v) {
+  const uint64_t value = (uint64_t)mrb_as_int(mrb, v);
+
+  if (value & ~field->mask)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "%v doesn't fit in field %v", v,
+               field->key);
+
+  return value << field->shift;
+}
+
+static mrb_value bitlayout_unpack(mrb_state *mrb, mrb_value self) {
+  mrb_int value;
+  mrb_get_args(mrb, "i", &value);
+
+  const bitlayout_t *layout = bitlayout_get(mrb, self);
+  mrb_value res = mrb_hash_new_capa(mrb, layout->count);
+
+  for (mrb_int i = 0; i < layout->count; ++i)
+    mrb_hash_set(mrb, res, layout->fields[i].key,
+                 mrb_int_value(mrb, bitfield_get(&layout->fields[i], value)));
+
+  return res;
+}
+
+/* missing fields pack as 0 */
+static mrb_value bitlayout_pack(mrb_state *mrb, mrb_value self) {
+  mrb_value hash;
+  mrb_get_args(mrb, "H", &hash);
+
+  const bitlayout_t *layout = bitlayout_get(mrb, self);
+  uint64_t res = 0;
+
+  for (mrb_int i = 0; i < layout->count; ++i) {
+    mrb_value v = mrb_hash_fetch(mrb, hash, layout->fields[i].key,
+                                 mrb_nil_value());
+    if (!mrb_nil_p(v))
+      res |= bitfield_put(mrb, &layout->fields[i], v);
+  }
+
+  return mrb_int_value(mrb, (mrb_int)res);
+}
+
+/* [int, ...] -> {field => [value, ...], ...} */
+static mrb_value bitlayout_unpack_all(mrb_state *mrb, mrb_value self) {
+  mrb_value ary;
+  mrb_get_args(mrb, "A", &ary);
+
+  const bitlayout_t *layout = bitlayout_get(mrb, self);
+  const mrb_int len = RARRAY_LEN(ary);
+  mrb_value res = mrb_hash_new_capa(mrb, layout->count);
+
+  for (mrb_int f = 0; f < layout->count; ++f) {
+    const bitfield_t *field = &layout->fields[f];
+    mrb_value column = mrb_ary_new_capa(mrb, len);
+    mrb_hash_set(mrb, res, field->key, column);
+
+    for (mrb_int i = 0; i < len; ++i) {
+      const uint64_t value = mrb_as_int(mrb, RARRAY_PTR(ary)[i]);
+      mrb_ary_push(mrb, column, mrb_int_value(mrb, bitfield_get(field, value)));
+    }
+  }
+
+  return res;
+}
+
+/* {field => [value, ...], ...} -> [int, ...]; missing columns pack as 0 */
+static mrb_value bitlayout_pack_all(mrb_state *mrb, mrb_value self) {
+  mrb_value columns;
+  mrb_get_args(mrb, "H", &columns);
+
+  const bitlayout_t *layout = bitlayout_get(mrb, self);
+  mrb_int len = -1;
+
+  for (mrb_int f = 0; f < layout->count; ++f) {
+    mrb_value column = mrb_hash_fetch(mrb, columns, layout->fields[f].key,
+                                      mrb_nil_value());
+    if (mrb_nil_p(column))
+      continue;
+
+    if (!mrb_array_p(column))
+      mrb_raisef(mrb, E_TYPE_ERROR, "column %v is not an Array",
+                 layout->fields[f].key);
+
+    if (len >= 0 && RARRAY_LEN(column) != len)
+      mrb_raisef(mrb, E_ARGUMENT_ERROR,
+                 "column %v has %i values, expected %i",
+                 layout->fields[f].key, RARRAY_LEN(column), len);
+
+    len = RARRAY_LEN(column);
+  }
+
+  if (len < 0)
+    return mrb_ary_new(mrb);
+
+  /* scratch owned by the GC, bitfield_put may raise halfway */
+  mrb_value buf = mrb_str_new(mrb, nullptr, len * sizeof(uint64_t));
+  uint64_t *packed = (uint64_t *)RSTRING_PTR(buf);
+  memset(packed, 0, len * sizeof(uint64_t));
+
+  for (mrb_int f = 0; f < layout->count; ++f) {
+    const bitfield_t *field = &layout->fields[f];
+    mrb_value column = mrb_hash_fetch(mrb, columns, field->key,
+                                      mrb_nil_value());
+    if (mrb_nil_p(column))
+      continue;
+
+    for (mrb_int i = 0; i < len && i < RARRAY_LEN(column); ++i) {
+      mrb_value v = RARRAY_PTR(column)[i];
+      if (mrb_integer_p(v) && !((uint64_t)mrb_integer(v) & ~field->mask))
+        packed[i] |= (uint64_t)mrb_integer(v) << field->shift;
+      else if (!mrb_nil_p(v))
+        packed[i] |= bitfield_put(mrb, field, v);
+    }
+  }
+
+  mrb_value res = mrb_ary_new_capa(mrb, len);
+  for (mrb_int i = 0; i < len; ++i)
+    mrb_ary_push(mrb, res, mrb_int_value(mrb, (mrb_int)packed[i]));
+
+  return res;
+}
+
+static mrb_value bitlayout_fields(mrb_state *mrb, mrb_value self) {
+  const bitlayout_t *layout = bitlayout_get(mrb, self);
+  mrb_value res = mrb_ary_new_capa(mrb, layout->count);
+
+  for (mrb_int i = 0; i < layout->count; ++i)
+    mrb_ary_push(mrb, res, layout->fields[i].key);
+
+  return res;
+}
+
 void drb_register_c_extensions_with_api(mrb_state *mrb, void *) {
   mrb_define_method_id(mrb, mrb->integer_class, mrb_intern_lit(mrb, "[]"),
                        integer_aref, MRB_ARGS_ARG(1, 1));
+
+  struct RClass *bitlayout = mrb_define_class_id(
+      mrb, mrb_intern_lit(mrb, "BitLayout"), mrb->object_class);
+  MRB_SET_INSTANCE_TT(bitlayout, MRB_TT_DATA);
+
+  mrb_define_method_id(mrb, bitlayout, mrb_intern_lit(mrb, "initialize"),
+                       bitlayout_init, MRB_ARGS_ANY());
+  mrb_define_method_id(mrb, bitlayout, mrb_intern_lit(mrb, "fields"),
+                       bitlayout_fields, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, bitlayout, mrb_intern_lit(mrb, "unpack"),
+                       bitlayout_unpack, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, bitlayout, mrb_intern_lit(mrb, "pack"),
+                       bitlayout_pack, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, bitlayout, mrb_intern_lit(mrb, "unpack_all"),
+                       bitlayout_unpack_all, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, bitlayout, mrb_intern_lit(mrb, "pack_all"),
+                       bitlayout_pack_all, MRB_ARGS_REQ(1));
 }
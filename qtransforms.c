@@ -1,7 +1,18 @@
 #include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/data.h>
 #include <mruby/hash.h>
 #include <mruby/variable.h>
 
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cext_simd.h"
+#include "cext_stats.h"
+
 typedef struct Box {
   mrb_float x;
   mrb_float y;
@@ -23,34 +34,232 @@ mrb_sym sym$anchor_x;
 mrb_value val$sym$anchor_x;
 mrb_sym sym$anchor_y;
 mrb_value val$sym$anchor_y;
+mrb_sym sym$angle;
+mrb_value val$sym$angle;
+mrb_sym sym$angle_anchor_x;
+mrb_value val$sym$angle_anchor_x;
+mrb_sym sym$angle_anchor_y;
+mrb_value val$sym$angle_anchor_y;
+mrb_sym sym$zoom;
+mrb_value val$sym$zoom;
+mrb_sym sym$camera;
+mrb_sym sym$viewport;
+mrb_sym sym$indices;
 
-mrb_float qtr_extract_flt_property(mrb_state *mrb, mrb_value obj,
-                                   mrb_value key) {
-  if (mrb_hash_p(obj)) {
-    mrb_value property = mrb_hash_get(mrb, obj, key);
-    if (mrb_float_p(property)) {
-      return mrb_float(property);
-    } else if (mrb_integer_p(property)) {
-      return (mrb_float)mrb_integer(property);
-    } else if (mrb_nil_p(property)) {
-      return 0.0;
-    } else {
-      mrb_raisef(mrb, E_TYPE_ERROR,
-                 "non-float value on hash key %v for hash %v", key, obj);
-    }
+/* idx is the position of obj in the array being processed, for error
+ * messages; -1 when working on a single hash. dflt is returned for nil */
+mrb_float qtr_flt_of_value(mrb_state *mrb, mrb_value obj, mrb_value key,
+                           mrb_value property, mrb_float dflt, mrb_int idx) {
+  if (mrb_float_p(property)) {
+    return mrb_float(property);
+  } else if (mrb_integer_p(property)) {
+    return (mrb_float)mrb_integer(property);
+  } else if (mrb_nil_p(property) || mrb_undef_p(property)) {
+    return dflt;
+  } else if (idx >= 0) {
+    mrb_raisef(mrb, E_TYPE_ERROR,
+               "non-float value on hash key %v for hash %v at index %i", key,
+               obj, idx);
+  } else {
+    mrb_raisef(mrb, E_TYPE_ERROR,
+               "non-float value on hash key %v for hash %v", key, obj);
+  }
+}
+
+void qtr_check_hash(mrb_state *mrb, mrb_value obj, mrb_int idx) {
+  if (mrb_hash_p(obj))
+    return;
+
+  if (idx >= 0) {
+    mrb_raisef(mrb, E_TYPE_ERROR,
+               "tried to get float property from a non-hash at index %i", idx);
   } else {
     mrb_raisef(mrb, E_TYPE_ERROR,
                "tried to get float property from a non-hash");
   }
 }
 
-Box qtr_box_of_hash(mrb_state *mrb, mrb_value hash) {
-  mrb_float x = qtr_extract_flt_property(mrb, hash, val$sym$x);
-  mrb_float y = qtr_extract_flt_property(mrb, hash, val$sym$y);
-  mrb_float w = qtr_extract_flt_property(mrb, hash, val$sym$w);
-  mrb_float h = qtr_extract_flt_property(mrb, hash, val$sym$h);
-  mrb_float anchor_x = qtr_extract_flt_property(mrb, hash, val$sym$anchor_x);
-  mrb_float anchor_y = qtr_extract_flt_property(mrb, hash, val$sym$anchor_y);
+mrb_float qtr_extract_flt_property_or(mrb_state *mrb, mrb_value obj,
+                                      mrb_value key, mrb_float dflt,
+                                      mrb_int idx) {
+  qtr_check_hash(mrb, obj, idx);
+  return qtr_flt_of_value(mrb, obj, key, mrb_hash_get(mrb, obj, key), dflt,
+                          idx);
+}
+
+/* shape-cached property extraction
+ *
+ * Primitive hashes nearly always carry the same few keys in the same
+ * insertion order. Instead of one hashed lookup per property, small hashes
+ * are walked once in entry order; the key order of the last hash seen (its
+ * "shape") is remembered, so while consecutive hashes share a shape each
+ * entry is classified by a single symbol compare. */
+enum QtrProp {
+  QTR_PROP_X,
+  QTR_PROP_Y,
+  QTR_PROP_W,
+  QTR_PROP_H,
+  QTR_PROP_ANCHOR_X,
+  QTR_PROP_ANCHOR_Y,
+  QTR_PROP_ANGLE,
+  QTR_PROP_ANGLE_ANCHOR_X,
+  QTR_PROP_ANGLE_ANCHOR_Y,
+  QTR_NPROPS
+};
+
+#define QTR_PROPS_BOX                                                          \
+  ((1u << QTR_PROP_X) | (1u << QTR_PROP_Y) | (1u << QTR_PROP_W) |              \
+   (1u << QTR_PROP_H) | (1u << QTR_PROP_ANCHOR_X) | (1u << QTR_PROP_ANCHOR_Y))
+#define QTR_PROPS_ALL ((1u << QTR_NPROPS) - 1)
+
+#define QTR_SHAPE_MAX 16
+
+typedef struct HashShape {
+  uint8_t len;
+  mrb_sym keys[QTR_SHAPE_MAX];
+  int8_t prop[QTR_SHAPE_MAX];
+} HashShape;
+
+static HashShape qtr_shape;
+static bool qtr_shape_cache = true;
+
+static mrb_value qtr_prop_key(enum QtrProp prop) {
+  switch (prop) {
+  case QTR_PROP_X:
+    return val$sym$x;
+  case QTR_PROP_Y:
+    return val$sym$y;
+  case QTR_PROP_W:
+    return val$sym$w;
+  case QTR_PROP_H:
+    return val$sym$h;
+  case QTR_PROP_ANCHOR_X:
+    return val$sym$anchor_x;
+  case QTR_PROP_ANCHOR_Y:
+    return val$sym$anchor_y;
+  case QTR_PROP_ANGLE:
+    return val$sym$angle;
+  case QTR_PROP_ANGLE_ANCHOR_X:
+    return val$sym$angle_anchor_x;
+  case QTR_PROP_ANGLE_ANCHOR_Y:
+    return val$sym$angle_anchor_y;
+  default:
+    __builtin_unreachable();
+  }
+}
+
+static int8_t qtr_prop_of_sym(mrb_sym sym) {
+  for (int8_t prop = 0; prop < QTR_NPROPS; ++prop)
+    if (mrb_symbol(qtr_prop_key(prop)) == sym)
+      return prop;
+  return -1;
+}
+
+static mrb_float qtr_prop_default(enum QtrProp prop) {
+  return prop == QTR_PROP_ANGLE_ANCHOR_X || prop == QTR_PROP_ANGLE_ANCHOR_Y
+             ? 0.5
+             : 0.0;
+}
+
+struct qtr_props_walk_t {
+  mrb_value hash;
+  mrb_int idx;
+  uint32_t need;
+  uint8_t pos;
+  bool hit;
+  HashShape next;
+  mrb_float *out;
+};
+
+static int qtr_props_walk(mrb_state *mrb, mrb_value key, mrb_value val,
+                          void *data) {
+  struct qtr_props_walk_t *walk = data;
+  /* symbols are never 0, so it stands in for any non-symbol key */
+  const mrb_sym sym = mrb_symbol_p(key) ? mrb_symbol(key) : 0;
+  int8_t prop;
+
+  if (walk->hit && walk->pos < qtr_shape.len &&
+      qtr_shape.keys[walk->pos] == sym) {
+    prop = qtr_shape.prop[walk->pos];
+  } else {
+    walk->hit = false;
+    prop = sym ? qtr_prop_of_sym(sym) : -1;
+  }
+
+  walk->next.keys[walk->pos] = sym;
+  walk->next.prop[walk->pos] = prop;
+  ++walk->pos;
+
+  /* props outside need aren't validated, same as the uncached path */
+  if (prop >= 0 && (walk->need & (1u << prop)))
+    walk->out[prop] = qtr_flt_of_value(mrb, walk->hash, qtr_prop_key(prop),
+                                       val, qtr_prop_default(prop), walk->idx);
+
+  return 0;
+}
+
+enum {
+  QTR_STAT_BOX_OF_HASH,
+  QTR_STAT_SHAPE_CACHE,
+  QTR_NSTATS,
+};
+
+CEXT_STATS_DEFINE(QTR_NSTATS, [QTR_STAT_BOX_OF_HASH] = {.name = "box_of_hash"},
+                  [QTR_STAT_SHAPE_CACHE] = {.name = "shape_cache"});
+
+/* fills out[prop] for every prop in need, others keep their defaults */
+void qtr_hash_props_at(mrb_state *mrb, mrb_value hash, uint32_t need,
+                       mrb_float out[QTR_NPROPS], mrb_int idx) {
+  qtr_check_hash(mrb, hash, idx);
+
+  for (int prop = 0; prop < QTR_NPROPS; ++prop)
+    out[prop] = qtr_prop_default(prop);
+
+  CEXT_STAT(QTR_STAT_SHAPE_CACHE, calls, 1);
+
+  if (!qtr_shape_cache || MRB_RHASH_DEFAULT_P(hash) ||
+      mrb_hash_size(mrb, hash) > QTR_SHAPE_MAX) {
+    CEXT_STAT(QTR_STAT_SHAPE_CACHE, misses, 1);
+    for (int prop = 0; prop < QTR_NPROPS; ++prop)
+      if (need & (1u << prop))
+        out[prop] = qtr_flt_of_value(
+            mrb, hash, qtr_prop_key(prop),
+            mrb_hash_get(mrb, hash, qtr_prop_key(prop)),
+            qtr_prop_default(prop), idx);
+    return;
+  }
+
+  struct qtr_props_walk_t walk = {
+      .hash = hash, .idx = idx, .need = need, .pos = 0, .hit = true,
+      .out = out};
+  mrb_hash_foreach(mrb, mrb_hash_ptr(hash), qtr_props_walk, &walk);
+
+  if (!walk.hit || walk.pos != qtr_shape.len) {
+    CEXT_STAT(QTR_STAT_SHAPE_CACHE, misses, 1);
+    walk.next.len = walk.pos;
+    qtr_shape = walk.next;
+  } else {
+    CEXT_STAT(QTR_STAT_SHAPE_CACHE, hits, 1);
+  }
+}
+
+mrb_float qtr_extract_flt_property_at(mrb_state *mrb, mrb_value obj,
+                                      mrb_value key, mrb_int idx) {
+  return qtr_extract_flt_property_or(mrb, obj, key, 0.0, idx);
+}
+
+mrb_float qtr_extract_flt_property(mrb_state *mrb, mrb_value obj,
+                                   mrb_value key) {
+  return qtr_extract_flt_property_at(mrb, obj, key, -1);
+}
+
+Box qtr_box_of_props(const mrb_float props[QTR_NPROPS]) {
+  mrb_float x = props[QTR_PROP_X];
+  mrb_float y = props[QTR_PROP_Y];
+  mrb_float w = props[QTR_PROP_W];
+  mrb_float h = props[QTR_PROP_H];
+  mrb_float anchor_x = props[QTR_PROP_ANCHOR_X];
+  mrb_float anchor_y = props[QTR_PROP_ANCHOR_Y];
 
 	return (Box) {
     .x = x - anchor_x * w,
@@ -62,10 +271,21 @@ Box qtr_box_of_hash(mrb_state *mrb, mrb_value hash) {
 	};
 }
 
-mrb_value qtr_normalize_hash_b(mrb_state *mrb, mrb_value hash) {
-  mrb_check_frozen(mrb, mrb_hash_ptr(hash));
+Box qtr_box_of_hash_at(mrb_state *mrb, mrb_value hash, mrb_int idx) {
+  CEXT_STAT(QTR_STAT_BOX_OF_HASH, calls, 1);
+  mrb_float props[QTR_NPROPS];
+  qtr_hash_props_at(mrb, hash, QTR_PROPS_BOX, props, idx);
+  return qtr_box_of_props(props);
+}
+
+Box qtr_box_of_hash(mrb_state *mrb, mrb_value hash) {
+  return qtr_box_of_hash_at(mrb, hash, -1);
+}
+
+mrb_value qtr_normalize_hash_at_b(mrb_state *mrb, mrb_value hash, mrb_int idx) {
+	Box box = qtr_box_of_hash_at(mrb, hash, idx);
 
-	Box box = qtr_box_of_hash(mrb, hash);
+  mrb_check_frozen(mrb, mrb_hash_ptr(hash));
 
   mrb_hash_set(mrb, hash, val$sym$x, mrb_float_value(mrb, box.x));
   mrb_hash_set(mrb, hash, val$sym$y, mrb_float_value(mrb, box.y));
@@ -75,6 +295,10 @@ mrb_value qtr_normalize_hash_b(mrb_state *mrb, mrb_value hash) {
   return hash;
 }
 
+mrb_value qtr_normalize_hash_b(mrb_state *mrb, mrb_value hash) {
+  return qtr_normalize_hash_at_b(mrb, hash, -1);
+}
+
 mrb_value qtr_r_normalize_hash_b(mrb_state *mrb, mrb_value self) {
 	return qtr_normalize_hash_b(mrb, self);
 }
@@ -87,9 +311,15 @@ mrb_value qtr_r_normalize_hash(mrb_state *mrb, mrb_value self) {
   return new;
 }
 
-mrb_value qtr_scale_hash_b(mrb_state *mrb, mrb_value hash, mrb_float scale) {
-	mrb_float w = qtr_extract_flt_property(mrb, hash, val$sym$w);
-	mrb_float h = qtr_extract_flt_property(mrb, hash, val$sym$h);
+mrb_value qtr_scale_hash_at_b(mrb_state *mrb, mrb_value hash, mrb_float scale,
+                             mrb_int idx) {
+	mrb_float props[QTR_NPROPS];
+	qtr_hash_props_at(mrb, hash, (1u << QTR_PROP_W) | (1u << QTR_PROP_H), props,
+	                  idx);
+	mrb_float w = props[QTR_PROP_W];
+	mrb_float h = props[QTR_PROP_H];
+
+	mrb_check_frozen(mrb, mrb_hash_ptr(hash));
 
 	mrb_hash_set(mrb, hash, val$sym$w, mrb_float_value(mrb, w * scale));
 	mrb_hash_set(mrb, hash, val$sym$h, mrb_float_value(mrb, h * scale));
@@ -97,6 +327,10 @@ mrb_value qtr_scale_hash_b(mrb_state *mrb, mrb_value hash, mrb_float scale) {
 	return hash;
 }
 
+mrb_value qtr_scale_hash_b(mrb_state *mrb, mrb_value hash, mrb_float scale) {
+	return qtr_scale_hash_at_b(mrb, hash, scale, -1);
+}
+
 mrb_value qtr_r_scale_hash_b(mrb_state *mrb, mrb_value self) {
 	mrb_float scale;
 	mrb_get_args(mrb, "f", &scale);
@@ -115,6 +349,1260 @@ mrb_value qtr_r_scale_hash(mrb_state *mrb, mrb_value self) {
 	return new;
 }
 
+mrb_value qtr_r_normalize_ary_b(mrb_state *mrb, mrb_value self) {
+  int ai = mrb_gc_arena_save(mrb);
+
+  for (mrb_int i = 0; i < RARRAY_LEN(self); ++i) {
+    qtr_normalize_hash_at_b(mrb, RARRAY_PTR(self)[i], i);
+    mrb_gc_arena_restore(mrb, ai);
+  }
+
+  return self;
+}
+
+mrb_value qtr_r_scale_ary_b(mrb_state *mrb, mrb_value self) {
+	mrb_float scale;
+	mrb_get_args(mrb, "f", &scale);
+
+  int ai = mrb_gc_arena_save(mrb);
+
+  for (mrb_int i = 0; i < RARRAY_LEN(self); ++i) {
+    qtr_scale_hash_at_b(mrb, RARRAY_PTR(self)[i], scale, i);
+    mrb_gc_arena_restore(mrb, ai);
+  }
+
+  return self;
+}
+
+/* struct-of-arrays box storage, one contiguous column per field */
+enum BoxBufferColumn {
+  BOXBUF_X,
+  BOXBUF_Y,
+  BOXBUF_W,
+  BOXBUF_H,
+  BOXBUF_ANCHOR_X,
+  BOXBUF_ANCHOR_Y,
+  BOXBUF_NCOLS
+};
+
+typedef struct BoxBuffer {
+  size_t size;
+  size_t capa;
+  float *cols;
+} BoxBuffer;
+
+[[clang::always_inline]] float *qtr_boxbuf_col(const BoxBuffer *buf,
+                                               enum BoxBufferColumn col) {
+  return buf->cols + col * buf->capa;
+}
+
+void qtr_boxbuf_free(mrb_state *mrb, BoxBuffer *buf) {
+  if (buf == nullptr)
+    return;
+
+  mrb_free(mrb, buf->cols);
+  mrb_free(mrb, buf);
+}
+
+static const mrb_data_type qtr_boxbuf_datatype = {
+    .struct_name = "BoxBuffer",
+    .dfree = (void (*)(mrb_state *, void *))qtr_boxbuf_free};
+
+/* drops the previous contents, the caller sets size once the boxes are in */
+void qtr_boxbuf_reserve(mrb_state *mrb, BoxBuffer *buf, size_t size) {
+  buf->size = 0;
+
+  if (size > buf->capa) {
+    size_t capa = buf->capa ? buf->capa : 16;
+    while (capa < size)
+      capa *= 2;
+
+    /* keep buf consistent if the allocation raises */
+    mrb_free(mrb, buf->cols);
+    buf->cols = nullptr;
+    buf->capa = 0;
+    buf->cols = mrb_malloc(mrb, capa * BOXBUF_NCOLS * sizeof(float));
+    buf->capa = capa;
+  }
+}
+
+void qtr_boxbuf_load(mrb_state *mrb, BoxBuffer *buf, mrb_value ary) {
+  const mrb_int len = RARRAY_LEN(ary);
+
+  qtr_boxbuf_reserve(mrb, buf, len);
+
+  float *x = qtr_boxbuf_col(buf, BOXBUF_X);
+  float *y = qtr_boxbuf_col(buf, BOXBUF_Y);
+  float *w = qtr_boxbuf_col(buf, BOXBUF_W);
+  float *h = qtr_boxbuf_col(buf, BOXBUF_H);
+  float *ax = qtr_boxbuf_col(buf, BOXBUF_ANCHOR_X);
+  float *ay = qtr_boxbuf_col(buf, BOXBUF_ANCHOR_Y);
+
+  /* a raise leaves the buffer empty, and a to_f that shrinks ary cuts it
+   * short, so size never covers slots that weren't written */
+  mrb_int i = 0;
+  for (; i < len && i < RARRAY_LEN(ary); ++i) {
+    mrb_value hash = RARRAY_PTR(ary)[i];
+
+    mrb_float props[QTR_NPROPS];
+    qtr_hash_props_at(mrb, hash, QTR_PROPS_BOX, props, i);
+
+    x[i] = props[QTR_PROP_X];
+    y[i] = props[QTR_PROP_Y];
+    w[i] = props[QTR_PROP_W];
+    h[i] = props[QTR_PROP_H];
+    ax[i] = props[QTR_PROP_ANCHOR_X];
+    ay[i] = props[QTR_PROP_ANCHOR_Y];
+  }
+
+  buf->size = i;
+}
+
+/* per column kernels, dispatched on the cpu at load time. every variant does
+ * the same single-rounding float ops per element, so results are identical */
+typedef struct BoxKernels {
+  void (*add)(float *restrict a, size_t n, float k);
+  void (*mul)(float *restrict a, size_t n, float k);
+  /* a -= b * c */
+  void (*sub_mul)(float *restrict a, const float *restrict b,
+                  const float *restrict c, size_t n);
+  /* a += (b - a) * t */
+  void (*lerp)(float *restrict a, const float *restrict b, size_t n, float t);
+} BoxKernels;
+
+static void qtr_box_add_scalar(float *restrict a, size_t n, float k) {
+  CEXT_SCALAR_LOOP
+  for (size_t i = 0; i < n; ++i)
+    a[i] += k;
+}
+
+static void qtr_box_mul_scalar(float *restrict a, size_t n, float k) {
+  CEXT_SCALAR_LOOP
+  for (size_t i = 0; i < n; ++i)
+    a[i] *= k;
+}
+
+static void qtr_box_sub_mul_scalar(float *restrict a, const float *restrict b,
+                                   const float *restrict c, size_t n) {
+  CEXT_SCALAR_LOOP
+  for (size_t i = 0; i < n; ++i)
+    a[i] -= b[i] * c[i];
+}
+
+static void qtr_box_lerp_scalar(float *restrict a, const float *restrict b,
+                                size_t n, float t) {
+  CEXT_SCALAR_LOOP
+  for (size_t i = 0; i < n; ++i)
+    a[i] += (b[i] - a[i]) * t;
+}
+
+static const BoxKernels qtr_box_kernels_scalar = {
+    .add = qtr_box_add_scalar,
+    .mul = qtr_box_mul_scalar,
+    .sub_mul = qtr_box_sub_mul_scalar,
+    .lerp = qtr_box_lerp_scalar,
+};
+
+#ifdef CEXT_SIMD_X86
+/* one vector body per isa, the scalar kernels finish the tails */
+#define QTR_BOX_KERNELS(isa, target, vec, lanes, pfx, set1)                    \
+  target static void qtr_box_add_##isa(float *restrict a, size_t n, float k) { \
+    const vec vk = set1(k);                                                    \
+    size_t i = 0;                                                              \
+    for (; i + lanes <= n; i += lanes)                                         \
+      pfx##_storeu_ps(&a[i], pfx##_add_ps(pfx##_loadu_ps(&a[i]), vk));         \
+    qtr_box_add_scalar(a + i, n - i, k);                                       \
+  }                                                                            \
+                                                                               \
+  target static void qtr_box_mul_##isa(float *restrict a, size_t n, float k) { \
+    const vec vk = set1(k);                                                    \
+    size_t i = 0;                                                              \
+    for (; i + lanes <= n; i += lanes)                                         \
+      pfx##_storeu_ps(&a[i], pfx##_mul_ps(pfx##_loadu_ps(&a[i]), vk));         \
+    qtr_box_mul_scalar(a + i, n - i, k);                                       \
+  }                                                                            \
+                                                                               \
+  target static void qtr_box_sub_mul_##isa(                                    \
+      float *restrict a, const float *restrict b, const float *restrict c,     \
+      size_t n) {                                                              \
+    size_t i = 0;                                                              \
+    for (; i + lanes <= n; i += lanes)                                         \
+      pfx##_storeu_ps(&a[i],                                                   \
+                      pfx##_sub_ps(pfx##_loadu_ps(&a[i]),                      \
+                                   pfx##_mul_ps(pfx##_loadu_ps(&b[i]),         \
+                                                pfx##_loadu_ps(&c[i]))));      \
+    qtr_box_sub_mul_scalar(a + i, b + i, c + i, n - i);                        \
+  }                                                                            \
+                                                                               \
+  target static void qtr_box_lerp_##isa(float *restrict a,                     \
+                                        const float *restrict b, size_t n,     \
+                                        float t) {                             \
+    const vec vt = set1(t);                                                    \
+    size_t i = 0;                                                              \
+    for (; i + lanes <= n; i += lanes) {                                       \
+      const vec va = pfx##_loadu_ps(&a[i]);                                    \
+      const vec d = pfx##_sub_ps(pfx##_loadu_ps(&b[i]), va);                   \
+      pfx##_storeu_ps(&a[i], pfx##_add_ps(va, pfx##_mul_ps(d, vt)));           \
+    }                                                                          \
+    qtr_box_lerp_scalar(a + i, b + i, n - i, t);                               \
+  }                                                                            \
+                                                                               \
+  static const BoxKernels qtr_box_kernels_##isa = {                            \
+      .add = qtr_box_add_##isa,                                                \
+      .mul = qtr_box_mul_##isa,                                                \
+      .sub_mul = qtr_box_sub_mul_##isa,                                        \
+      .lerp = qtr_box_lerp_##isa,                                              \
+  };
+
+QTR_BOX_KERNELS(sse2, CEXT_TARGET_SSE2, __m128, 4, _mm, _mm_set1_ps)
+QTR_BOX_KERNELS(avx2, CEXT_TARGET_AVX2, __m256, 8, _mm256, _mm256_set1_ps)
+#endif
+
+static const BoxKernels *qtr_box_kernels = &qtr_box_kernels_scalar;
+
+static void qtr_simd_select(enum cext_isa isa) {
+  qtr_box_kernels =
+      CEXT_SIMD_PICK(isa, &qtr_box_kernels_scalar, &qtr_box_kernels_sse2,
+                     &qtr_box_kernels_avx2);
+}
+
+void qtr_boxbuf_translate(BoxBuffer *buf, float dx, float dy) {
+  qtr_box_kernels->add(qtr_boxbuf_col(buf, BOXBUF_X), buf->size, dx);
+  qtr_box_kernels->add(qtr_boxbuf_col(buf, BOXBUF_Y), buf->size, dy);
+}
+
+void qtr_boxbuf_scale(BoxBuffer *buf, float k) {
+  qtr_box_kernels->mul(qtr_boxbuf_col(buf, BOXBUF_W), buf->size, k);
+  qtr_box_kernels->mul(qtr_boxbuf_col(buf, BOXBUF_H), buf->size, k);
+}
+
+void qtr_boxbuf_normalize(BoxBuffer *buf) {
+  float *ax = qtr_boxbuf_col(buf, BOXBUF_ANCHOR_X);
+  float *ay = qtr_boxbuf_col(buf, BOXBUF_ANCHOR_Y);
+
+  qtr_box_kernels->sub_mul(qtr_boxbuf_col(buf, BOXBUF_X), ax,
+                           qtr_boxbuf_col(buf, BOXBUF_W), buf->size);
+  qtr_box_kernels->sub_mul(qtr_boxbuf_col(buf, BOXBUF_Y), ay,
+                           qtr_boxbuf_col(buf, BOXBUF_H), buf->size);
+
+  memset(ax, 0, buf->size * sizeof(float));
+  memset(ay, 0, buf->size * sizeof(float));
+}
+
+void qtr_boxbuf_lerp_to(BoxBuffer *buf, const BoxBuffer *other, float t) {
+  if (buf == other)
+    return;
+
+  for (enum BoxBufferColumn col = 0; col < BOXBUF_NCOLS; ++col)
+    qtr_box_kernels->lerp(qtr_boxbuf_col(buf, col), qtr_boxbuf_col(other, col),
+                          buf->size, t);
+}
+
+void qtr_boxbuf_store(mrb_state *mrb, const BoxBuffer *buf, size_t i,
+                      mrb_value hash) {
+  const float ax = qtr_boxbuf_col(buf, BOXBUF_ANCHOR_X)[i];
+  const float ay = qtr_boxbuf_col(buf, BOXBUF_ANCHOR_Y)[i];
+
+  mrb_hash_set(mrb, hash, val$sym$x,
+               mrb_float_value(mrb, qtr_boxbuf_col(buf, BOXBUF_X)[i]));
+  mrb_hash_set(mrb, hash, val$sym$y,
+               mrb_float_value(mrb, qtr_boxbuf_col(buf, BOXBUF_Y)[i]));
+  mrb_hash_set(mrb, hash, val$sym$w,
+               mrb_float_value(mrb, qtr_boxbuf_col(buf, BOXBUF_W)[i]));
+  mrb_hash_set(mrb, hash, val$sym$h,
+               mrb_float_value(mrb, qtr_boxbuf_col(buf, BOXBUF_H)[i]));
+
+  if (ax != 0.0f)
+    mrb_hash_set(mrb, hash, val$sym$anchor_x, mrb_float_value(mrb, ax));
+  else
+    mrb_hash_delete_key(mrb, hash, val$sym$anchor_x);
+
+  if (ay != 0.0f)
+    mrb_hash_set(mrb, hash, val$sym$anchor_y, mrb_float_value(mrb, ay));
+  else
+    mrb_hash_delete_key(mrb, hash, val$sym$anchor_y);
+}
+
+BoxBuffer *qtr_boxbuf_get(mrb_state *mrb, mrb_value self) {
+  BoxBuffer *buf = mrb_data_get_ptr(mrb, self, &qtr_boxbuf_datatype);
+
+  if (buf == nullptr)
+    mrb_raisef(mrb, E_RUNTIME_ERROR, "uninitialized %T", self);
+
+  return buf;
+}
+
+mrb_value qtr_r_boxbuf_init(mrb_state *mrb, mrb_value self) {
+  mrb_value ary = mrb_nil_value();
+  mrb_get_args(mrb, "|A!", &ary);
+
+  BoxBuffer *buf = DATA_PTR(self);
+  if (buf != nullptr && DATA_TYPE(self) == &qtr_boxbuf_datatype)
+    qtr_boxbuf_free(mrb, buf);
+  mrb_data_init(self, nullptr, &qtr_boxbuf_datatype);
+
+  buf = mrb_calloc(mrb, 1, sizeof(BoxBuffer));
+  mrb_data_init(self, buf, &qtr_boxbuf_datatype);
+
+  if (!mrb_nil_p(ary))
+    qtr_boxbuf_load(mrb, buf, ary);
+
+  return self;
+}
+
+mrb_value qtr_r_boxbuf_load(mrb_state *mrb, mrb_value self) {
+  mrb_value ary;
+  mrb_get_args(mrb, "A", &ary);
+
+  qtr_boxbuf_load(mrb, qtr_boxbuf_get(mrb, self), ary);
+  return self;
+}
+
+mrb_value qtr_r_boxbuf_size(mrb_state *mrb, mrb_value self) {
+  return mrb_int_value(mrb, qtr_boxbuf_get(mrb, self)->size);
+}
+
+mrb_value qtr_r_boxbuf_translate_b(mrb_state *mrb, mrb_value self) {
+  mrb_float dx, dy;
+  mrb_get_args(mrb, "ff", &dx, &dy);
+
+  qtr_boxbuf_translate(qtr_boxbuf_get(mrb, self), dx, dy);
+  return self;
+}
+
+mrb_value qtr_r_boxbuf_scale_b(mrb_state *mrb, mrb_value self) {
+  mrb_float scale;
+  mrb_get_args(mrb, "f", &scale);
+
+  qtr_boxbuf_scale(qtr_boxbuf_get(mrb, self), scale);
+  return self;
+}
+
+mrb_value qtr_r_boxbuf_normalize_b(mrb_state *mrb, mrb_value self) {
+  qtr_boxbuf_normalize(qtr_boxbuf_get(mrb, self));
+  return self;
+}
+
+mrb_value qtr_r_boxbuf_lerp_to_b(mrb_state *mrb, mrb_value self) {
+  mrb_value other;
+  mrb_float t;
+  mrb_get_args(mrb, "of", &other, &t);
+
+  BoxBuffer *buf = qtr_boxbuf_get(mrb, self);
+  const BoxBuffer *obuf =
+      mrb_data_check_get_ptr(mrb, other, &qtr_boxbuf_datatype);
+  if (obuf == nullptr)
+    mrb_raisef(mrb, E_TYPE_ERROR, "expected BoxBuffer, got %T", other);
+
+  if (buf->size != obuf->size)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "size mismatch: %i vs %i",
+               (mrb_int)buf->size, (mrb_int)obuf->size);
+
+  qtr_boxbuf_lerp_to(buf, obuf, t);
+  return self;
+}
+
+mrb_value qtr_r_boxbuf_write_back(mrb_state *mrb, mrb_value self) {
+  mrb_value ary;
+  mrb_get_args(mrb, "A", &ary);
+
+  const BoxBuffer *buf = qtr_boxbuf_get(mrb, self);
+
+  if ((size_t)RARRAY_LEN(ary) != buf->size)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "size mismatch: %i vs %i",
+               (mrb_int)RARRAY_LEN(ary), (mrb_int)buf->size);
+
+  int ai = mrb_gc_arena_save(mrb);
+
+  for (size_t i = 0; i < buf->size && i < (size_t)RARRAY_LEN(ary); ++i) {
+    mrb_value hash = RARRAY_PTR(ary)[i];
+
+    if (!mrb_hash_p(hash))
+      mrb_raisef(mrb, E_TYPE_ERROR, "non-hash %v at index %i", hash,
+                 (mrb_int)i);
+    mrb_check_frozen(mrb, mrb_hash_ptr(hash));
+
+    qtr_boxbuf_store(mrb, buf, i, hash);
+    mrb_gc_arena_restore(mrb, ai);
+  }
+
+  return ary;
+}
+
+mrb_value qtr_r_boxbuf_to_primitives(mrb_state *mrb, mrb_value self) {
+  const BoxBuffer *buf = qtr_boxbuf_get(mrb, self);
+  mrb_value ary = mrb_ary_new_capa(mrb, buf->size);
+
+  int ai = mrb_gc_arena_save(mrb);
+
+  for (size_t i = 0; i < buf->size; ++i) {
+    mrb_value hash = mrb_hash_new_capa(mrb, 6);
+    qtr_boxbuf_store(mrb, buf, i, hash);
+    mrb_ary_push(mrb, ary, hash);
+    mrb_gc_arena_restore(mrb, ai);
+  }
+
+  return ary;
+}
+
+/* rotation, as rendered: angle in degrees counter-clockwise around the point
+ * at (angle_anchor_x, angle_anchor_y) of the normalized box, default centre */
+typedef struct RotatedBox {
+  Box box;
+  mrb_float angle;
+  mrb_float angle_anchor_x;
+  mrb_float angle_anchor_y;
+} RotatedBox;
+
+typedef struct Corners {
+  mrb_float x[4];
+  mrb_float y[4];
+} Corners;
+
+/* sin/cos memo for batch calls, most primitives share a few angles */
+#define QTR_TRIG_CACHE_SIZE 64
+
+typedef struct TrigCache {
+  mrb_float angle[QTR_TRIG_CACHE_SIZE];
+  mrb_float sin[QTR_TRIG_CACHE_SIZE];
+  mrb_float cos[QTR_TRIG_CACHE_SIZE];
+  bool valid[QTR_TRIG_CACHE_SIZE];
+} TrigCache;
+
+void qtr_sincos(TrigCache *cache, mrb_float angle, mrb_float *s,
+                mrb_float *c) {
+  if (angle == 0.0) {
+    *s = 0.0;
+    *c = 1.0;
+    return;
+  }
+
+  size_t slot = 0;
+  if (cache != nullptr) {
+    uint64_t bits;
+    memcpy(&bits, &angle, sizeof(bits));
+    slot = ((bits * UINT64_C(0x9e3779b97f4a7c15)) >> 58) &
+           (QTR_TRIG_CACHE_SIZE - 1);
+
+    if (cache->valid[slot] && cache->angle[slot] == angle) {
+      *s = cache->sin[slot];
+      *c = cache->cos[slot];
+      return;
+    }
+  }
+
+  const mrb_float rad = angle * (3.14159265358979323846 / 180.0);
+  *s = sin(rad);
+  *c = cos(rad);
+
+  if (cache != nullptr) {
+    cache->angle[slot] = angle;
+    cache->sin[slot] = *s;
+    cache->cos[slot] = *c;
+    cache->valid[slot] = true;
+  }
+}
+
+RotatedBox qtr_rotated_box_of_hash_at(mrb_state *mrb, mrb_value hash,
+                                      mrb_int idx) {
+  mrb_float props[QTR_NPROPS];
+  qtr_hash_props_at(mrb, hash, QTR_PROPS_ALL, props, idx);
+
+  return (RotatedBox){
+      .box = qtr_box_of_props(props),
+      .angle = props[QTR_PROP_ANGLE],
+      .angle_anchor_x = props[QTR_PROP_ANGLE_ANCHOR_X],
+      .angle_anchor_y = props[QTR_PROP_ANGLE_ANCHOR_Y],
+  };
+}
+
+/* counter-clockwise from the bottom left corner of the unrotated box */
+Corners qtr_rotated_corners(const RotatedBox *rb, TrigCache *cache) {
+  const Box *b = &rb->box;
+  const mrb_float px = b->x + rb->angle_anchor_x * b->w;
+  const mrb_float py = b->y + rb->angle_anchor_y * b->h;
+
+  const mrb_float lx[4] = {b->x, b->x + b->w, b->x + b->w, b->x};
+  const mrb_float ly[4] = {b->y, b->y, b->y + b->h, b->y + b->h};
+
+  mrb_float s, c;
+  qtr_sincos(cache, rb->angle, &s, &c);
+
+  Corners out;
+  for (int i = 0; i < 4; ++i) {
+    const mrb_float dx = lx[i] - px;
+    const mrb_float dy = ly[i] - py;
+    out.x[i] = px + dx * c - dy * s;
+    out.y[i] = py + dx * s + dy * c;
+  }
+
+  return out;
+}
+
+Box qtr_corners_bounds(const Corners *cs) {
+  mrb_float x0 = cs->x[0], x1 = cs->x[0], y0 = cs->y[0], y1 = cs->y[0];
+
+  for (int i = 1; i < 4; ++i) {
+    x0 = cs->x[i] < x0 ? cs->x[i] : x0;
+    x1 = cs->x[i] > x1 ? cs->x[i] : x1;
+    y0 = cs->y[i] < y0 ? cs->y[i] : y0;
+    y1 = cs->y[i] > y1 ? cs->y[i] : y1;
+  }
+
+  return (Box){.x = x0, .y = y0, .w = x1 - x0, .h = y1 - y0};
+}
+
+static void qtr_corners_project(const Corners *cs, mrb_float ax, mrb_float ay,
+                                mrb_float *lo, mrb_float *hi) {
+  *lo = *hi = cs->x[0] * ax + cs->y[0] * ay;
+  for (int i = 1; i < 4; ++i) {
+    const mrb_float d = cs->x[i] * ax + cs->y[i] * ay;
+    *lo = d < *lo ? d : *lo;
+    *hi = d > *hi ? d : *hi;
+  }
+}
+
+/* separating axis test, the edge normals of both rectangles are the only
+ * candidate axes */
+bool qtr_corners_overlap(const Corners *a, const Corners *b) {
+  const Corners *shapes[2] = {a, b};
+
+  for (int s = 0; s < 2; ++s)
+    for (int e = 0; e < 2; ++e) {
+      const Corners *cs = shapes[s];
+      const mrb_float ax = -(cs->y[e + 1] - cs->y[e]);
+      const mrb_float ay = cs->x[e + 1] - cs->x[e];
+      /* a zero-size side has no normal to separate along */
+      if (ax == 0 && ay == 0)
+        continue;
+
+      mrb_float alo, ahi, blo, bhi;
+      qtr_corners_project(a, ax, ay, &alo, &ahi);
+      qtr_corners_project(b, ax, ay, &blo, &bhi);
+
+      if (ahi <= blo || bhi <= alo)
+        return false;
+    }
+
+  return true;
+}
+
+mrb_value qtr_corners_to_ary(mrb_state *mrb, const Corners *cs) {
+  mrb_value vals[8];
+  for (int i = 0; i < 4; ++i) {
+    vals[i * 2] = mrb_float_value(mrb, cs->x[i]);
+    vals[i * 2 + 1] = mrb_float_value(mrb, cs->y[i]);
+  }
+  return mrb_ary_new_from_values(mrb, 8, vals);
+}
+
+mrb_value qtr_box_to_hash(mrb_state *mrb, Box box) {
+  mrb_value hash = mrb_hash_new_capa(mrb, 4);
+  mrb_hash_set(mrb, hash, val$sym$x, mrb_float_value(mrb, box.x));
+  mrb_hash_set(mrb, hash, val$sym$y, mrb_float_value(mrb, box.y));
+  mrb_hash_set(mrb, hash, val$sym$w, mrb_float_value(mrb, box.w));
+  mrb_hash_set(mrb, hash, val$sym$h, mrb_float_value(mrb, box.h));
+  return hash;
+}
+
+mrb_value qtr_r_rotated_corners(mrb_state *mrb, mrb_value self) {
+  const RotatedBox rb = qtr_rotated_box_of_hash_at(mrb, self, -1);
+  const Corners cs = qtr_rotated_corners(&rb, nullptr);
+  return qtr_corners_to_ary(mrb, &cs);
+}
+
+mrb_value qtr_r_rotated_bounds(mrb_state *mrb, mrb_value self) {
+  const RotatedBox rb = qtr_rotated_box_of_hash_at(mrb, self, -1);
+  const Corners cs = qtr_rotated_corners(&rb, nullptr);
+  return qtr_box_to_hash(mrb, qtr_corners_bounds(&cs));
+}
+
+mrb_value qtr_r_ary_rotated_corners(mrb_state *mrb, mrb_value self) {
+  TrigCache cache = {0};
+  mrb_value res = mrb_ary_new_capa(mrb, RARRAY_LEN(self));
+  int ai = mrb_gc_arena_save(mrb);
+
+  for (mrb_int i = 0; i < RARRAY_LEN(self); ++i) {
+    const RotatedBox rb =
+        qtr_rotated_box_of_hash_at(mrb, RARRAY_PTR(self)[i], i);
+    const Corners cs = qtr_rotated_corners(&rb, &cache);
+    mrb_ary_push(mrb, res, qtr_corners_to_ary(mrb, &cs));
+    mrb_gc_arena_restore(mrb, ai);
+  }
+
+  return res;
+}
+
+mrb_value qtr_r_ary_rotated_bounds(mrb_state *mrb, mrb_value self) {
+  TrigCache cache = {0};
+  mrb_value res = mrb_ary_new_capa(mrb, RARRAY_LEN(self));
+  int ai = mrb_gc_arena_save(mrb);
+
+  for (mrb_int i = 0; i < RARRAY_LEN(self); ++i) {
+    const RotatedBox rb =
+        qtr_rotated_box_of_hash_at(mrb, RARRAY_PTR(self)[i], i);
+    const Corners cs = qtr_rotated_corners(&rb, &cache);
+    mrb_ary_push(mrb, res, qtr_box_to_hash(mrb, qtr_corners_bounds(&cs)));
+    mrb_gc_arena_restore(mrb, ai);
+  }
+
+  return res;
+}
+
+mrb_value qtr_r_obb_overlap_p(mrb_state *mrb, mrb_value) {
+  mrb_value a, b;
+  mrb_get_args(mrb, "HH", &a, &b);
+
+  const RotatedBox ra = qtr_rotated_box_of_hash_at(mrb, a, -1);
+  const RotatedBox rb = qtr_rotated_box_of_hash_at(mrb, b, -1);
+  const Corners ca = qtr_rotated_corners(&ra, nullptr);
+  const Corners cb = qtr_rotated_corners(&rb, nullptr);
+
+  return mrb_bool_value(qtr_corners_overlap(&ca, &cb));
+}
+
+/* broadphase spatial index over normalized boxes
+ *
+ * Both backends share one open-addressing table of buckets keyed by
+ * (level, cx, cy). The uniform grid uses level 0 only and files a box under
+ * every cell it covers; a box covering more than SPATIAL_MAX_CELLS cells goes
+ * into a single oversize bucket instead, which every query scans. The loose quadtree files a box once, in the cell of
+ * its centre at the deepest level whose cell size still fits it; a box then
+ * sticks out of its cell by at most half its extent, which is tracked per
+ * level and used to widen queries. Buckets are freed once they empty.
+ *
+ * Ids index a dense entry array, so they should be small and packed (array
+ * indices, slot numbers); an id more than SPATIAL_ID_SLACK past twice the
+ * current capacity raises instead of growing the array to match. */
+#define SPATIAL_MAX_LEVELS 24
+#define SPATIAL_CELL_LIMIT (1 << 30)
+#define SPATIAL_ID_SLACK 1024
+#define SPATIAL_MAX_CELLS 256
+#define SPATIAL_OVERSIZE SPATIAL_MAX_LEVELS /* level of the oversize bucket */
+
+enum SpatialKind { SPATIAL_GRID, SPATIAL_QUADTREE };
+
+typedef struct SpatialEntry {
+  mrb_float x;
+  mrb_float y;
+  mrb_float w;
+  mrb_float h;
+  int32_t cx0;
+  int32_t cy0;
+  int32_t cx1;
+  int32_t cy1;
+  uint32_t stamp;
+  uint8_t level;
+  bool present;
+} SpatialEntry;
+
+typedef struct SpatialBucket {
+  int32_t cx;
+  int32_t cy;
+  uint8_t level;
+  bool used;
+  uint32_t size;
+  uint32_t capa;
+  uint32_t *ids;
+} SpatialBucket;
+
+typedef struct SpatialIds {
+  size_t size;
+  size_t capa;
+  uint32_t *ids;
+} SpatialIds;
+
+typedef struct SpatialIndex {
+  enum SpatialKind kind;
+  /* grid cell size, or the level 0 cell size of the quadtree */
+  mrb_float cell;
+  uint8_t depth;
+  uint32_t stamp;
+  size_t count;
+  size_t nentries;
+  SpatialEntry *entries;
+  size_t nslots;
+  size_t nused;
+  SpatialBucket *slots;
+  size_t level_buckets[SPATIAL_MAX_LEVELS + 1];
+  mrb_float margin[SPATIAL_MAX_LEVELS + 1];
+  SpatialIds scratch;
+} SpatialIndex;
+
+void qtr_spatial_free(mrb_state *mrb, SpatialIndex *idx) {
+  if (idx == nullptr)
+    return;
+
+  for (size_t i = 0; i < idx->nslots; ++i)
+    mrb_free(mrb, idx->slots[i].ids);
+
+  mrb_free(mrb, idx->slots);
+  mrb_free(mrb, idx->entries);
+  mrb_free(mrb, idx->scratch.ids);
+  mrb_free(mrb, idx);
+}
+
+static const mrb_data_type qtr_spatial_datatype = {
+    .struct_name = "SpatialIndex",
+    .dfree = (void (*)(mrb_state *, void *))qtr_spatial_free};
+
+static inline uint64_t qtr_spatial_hash(uint8_t level, int32_t cx,
+                                        int32_t cy) {
+  uint64_t k = ((uint64_t)(uint32_t)cx << 32 | (uint32_t)cy) ^
+               ((uint64_t)level * UINT64_C(0x9e3779b97f4a7c15));
+  k = (k ^ (k >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+  k = (k ^ (k >> 27)) * UINT64_C(0x94d049bb133111eb);
+  return k ^ (k >> 31);
+}
+
+static SpatialBucket *qtr_spatial_slot(SpatialBucket *slots, size_t nslots,
+                                       uint8_t level, int32_t cx, int32_t cy) {
+  for (size_t h = qtr_spatial_hash(level, cx, cy);; ++h) {
+    SpatialBucket *b = &slots[h & (nslots - 1)];
+    if (!b->used || (b->level == level && b->cx == cx && b->cy == cy))
+      return b;
+  }
+}
+
+SpatialBucket *qtr_spatial_find(const SpatialIndex *idx, uint8_t level,
+                                int32_t cx, int32_t cy) {
+  if (idx->nslots == 0)
+    return nullptr;
+
+  SpatialBucket *b = qtr_spatial_slot(idx->slots, idx->nslots, level, cx, cy);
+  return b->used ? b : nullptr;
+}
+
+SpatialBucket *qtr_spatial_find_or_add(mrb_state *mrb, SpatialIndex *idx,
+                                       uint8_t level, int32_t cx, int32_t cy) {
+  if ((idx->nused + 1) * 2 > idx->nslots) {
+    size_t nslots = idx->nslots ? idx->nslots * 2 : 64;
+    SpatialBucket *slots = mrb_calloc(mrb, nslots, sizeof(SpatialBucket));
+
+    for (size_t i = 0; i < idx->nslots; ++i) {
+      const SpatialBucket *old = &idx->slots[i];
+      if (old->used)
+        *qtr_spatial_slot(slots, nslots, old->level, old->cx, old->cy) = *old;
+    }
+
+    mrb_free(mrb, idx->slots);
+    idx->slots = slots;
+    idx->nslots = nslots;
+  }
+
+  SpatialBucket *b = qtr_spatial_slot(idx->slots, idx->nslots, level, cx, cy);
+  if (!b->used) {
+    *b = (SpatialBucket){.cx = cx, .cy = cy, .level = level, .used = true};
+    ++idx->nused;
+    ++idx->level_buckets[level];
+  }
+
+  return b;
+}
+
+void qtr_spatial_ids_push(mrb_state *mrb, SpatialIds *ids, uint32_t id) {
+  if (ids->size == ids->capa) {
+    size_t capa = ids->capa ? ids->capa * 2 : 64;
+    ids->ids = mrb_realloc(mrb, ids->ids, capa * sizeof(uint32_t));
+    ids->capa = capa;
+  }
+  ids->ids[ids->size++] = id;
+}
+
+void qtr_spatial_bucket_add(mrb_state *mrb, SpatialBucket *b, uint32_t id) {
+  if (b->size == b->capa) {
+    uint32_t capa = b->capa ? b->capa * 2 : 4;
+    b->ids = mrb_realloc(mrb, b->ids, capa * sizeof(uint32_t));
+    b->capa = capa;
+  }
+  b->ids[b->size++] = id;
+}
+
+/* frees an emptied bucket and closes the gap it leaves in its probe run, so
+ * lookups still reach the buckets placed past it */
+void qtr_spatial_drop(mrb_state *mrb, SpatialIndex *idx, SpatialBucket *b) {
+  const size_t mask = idx->nslots - 1;
+  size_t gap = b - idx->slots;
+
+  mrb_free(mrb, b->ids);
+  --idx->level_buckets[b->level];
+  --idx->nused;
+
+  for (size_t j = (gap + 1) & mask; idx->slots[j].used; j = (j + 1) & mask) {
+    const SpatialBucket *c = &idx->slots[j];
+    const size_t home = qtr_spatial_hash(c->level, c->cx, c->cy) & mask;
+
+    /* c can only move back if its home slot is not between gap and j */
+    if (((j - home) & mask) >= ((j - gap) & mask)) {
+      idx->slots[gap] = *c;
+      gap = j;
+    }
+  }
+
+  idx->slots[gap] = (SpatialBucket){0};
+}
+
+void qtr_spatial_bucket_remove(SpatialBucket *b, uint32_t id) {
+  for (uint32_t i = 0; i < b->size; ++i) {
+    if (b->ids[i] == id) {
+      b->ids[i] = b->ids[--b->size];
+      return;
+    }
+  }
+}
+
+static inline int32_t qtr_spatial_cell_of(mrb_float v, mrb_float cell) {
+  mrb_float c = floor(v / cell);
+  if (!(c > -SPATIAL_CELL_LIMIT))
+    return -SPATIAL_CELL_LIMIT;
+  if (c > SPATIAL_CELL_LIMIT)
+    return SPATIAL_CELL_LIMIT;
+  return (int32_t)c;
+}
+
+static inline mrb_float qtr_spatial_level_cell(const SpatialIndex *idx,
+                                               uint8_t level) {
+  return ldexp(idx->cell, -level);
+}
+
+static inline bool qtr_spatial_overlap(const SpatialEntry *e, Box r) {
+  return e->x < r.x + r.w && r.x < e->x + e->w && e->y < r.y + r.h &&
+         r.y < e->y + e->h;
+}
+
+/* decides the level and cell range of e */
+void qtr_spatial_place(SpatialIndex *idx, SpatialEntry *e) {
+  if (idx->kind == SPATIAL_GRID) {
+    e->level = 0;
+    e->cx0 = qtr_spatial_cell_of(e->x, idx->cell);
+    e->cy0 = qtr_spatial_cell_of(e->y, idx->cell);
+    e->cx1 = qtr_spatial_cell_of(e->x + e->w, idx->cell);
+    e->cy1 = qtr_spatial_cell_of(e->y + e->h, idx->cell);
+
+    if (((double)e->cx1 - e->cx0 + 1) * ((double)e->cy1 - e->cy0 + 1) >
+        SPATIAL_MAX_CELLS) {
+      e->level = SPATIAL_OVERSIZE;
+      e->cx0 = e->cy0 = e->cx1 = e->cy1 = 0;
+    }
+    return;
+  }
+
+  mrb_float extent = e->w > e->h ? e->w : e->h;
+  uint8_t level = 0;
+  while (level < idx->depth &&
+         qtr_spatial_level_cell(idx, level + 1) >= extent)
+    ++level;
+
+  mrb_float cell = qtr_spatial_level_cell(idx, level);
+  e->level = level;
+  e->cx0 = e->cx1 = qtr_spatial_cell_of(e->x + e->w / 2, cell);
+  e->cy0 = e->cy1 = qtr_spatial_cell_of(e->y + e->h / 2, cell);
+
+  if (extent / 2 > idx->margin[level])
+    idx->margin[level] = extent / 2;
+}
+
+void qtr_spatial_unlink(mrb_state *mrb, SpatialIndex *idx, uint32_t id) {
+  SpatialEntry *e = &idx->entries[id];
+
+  for (int32_t cy = e->cy0; cy <= e->cy1; ++cy)
+    for (int32_t cx = e->cx0; cx <= e->cx1; ++cx) {
+      SpatialBucket *b = qtr_spatial_find(idx, e->level, cx, cy);
+      if (b == nullptr)
+        continue;
+
+      qtr_spatial_bucket_remove(b, id);
+      if (b->size == 0)
+        qtr_spatial_drop(mrb, idx, b);
+    }
+
+  e->present = false;
+  --idx->count;
+}
+
+void qtr_spatial_update(mrb_state *mrb, SpatialIndex *idx, mrb_int id,
+                        Box box) {
+  if (id < 0 || id >= UINT32_MAX)
+    mrb_raisef(mrb, E_INDEX_ERROR, "spatial index id %i out of range", id);
+  if ((size_t)id >= idx->nentries * 2 + SPATIAL_ID_SLACK)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR,
+               "spatial index id %i too sparse, ids must be dense (below %i)",
+               id, (mrb_int)(idx->nentries * 2 + SPATIAL_ID_SLACK));
+  if (!isfinite(box.x) || !isfinite(box.y) || !isfinite(box.w) ||
+      !isfinite(box.h))
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "non-finite box %f, %f, %f, %f", box.x,
+               box.y, box.w, box.h);
+
+  if ((size_t)id >= idx->nentries) {
+    size_t nentries = idx->nentries ? idx->nentries : 64;
+    while (nentries <= (size_t)id)
+      nentries *= 2;
+
+    idx->entries =
+        mrb_realloc(mrb, idx->entries, nentries * sizeof(SpatialEntry));
+    memset(idx->entries + idx->nentries, 0,
+           (nentries - idx->nentries) * sizeof(SpatialEntry));
+    idx->nentries = nentries;
+  }
+
+  SpatialEntry *e = &idx->entries[id];
+  SpatialEntry next = {
+      .x = box.x, .y = box.y, .w = box.w, .h = box.h, .stamp = e->stamp};
+  qtr_spatial_place(idx, &next);
+
+  if (e->present && e->level == next.level && e->cx0 == next.cx0 &&
+      e->cy0 == next.cy0 && e->cx1 == next.cx1 && e->cy1 == next.cy1) {
+    /* same cells, only the exact bounds move */
+    e->x = next.x;
+    e->y = next.y;
+    e->w = next.w;
+    e->h = next.h;
+    return;
+  }
+
+  if (e->present)
+    qtr_spatial_unlink(mrb, idx, id);
+
+  for (int32_t cy = next.cy0; cy <= next.cy1; ++cy)
+    for (int32_t cx = next.cx0; cx <= next.cx1; ++cx)
+      qtr_spatial_bucket_add(
+          mrb, qtr_spatial_find_or_add(mrb, idx, next.level, cx, cy), id);
+
+  next.present = true;
+  idx->entries[id] = next;
+  ++idx->count;
+}
+
+static void qtr_spatial_collect_bucket(mrb_state *mrb, SpatialIndex *idx,
+                                       const SpatialBucket *b, Box rect,
+                                       SpatialIds *out) {
+  for (uint32_t i = 0; i < b->size; ++i) {
+    SpatialEntry *e = &idx->entries[b->ids[i]];
+    if (e->stamp == idx->stamp)
+      continue;
+    e->stamp = idx->stamp;
+
+    if (qtr_spatial_overlap(e, rect))
+      qtr_spatial_ids_push(mrb, out, b->ids[i]);
+  }
+}
+
+/* appends the ids of every entry overlapping rect to out */
+void qtr_spatial_query(mrb_state *mrb, SpatialIndex *idx, Box rect,
+                       SpatialIds *out) {
+  if (++idx->stamp == 0) {
+    for (size_t i = 0; i < idx->nentries; ++i)
+      idx->entries[i].stamp = 0;
+    idx->stamp = 1;
+  }
+
+  uint8_t levels = idx->kind == SPATIAL_GRID ? 1 : idx->depth + 1;
+
+  for (uint8_t level = 0; level < levels; ++level) {
+    if (idx->level_buckets[level] == 0)
+      continue;
+
+    mrb_float cell = idx->kind == SPATIAL_GRID
+                         ? idx->cell
+                         : qtr_spatial_level_cell(idx, level);
+    mrb_float margin = idx->kind == SPATIAL_GRID ? 0.0 : idx->margin[level];
+
+    int32_t cx0 = qtr_spatial_cell_of(rect.x - margin, cell);
+    int32_t cy0 = qtr_spatial_cell_of(rect.y - margin, cell);
+    int32_t cx1 = qtr_spatial_cell_of(rect.x + rect.w + margin, cell);
+    int32_t cy1 = qtr_spatial_cell_of(rect.y + rect.h + margin, cell);
+
+    double ncells = ((double)cx1 - cx0 + 1) * ((double)cy1 - cy0 + 1);
+
+    if (ncells > (double)idx->level_buckets[level]) {
+      /* cheaper to walk every bucket of the level than every cell */
+      for (size_t i = 0; i < idx->nslots; ++i) {
+        const SpatialBucket *b = &idx->slots[i];
+        if (b->used && b->level == level && b->cx >= cx0 && b->cx <= cx1 &&
+            b->cy >= cy0 && b->cy <= cy1)
+          qtr_spatial_collect_bucket(mrb, idx, b, rect, out);
+      }
+      continue;
+    }
+
+    for (int32_t cy = cy0; cy <= cy1; ++cy)
+      for (int32_t cx = cx0; cx <= cx1; ++cx) {
+        const SpatialBucket *b = qtr_spatial_find(idx, level, cx, cy);
+        if (b != nullptr)
+          qtr_spatial_collect_bucket(mrb, idx, b, rect, out);
+      }
+  }
+
+  const SpatialBucket *big = qtr_spatial_find(idx, SPATIAL_OVERSIZE, 0, 0);
+  if (big != nullptr)
+    qtr_spatial_collect_bucket(mrb, idx, big, rect, out);
+}
+
+void qtr_spatial_clear(mrb_state *mrb, SpatialIndex *idx) {
+  for (size_t i = 0; i < idx->nslots; ++i)
+    mrb_free(mrb, idx->slots[i].ids);
+  mrb_free(mrb, idx->slots);
+
+  idx->slots = nullptr;
+  idx->nslots = 0;
+  idx->nused = 0;
+  idx->count = 0;
+
+  memset(idx->entries, 0, idx->nentries * sizeof(SpatialEntry));
+  memset(idx->level_buckets, 0, sizeof(idx->level_buckets));
+  memset(idx->margin, 0, sizeof(idx->margin));
+  idx->stamp = 0;
+}
+
+/* rects are primitive hashes (anchor-aware) or [x, y, w, h] arrays */
+Box qtr_rect_of_value(mrb_state *mrb, mrb_value v, mrb_int i) {
+  if (mrb_array_p(v) && RARRAY_LEN(v) == 4) {
+    const mrb_value *p = RARRAY_PTR(v);
+    return (Box){.x = mrb_as_float(mrb, p[0]),
+                 .y = mrb_as_float(mrb, p[1]),
+                 .w = mrb_as_float(mrb, p[2]),
+                 .h = mrb_as_float(mrb, p[3])};
+  }
+
+  return qtr_box_of_hash_at(mrb, v, i);
+}
+
+SpatialIndex *qtr_spatial_get(mrb_state *mrb, mrb_value self) {
+  SpatialIndex *idx = mrb_data_get_ptr(mrb, self, &qtr_spatial_datatype);
+
+  if (idx == nullptr)
+    mrb_raisef(mrb, E_RUNTIME_ERROR, "uninitialized %T", self);
+
+  return idx;
+}
+
+static void qtr_spatial_init(mrb_state *mrb, mrb_value self,
+                             enum SpatialKind kind, mrb_float cell,
+                             mrb_int depth) {
+  if (!(cell > 0.0) || isinf(cell))
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid cell size %f", cell);
+
+  if (depth < 0 || depth >= SPATIAL_MAX_LEVELS)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "depth %i outside of 0...%i", depth,
+               (mrb_int)SPATIAL_MAX_LEVELS);
+
+  SpatialIndex *idx = DATA_PTR(self);
+  if (idx != nullptr && DATA_TYPE(self) == &qtr_spatial_datatype)
+    qtr_spatial_free(mrb, idx);
+  mrb_data_init(self, nullptr, &qtr_spatial_datatype);
+
+  idx = mrb_calloc(mrb, 1, sizeof(SpatialIndex));
+  idx->kind = kind;
+  idx->cell = cell;
+  idx->depth = depth;
+  mrb_data_init(self, idx, &qtr_spatial_datatype);
+}
+
+mrb_value qtr_r_spatial_grid_init(mrb_state *mrb, mrb_value self) {
+  mrb_float cell;
+  mrb_get_args(mrb, "f", &cell);
+
+  qtr_spatial_init(mrb, self, SPATIAL_GRID, cell, 0);
+  return self;
+}
+
+mrb_value qtr_r_spatial_quadtree_init(mrb_state *mrb, mrb_value self) {
+  mrb_float size;
+  mrb_int depth = 8;
+  mrb_get_args(mrb, "f|i", &size, &depth);
+
+  qtr_spatial_init(mrb, self, SPATIAL_QUADTREE, size, depth);
+  return self;
+}
+
+mrb_value qtr_r_spatial_build(mrb_state *mrb, mrb_value self) {
+  mrb_value src = mrb_get_arg1(mrb);
+  SpatialIndex *idx = qtr_spatial_get(mrb, self);
+
+  qtr_spatial_clear(mrb, idx);
+
+  if (mrb_array_p(src)) {
+    for (mrb_int i = 0; i < RARRAY_LEN(src); ++i)
+      qtr_spatial_update(mrb, idx, i,
+                         qtr_rect_of_value(mrb, RARRAY_PTR(src)[i], i));
+    return self;
+  }
+
+  const BoxBuffer *buf = mrb_data_check_get_ptr(mrb, src, &qtr_boxbuf_datatype);
+  if (buf == nullptr)
+    mrb_raisef(mrb, E_TYPE_ERROR, "expected Array or BoxBuffer, got %T", src);
+
+  const float *x = qtr_boxbuf_col(buf, BOXBUF_X);
+  const float *y = qtr_boxbuf_col(buf, BOXBUF_Y);
+  const float *w = qtr_boxbuf_col(buf, BOXBUF_W);
+  const float *h = qtr_boxbuf_col(buf, BOXBUF_H);
+  const float *ax = qtr_boxbuf_col(buf, BOXBUF_ANCHOR_X);
+  const float *ay = qtr_boxbuf_col(buf, BOXBUF_ANCHOR_Y);
+
+  for (size_t i = 0; i < buf->size; ++i)
+    qtr_spatial_update(mrb, idx, i,
+                       (Box){.x = x[i] - ax[i] * w[i],
+                             .y = y[i] - ay[i] * h[i],
+                             .w = w[i],
+                             .h = h[i]});
+
+  return self;
+}
+
+mrb_value qtr_r_spatial_update(mrb_state *mrb, mrb_value self) {
+  mrb_int id;
+  mrb_value box;
+  mrb_get_args(mrb, "io", &id, &box);
+
+  qtr_spatial_update(mrb, qtr_spatial_get(mrb, self), id,
+                     qtr_rect_of_value(mrb, box, -1));
+  return self;
+}
+
+mrb_value qtr_r_spatial_remove(mrb_state *mrb, mrb_value self) {
+  mrb_int id;
+  mrb_get_args(mrb, "i", &id);
+
+  SpatialIndex *idx = qtr_spatial_get(mrb, self);
+
+  if (id < 0 || (size_t)id >= idx->nentries || !idx->entries[id].present)
+    return mrb_false_value();
+
+  qtr_spatial_unlink(mrb, idx, id);
+  return mrb_true_value();
+}
+
+mrb_value qtr_r_spatial_query(mrb_state *mrb, mrb_value self) {
+  mrb_value rect = mrb_get_arg1(mrb);
+  SpatialIndex *idx = qtr_spatial_get(mrb, self);
+
+  idx->scratch.size = 0;
+  qtr_spatial_query(mrb, idx, qtr_rect_of_value(mrb, rect, -1),
+                    &idx->scratch);
+
+  mrb_value ary = mrb_ary_new_capa(mrb, idx->scratch.size);
+  for (size_t i = 0; i < idx->scratch.size; ++i)
+    mrb_ary_push(mrb, ary, mrb_int_value(mrb, idx->scratch.ids[i]));
+
+  return ary;
+}
+
+mrb_value qtr_r_spatial_overlapping_pairs(mrb_state *mrb, mrb_value self) {
+  SpatialIndex *idx = qtr_spatial_get(mrb, self);
+  mrb_value ary = mrb_ary_new(mrb);
+
+  for (size_t a = 0; a < idx->nentries; ++a) {
+    const SpatialEntry *e = &idx->entries[a];
+    if (!e->present)
+      continue;
+
+    idx->scratch.size = 0;
+    qtr_spatial_query(mrb, idx,
+                      (Box){.x = e->x, .y = e->y, .w = e->w, .h = e->h},
+                      &idx->scratch);
+
+    for (size_t i = 0; i < idx->scratch.size; ++i) {
+      uint32_t b = idx->scratch.ids[i];
+      if (b <= a)
+        continue;
+      mrb_ary_push(mrb, ary, mrb_int_value(mrb, a));
+      mrb_ary_push(mrb, ary, mrb_int_value(mrb, b));
+    }
+  }
+
+  return ary;
+}
+
+mrb_value qtr_r_spatial_size(mrb_state *mrb, mrb_value self) {
+  return mrb_int_value(mrb, qtr_spatial_get(mrb, self)->count);
+}
+
+mrb_value qtr_r_spatial_clear(mrb_state *mrb, mrb_value self) {
+  qtr_spatial_clear(mrb, qtr_spatial_get(mrb, self));
+  return self;
+}
+
+/* camera is a hash of x, y and zoom (nil zoom meaning 1), or [x, y, zoom] */
+void qtr_camera_of_value(mrb_state *mrb, mrb_value v, mrb_float *x,
+                         mrb_float *y, mrb_float *zoom) {
+  if (mrb_array_p(v) && (RARRAY_LEN(v) == 2 || RARRAY_LEN(v) == 3)) {
+    const mrb_value *p = RARRAY_PTR(v);
+    *x = mrb_as_float(mrb, p[0]);
+    *y = mrb_as_float(mrb, p[1]);
+    *zoom = RARRAY_LEN(v) == 3 ? mrb_as_float(mrb, p[2]) : 1.0;
+    return;
+  }
+
+  *x = qtr_extract_flt_property(mrb, v, val$sym$x);
+  *y = qtr_extract_flt_property(mrb, v, val$sym$y);
+  *zoom = qtr_extract_flt_property_or(mrb, v, val$sym$zoom, 1.0, -1);
+}
+
+mrb_value qtr_r_cull_and_project(mrb_state *mrb, mrb_value) {
+  mrb_value ary;
+  const mrb_sym kws[] = {sym$camera, sym$viewport, sym$indices};
+  static const uint32_t numks = sizeof(kws) / sizeof(*kws);
+  static const uint32_t reqks = 2;
+  mrb_value kwvals[sizeof(kws) / sizeof(*kws)];
+  const mrb_kwargs kwargs = {numks, reqks, kws, kwvals, NULL};
+
+  mrb_get_args(mrb, "A:", &ary, &kwargs);
+
+  mrb_float cam_x, cam_y, zoom;
+  qtr_camera_of_value(mrb, kwvals[0], &cam_x, &cam_y, &zoom);
+  const Box vp = qtr_rect_of_value(mrb, kwvals[1], -1);
+  const bool indices = !mrb_undef_p(kwvals[2]) && mrb_test(kwvals[2]);
+
+  mrb_value res = mrb_ary_new(mrb);
+  int ai = mrb_gc_arena_save(mrb);
+
+  for (mrb_int i = 0; i < RARRAY_LEN(ary); ++i) {
+    mrb_value hash = RARRAY_PTR(ary)[i];
+    Box box = qtr_box_of_hash_at(mrb, hash, i);
+
+    const mrb_float sx = (box.x - cam_x) * zoom;
+    const mrb_float sy = (box.y - cam_y) * zoom;
+    const mrb_float sw = box.w * zoom;
+    const mrb_float sh = box.h * zoom;
+
+    if (!(sx < vp.x + vp.w && vp.x < sx + sw && sy < vp.y + vp.h &&
+          vp.y < sy + sh))
+      continue;
+
+    if (indices) {
+      mrb_ary_push(mrb, res, mrb_int_value(mrb, i));
+      continue;
+    }
+
+    mrb_value out = mrb_hash_dup(mrb, hash);
+    mrb_hash_set(mrb, out, val$sym$x, mrb_float_value(mrb, sx));
+    mrb_hash_set(mrb, out, val$sym$y, mrb_float_value(mrb, sy));
+    mrb_hash_set(mrb, out, val$sym$w, mrb_float_value(mrb, sw));
+    mrb_hash_set(mrb, out, val$sym$h, mrb_float_value(mrb, sh));
+    mrb_hash_delete_key(mrb, out, val$sym$anchor_x);
+    mrb_hash_delete_key(mrb, out, val$sym$anchor_y);
+
+    mrb_ary_push(mrb, res, out);
+    mrb_gc_arena_restore(mrb, ai);
+  }
+
+  return res;
+}
+
+mrb_value qtr_r_shape_cache_set(mrb_state *mrb, mrb_value) {
+  mrb_bool enabled;
+  mrb_get_args(mrb, "b", &enabled);
+
+  qtr_shape_cache = enabled;
+  qtr_shape.len = 0;
+
+  return mrb_bool_value(enabled);
+}
+
+mrb_value qtr_r_shape_cache_p(mrb_state *, mrb_value) {
+  return mrb_bool_value(qtr_shape_cache);
+}
+
 void drb_register_c_extensions_with_api(mrb_state *mrb, void *) {
   sym$x = mrb_intern_lit(mrb, "x");
   val$sym$x = mrb_symbol_value(sym$x);
@@ -128,6 +1616,17 @@ void drb_register_c_extensions_with_api(mrb_state *mrb, void *) {
   val$sym$anchor_x = mrb_symbol_value(sym$anchor_x);
   sym$anchor_y = mrb_intern_lit(mrb, "anchor_y");
   val$sym$anchor_y = mrb_symbol_value(sym$anchor_y);
+  sym$angle = mrb_intern_lit(mrb, "angle");
+  val$sym$angle = mrb_symbol_value(sym$angle);
+  sym$angle_anchor_x = mrb_intern_lit(mrb, "angle_anchor_x");
+  val$sym$angle_anchor_x = mrb_symbol_value(sym$angle_anchor_x);
+  sym$angle_anchor_y = mrb_intern_lit(mrb, "angle_anchor_y");
+  val$sym$angle_anchor_y = mrb_symbol_value(sym$angle_anchor_y);
+  sym$zoom = mrb_intern_lit(mrb, "zoom");
+  val$sym$zoom = mrb_symbol_value(sym$zoom);
+  sym$camera = mrb_intern_lit(mrb, "camera");
+  sym$viewport = mrb_intern_lit(mrb, "viewport");
+  sym$indices = mrb_intern_lit(mrb, "indices");
 
 	struct RClass *hash = mrb->hash_class;
 	
@@ -140,4 +1639,96 @@ void drb_register_c_extensions_with_api(mrb_state *mrb, void *) {
 
 	mrb_define_method_id(mrb, hash, mrb_intern_lit(mrb, "scale!"), qtr_r_scale_hash_b, MRB_ARGS_REQ(1));
 	mrb_define_method_id(mrb, hash, mrb_intern_lit(mrb, "scale"), qtr_r_scale_hash, MRB_ARGS_REQ(1));
+
+  mrb_define_method_id(mrb, hash, mrb_intern_lit(mrb, "rotated_corners"),
+                       qtr_r_rotated_corners, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, hash, mrb_intern_lit(mrb, "rotated_bounds"),
+                       qtr_r_rotated_bounds, MRB_ARGS_NONE());
+
+	struct RClass *array = mrb->array_class;
+
+  mrb_define_method_id(mrb, array,
+                       mrb_intern_lit(mrb, "normalize_posdata!"),
+                       qtr_r_normalize_ary_b, MRB_ARGS_NONE());
+	mrb_define_method_id(mrb, array, mrb_intern_lit(mrb, "scale!"), qtr_r_scale_ary_b, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, array, mrb_intern_lit(mrb, "rotated_corners"),
+                       qtr_r_ary_rotated_corners, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, array, mrb_intern_lit(mrb, "rotated_bounds"),
+                       qtr_r_ary_rotated_bounds, MRB_ARGS_NONE());
+
+  struct RClass *boxbuf = mrb_define_class_id(
+      mrb, mrb_intern_lit(mrb, "BoxBuffer"), mrb->object_class);
+  MRB_SET_INSTANCE_TT(boxbuf, MRB_TT_DATA);
+
+  mrb_define_method_id(mrb, boxbuf, mrb_intern_lit(mrb, "initialize"),
+                       qtr_r_boxbuf_init, MRB_ARGS_OPT(1));
+  mrb_define_method_id(mrb, boxbuf, mrb_intern_lit(mrb, "load"),
+                       qtr_r_boxbuf_load, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, boxbuf, mrb_intern_lit(mrb, "size"),
+                       qtr_r_boxbuf_size, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, boxbuf, mrb_intern_lit(mrb, "translate!"),
+                       qtr_r_boxbuf_translate_b, MRB_ARGS_REQ(2));
+  mrb_define_method_id(mrb, boxbuf, mrb_intern_lit(mrb, "scale!"),
+                       qtr_r_boxbuf_scale_b, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, boxbuf, mrb_intern_lit(mrb, "normalize!"),
+                       qtr_r_boxbuf_normalize_b, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, boxbuf, mrb_intern_lit(mrb, "lerp_to!"),
+                       qtr_r_boxbuf_lerp_to_b, MRB_ARGS_REQ(2));
+  mrb_define_method_id(mrb, boxbuf, mrb_intern_lit(mrb, "write_back"),
+                       qtr_r_boxbuf_write_back, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, boxbuf, mrb_intern_lit(mrb, "to_primitives"),
+                       qtr_r_boxbuf_to_primitives, MRB_ARGS_NONE());
+
+  struct RClass *qtransforms =
+      mrb_define_module_id(mrb, mrb_intern_lit(mrb, "QTransforms"));
+
+  mrb_define_module_function_id(mrb, qtransforms,
+                                mrb_intern_lit(mrb, "cull_and_project"),
+                                qtr_r_cull_and_project,
+                                MRB_ARGS_REQ(1) | MRB_ARGS_KEY(2, 1));
+  mrb_define_module_function_id(mrb, qtransforms,
+                                mrb_intern_lit(mrb, "obb_overlap?"),
+                                qtr_r_obb_overlap_p, MRB_ARGS_REQ(2));
+  mrb_define_module_function_id(mrb, qtransforms,
+                                mrb_intern_lit(mrb, "shape_cache="),
+                                qtr_r_shape_cache_set, MRB_ARGS_REQ(1));
+  mrb_define_module_function_id(mrb, qtransforms,
+                                mrb_intern_lit(mrb, "shape_cache?"),
+                                qtr_r_shape_cache_p, MRB_ARGS_NONE());
+
+  struct RClass *spatial = mrb_define_class_id(
+      mrb, mrb_intern_lit(mrb, "SpatialIndex"), mrb->object_class);
+  MRB_SET_INSTANCE_TT(spatial, MRB_TT_DATA);
+
+  mrb_define_method_id(mrb, spatial, mrb_intern_lit(mrb, "build"),
+                       qtr_r_spatial_build, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, spatial, mrb_intern_lit(mrb, "update"),
+                       qtr_r_spatial_update, MRB_ARGS_REQ(2));
+  mrb_define_method_id(mrb, spatial, mrb_intern_lit(mrb, "remove"),
+                       qtr_r_spatial_remove, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, spatial, mrb_intern_lit(mrb, "query"),
+                       qtr_r_spatial_query, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, spatial,
+                       mrb_intern_lit(mrb, "each_overlapping_pair"),
+                       qtr_r_spatial_overlapping_pairs, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, spatial, mrb_intern_lit(mrb, "size"),
+                       qtr_r_spatial_size, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, spatial, mrb_intern_lit(mrb, "clear"),
+                       qtr_r_spatial_clear, MRB_ARGS_NONE());
+
+  struct RClass *spatial_grid = mrb_define_class_under_id(
+      mrb, spatial, mrb_intern_lit(mrb, "Grid"), spatial);
+  MRB_SET_INSTANCE_TT(spatial_grid, MRB_TT_DATA);
+  mrb_define_method_id(mrb, spatial_grid, mrb_intern_lit(mrb, "initialize"),
+                       qtr_r_spatial_grid_init, MRB_ARGS_REQ(1));
+
+  struct RClass *spatial_quadtree = mrb_define_class_under_id(
+      mrb, spatial, mrb_intern_lit(mrb, "Quadtree"), spatial);
+  MRB_SET_INSTANCE_TT(spatial_quadtree, MRB_TT_DATA);
+  mrb_define_method_id(mrb, spatial_quadtree,
+                       mrb_intern_lit(mrb, "initialize"),
+                       qtr_r_spatial_quadtree_init, MRB_ARGS_ARG(1, 1));
+
+  CEXT_STATS_INIT(mrb, "qtransforms");
+  cext_simd_init(mrb, "qtransforms", qtr_simd_select);
 }
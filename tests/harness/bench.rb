@@ -0,0 +1,77 @@
+# micro and macro benchmarks, one JSON line each
+
+Harness.bench('minheap.insert_pop', 100_000) do |n|
+  heap = MinHeap.new
+  n.times { |i| heap.insert((i * 7919) % n) }
+  n.times { heap.pop }
+end
+
+Harness.bench('xoroshiro.rand_float', 1_000_000) do |n|
+  rng = Xoroshiro128.new(1)
+  n.times { rng.rand }
+end
+
+Harness.bench('xoroshiro.rand_int', 1_000_000) do |n|
+  rng = Xoroshiro128.new(1)
+  n.times { rng.rand(100) }
+end
+
+Harness.bench('counter_rand.fill_at', 1_000_000) do |n|
+  CounterRand.new(1).fill_at(0, n, 256)
+end
+
+Harness.bench('pnoise.cells_cold', 256 * 256) do
+  noise = Noise::PerlinNoise.new(width: 256, height: 256, octaves: 4, seed: 1)
+  256.times { |y| 256.times { |x| noise[x, y] } }
+end
+
+Harness.bench('pnoise.rows_cold', 256 * 256) do
+  noise = Noise::PerlinNoise.new(width: 256, height: 256, octaves: 4, seed: 1)
+  256.times { |y| noise.row(y) }
+end
+
+cached = Noise::PerlinNoise.new(width: 256, height: 256, octaves: 4, seed: 1)
+Harness.bench('pnoise.cells_cached', 256 * 256) do
+  256.times { |y| 256.times { |x| cached[x, y] } }
+end
+
+Harness.bench('pnoise.poisson_disk', 1) do
+  Noise.poisson_disk(width: 1000, height: 1000, radius: 5, seed: 1)
+end
+
+Harness.bench('pnoise.cave_512', 1) do
+  Noise.cave(width: 512, height: 512, steps: 5, seed: 1)
+end
+
+primitives = Array.new(20_000) do |i|
+  { x: i, y: i * 2, w: 10, h: 20, anchor_x: 0.5, anchor_y: 1 }
+end
+
+Harness.bench('qtransforms.normalize_posdata', primitives.size) do
+  primitives.map(&:normalize_posdata)
+end
+
+[false, true].each do |enabled|
+  QTransforms.shape_cache = enabled
+  loader = BoxBuffer.new
+  Harness.bench("qtransforms.boxbuffer_load#{enabled ? '' : '_uncached'}", primitives.size) do
+    loader.load primitives
+  end
+end
+
+buffer = BoxBuffer.new(primitives)
+Harness.bench('qtransforms.boxbuffer_translate', primitives.size) do
+  buffer.translate!(1, 1)
+end
+
+index = SpatialIndex::Grid.new(64)
+index.build(primitives)
+Harness.bench('qtransforms.spatial_query', 10_000) do |n|
+  n.times { |i| index.query([i, i * 2, 32, 32]) }
+end
+
+path = '/tmp/harness_bench.ppm'
+Harness.write_file(path, "P6\n512 512\n255\n" + [17, 34, 51].map(&:chr).join * (512 * 512))
+Harness.bench('getcolor.region', 512 * 512) do
+  ColorPicker.region(path, 0, 0, 512, 512, as: :ints)
+end
@@ -0,0 +1,86 @@
+def test_bitgrid_set_get_popcount(_args, assert)
+  grid = BitGrid.new(130, 5)
+  grid.set(0, 0)
+  grid.set(129, 4)
+  grid[64, 2] = true
+
+  assert.true! grid[129, 4]
+  assert.false! grid[128, 4]
+  assert.false! grid[-1, 0]
+  assert.equal! grid.popcount, 3
+end
+
+def test_bitgrid_fill_rect_clips(_args, assert)
+  grid = BitGrid.new(10, 10)
+  grid.fill_rect(-5, 8, 10, 10)
+
+  assert.equal! grid.popcount, 5 * 2
+end
+
+def test_bitgrid_dilate_erode(_args, assert)
+  grid = BitGrid.new(20, 20)
+  grid.set(10, 10)
+
+  dilated = grid.dilate
+  assert.equal! dilated.popcount, 9
+  assert.equal! dilated.erode, grid
+end
+
+def test_bitgrid_ops_and_each_set_bit(_args, assert)
+  a = BitGrid.new(70, 2)
+  b = BitGrid.new(70, 2)
+  a.set(1, 0)
+  a.set(69, 1)
+  b.set(69, 1)
+
+  assert.equal! (a & b).each_set_bit, [69, 1]
+  assert.equal! (a ^ b).each_set_bit, [1, 0]
+  assert.equal! (~a).popcount, 140 - 2
+  assert.equal! a.shift(1, 0).each_set_bit, [2, 0]
+end
+
+def test_bitset_basics(_args, assert)
+  set = BitSet.new(100)
+  set.fill_range(10, 5)
+
+  assert.equal! set.popcount, 5
+  assert.equal! set.shift(-10).each_set_bit, [0, 1, 2, 3, 4]
+  assert.equal! set.dilate.popcount, 7
+end
+
+def test_bitgrid_fill_rect_huge_extents(_args, assert)
+  grid = BitGrid.new(10, 3)
+  grid.fill_rect(1, 0, 0x7fff_ffff_ffff_ffff, 1)
+  grid.fill_rect(-(2**62), 2, 2**62 + 2, 0x7fff_ffff_ffff_ffff)
+
+  assert.equal! grid.popcount, 9 + 2
+end
+
+def test_bitset_shift_takes_one_argument(_args, assert)
+  set = BitSet.new(10)
+  set.set(3)
+
+  raised = begin
+    set.shift(1, 1)
+    false
+  rescue ArgumentError
+    true
+  end
+
+  assert.true! raised
+  assert.equal! set.shift(2).each_set_bit, [5]
+end
+
+def test_bitgrid_each_set_bit_stops_when_resized(_args, assert)
+  grid = BitGrid.new(70, 2)
+  grid.fill
+  seen = []
+
+  grid.each_set_bit do |x, y|
+    seen << [x, y]
+    grid.send(:initialize, 3, 1) if seen.size == 2
+  end
+
+  assert.equal! seen, [[0, 0], [1, 0]]
+  assert.equal! [grid.width, grid.height], [3, 1]
+end
@@ -0,0 +1,46 @@
+STAT_FIELDS = %i[calls hits misses comparisons bytes ns].freeze
+
+def test_cext_stats_disabled_is_empty(_args, assert)
+  return if CExtStats.enabled?
+
+  assert.equal! CExtStats.snapshot, {}
+  assert.equal! CExtStats.reset, nil
+end
+
+def test_cext_stats_counts_hot_paths(_args, assert)
+  return unless CExtStats.enabled?
+
+  CExtStats.reset
+  heap = MinHeap.new(5, 3, 8, 1)
+  4.times { heap.pop }
+
+  noise = Noise::PerlinNoise.new(width: 8, height: 8, seed: 1)
+  noise[1, 1]
+  noise[1, 1]
+
+  QTransforms.shape_cache = true
+  { x: 1, y: 2, w: 3, h: 4 }.normalize_posdata
+  { x: 5, y: 6, w: 7, h: 8 }.normalize_posdata
+
+  stats = CExtStats.snapshot
+  assert.equal! stats['minheap.pop'].keys, STAT_FIELDS
+  assert.equal! stats['minheap.insert'][:calls], 4
+  assert.equal! stats['minheap.pop'][:calls], 4
+  assert.true! stats['minheap.pop'][:comparisons] > 0
+  assert.true! stats['minheap.alloc'][:bytes] > 0
+  assert.equal! stats['pnoise.cell'][:hits], 1
+  assert.equal! stats['pnoise.cell'][:misses], 1
+  assert.true! stats['qtransforms.box_of_hash'][:calls] >= 2
+  assert.true! stats['qtransforms.shape_cache'][:hits] >= 1
+end
+
+def test_cext_stats_reset_zeroes_counters(_args, assert)
+  return unless CExtStats.enabled?
+
+  MinHeap.new(1, 2).pop
+  CExtStats.reset
+
+  CExtStats.snapshot.each_value do |site|
+    assert.equal! site.values.uniq, [0]
+  end
+end
@@ -0,0 +1,136 @@
+# a 3x2 binary PPM, rows top to bottom: red green blue / white black grey
+FIXTURE = '/tmp/harness_getcolor.ppm'
+Harness.write_file(FIXTURE, "P6\n3 2\n255\n" + [255, 0, 0, 0, 255, 0, 0, 0, 255,
+                                                255, 255, 255, 0, 0, 0, 128, 128, 128].map(&:chr).join)
+
+def test_getcolor_pixel_counts_rows_from_the_bottom(_args, assert)
+  assert.equal! ColorPicker.pixel(FIXTURE, 0, 1), { r: 255, g: 0, b: 0, a: 255 }
+  assert.equal! ColorPicker.pixel(FIXTURE, 2, 0), { r: 128, g: 128, b: 128, a: 255 }
+end
+
+def test_getcolor_image_handle(_args, assert)
+  image = ColorPicker::Image.new(FIXTURE)
+
+  assert.equal! [image.width, image.height], [3, 2]
+  assert.equal! image.pixel(1, 1), ColorPicker.pixel(FIXTURE, 1, 1)
+end
+
+def test_getcolor_histogram_and_find_color(_args, assert)
+  histogram = ColorPicker.histogram(FIXTURE)
+
+  assert.equal! histogram.size, 6
+  assert.equal! histogram.values.inject(:+), 6
+  assert.equal! ColorPicker.find_color(FIXTURE, [0, 0, 255]), [2, 1]
+end
+
+def test_getcolor_out_of_bounds_raises(_args, assert)
+  raised = begin
+    ColorPicker.pixel(FIXTURE, 3, 0)
+    false
+  rescue ArgumentError
+    true
+  end
+
+  assert.true! raised
+end
+
+def test_getcolor_to_grid_maps_palette_colors(_args, assert)
+  palette = { [255, 0, 0] => 1, [0, 0, 0] => 2 }
+
+  assert.equal! ColorPicker.to_grid(FIXTURE, palette: palette).bytes, [0, 2, 0, 1, 0, 0]
+  assert.equal! ColorPicker.to_grid(FIXTURE, palette: palette, default: 7, as: :ints), [7, 2, 7, 1, 7, 7]
+end
+
+def test_getcolor_to_grid_rejects_bad_arguments(_args, assert)
+  bad_format = begin
+    ColorPicker.to_grid(FIXTURE, palette: {}, as: :bytes)
+    false
+  rescue ArgumentError
+    true
+  end
+  bad_key = begin
+    ColorPicker.to_grid(FIXTURE, palette: { 'red' => 1 })
+    false
+  rescue ArgumentError
+    true
+  end
+
+  assert.true! bad_format
+  assert.true! bad_key
+end
+
+def test_getcolor_to_grid_rejects_out_of_range_integer_keys(_args, assert)
+  [-1, 0x1_0000_0000].each do |key|
+    raised = begin
+      ColorPicker.to_grid(FIXTURE, palette: { key => 1 })
+      false
+    rescue ArgumentError
+      true
+    end
+    assert.true! raised, key.inspect
+  end
+
+  assert.equal! ColorPicker.to_grid(FIXTURE, palette: { 0xffffffff => 1 }).bytes.size, 6
+end
+
+def test_getcolor_to_mask_sets_opaque_pixels(_args, assert)
+  assert.equal! ColorPicker.to_mask(FIXTURE), "\x3f"
+  assert.equal! ColorPicker::Image.new(FIXTURE).to_mask(threshold: 255), "\x3f"
+end
+
+def test_getcolor_dominant_colors(_args, assert)
+  image = ColorPicker::Image.new(FIXTURE)
+
+  assert.equal! ColorPicker.dominant_colors(FIXTURE, 6).sort, ColorPicker.histogram(FIXTURE).keys.sort
+  assert.equal! image.dominant_colors(10).size, 6
+  # every channel averages to (255 + 255 + 128) / 6, rounded
+  assert.equal! image.dominant_colors(1), [0xff6a6a6a]
+end
+
+def test_getcolor_dominant_colors_rejects_non_positive_counts(_args, assert)
+  raised = begin
+    ColorPicker.dominant_colors(FIXTURE, 0)
+    false
+  rescue ArgumentError
+    true
+  end
+
+  assert.true! raised
+end
+
+def getcolor_preload_fixture(name)
+  path = "/tmp/harness_getcolor_#{name}.ppm"
+  Harness.write_file(path, "P6\n1 1\n255\n" + [1, 2, 3].map(&:chr).join)
+  path
+end
+
+def test_getcolor_preload_calls_every_block_for_a_path(_args, assert)
+  path = getcolor_preload_fixture('preload')
+  calls = []
+
+  ColorPicker.preload(path) { |p, ok| calls << [:first, p, ok] }
+  ColorPicker.preload(path) { |p, ok| calls << [:second, p, ok] }
+  ColorPicker.await(path)
+  ColorPicker.poll
+
+  assert.equal! calls, [[:first, path, true], [:second, path, true]]
+end
+
+def test_getcolor_poll_keeps_callbacks_after_a_raise(_args, assert)
+  path = getcolor_preload_fixture('preload_raise')
+  calls = []
+
+  ColorPicker.preload(path) { |_p, _ok| raise 'boom' }
+  ColorPicker.preload(path) { |p, ok| calls << [p, ok] }
+  ColorPicker.await(path)
+  raised = begin
+    ColorPicker.poll
+    false
+  rescue RuntimeError
+    true
+  end
+  ColorPicker.poll
+
+  assert.true! raised
+  assert.equal! calls, [[path, true]]
+end
@@ -0,0 +1,143 @@
+/* loads extensions into a stock mruby and runs scripts against them:
+ *
+ *   harness prelude.rb -l build/libminheap.so tests.rb ...
+ *
+ * arguments run in order, -l registers a shared library through its
+ * drb_register_c_extensions_with_api with the stand-in api below. once every
+ * script ran, Harness.finish decides the exit status */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dragonruby.h>
+#include <mruby/compile.h>
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_FAILURE_USERMSG
+#include <stb_image.h>
+
+/* DragonRuby hands out RGBA rows top to bottom, as stb_image does */
+static void *harness_load_image(const char *fname, int *w, int *h) {
+  int comp;
+  return stbi_load(fname, w, h, &comp, 4);
+}
+
+static void harness_free_image(void *pixels) { stbi_image_free(pixels); }
+
+static struct drb_api_t harness_api = {
+    .drb_load_image = harness_load_image,
+    .drb_free_image = harness_free_image,
+};
+
+static mrb_value harness_clock_ns(mrb_state *mrb, mrb_value _) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return mrb_int_value(mrb, (mrb_int)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/* mruby has no File without mruby-io, tests write their fixtures here */
+static mrb_value harness_write_file(mrb_state *mrb, mrb_value _) {
+  char *path;
+  mrb_value data;
+  mrb_get_args(mrb, "zS", &path, &data);
+
+  FILE *f = fopen(path, "wb");
+  if (f == nullptr ||
+      fwrite(RSTRING_PTR(data), 1, RSTRING_LEN(data), f) !=
+          (size_t)RSTRING_LEN(data)) {
+    if (f)
+      fclose(f);
+    mrb_raisef(mrb, E_RUNTIME_ERROR, "couldn't write %s", path);
+  }
+
+  fclose(f);
+  return mrb_nil_value();
+}
+
+static int harness_load_lib(mrb_state *mrb, const char *path) {
+  void *lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (lib == nullptr) {
+    fprintf(stderr, "harness: %s\n", dlerror());
+    return 1;
+  }
+
+  void (*reg)(mrb_state *, struct drb_api_t *) =
+      (void (*)(mrb_state *, struct drb_api_t *))dlsym(
+          lib, "drb_register_c_extensions_with_api");
+  if (reg == nullptr) {
+    fprintf(stderr, "harness: %s has no drb_register_c_extensions_with_api\n",
+            path);
+    return 1;
+  }
+
+  reg(mrb, &harness_api);
+  if (mrb->exc) {
+    mrb_print_error(mrb);
+    return 1;
+  }
+
+  return 0;
+}
+
+static int harness_run_script(mrb_state *mrb, const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == nullptr) {
+    fprintf(stderr, "harness: couldn't open %s\n", path);
+    return 1;
+  }
+
+  mrbc_context *cxt = mrbc_context_new(mrb);
+  mrbc_filename(mrb, cxt, path);
+  mrb_load_file_cxt(mrb, f, cxt);
+  mrbc_context_free(mrb, cxt);
+  fclose(f);
+
+  if (mrb->exc) {
+    mrb_print_error(mrb);
+    return 1;
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  mrb_state *mrb = mrb_open();
+  if (mrb == nullptr) {
+    fprintf(stderr, "harness: couldn't open mruby\n");
+    return 1;
+  }
+
+  struct RClass *harness = mrb_define_module(mrb, "Harness");
+  mrb_define_module_function(mrb, harness, "clock_ns", harness_clock_ns,
+                             MRB_ARGS_NONE());
+  mrb_define_module_function(mrb, harness, "write_file", harness_write_file,
+                             MRB_ARGS_REQ(2));
+
+  int status = 0;
+  for (int i = 1; i < argc && status == 0; ++i) {
+    if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+      status = harness_load_lib(mrb, argv[++i]);
+    else
+      status = harness_run_script(mrb, argv[i]);
+  }
+
+  if (status == 0 &&
+      mrb_respond_to(mrb, mrb_obj_value(harness), mrb_intern_lit(mrb, "finish"))) {
+    mrb_value failed =
+        mrb_funcall(mrb, mrb_obj_value(harness), "finish", 0);
+    if (mrb->exc) {
+      mrb_print_error(mrb);
+      status = 1;
+    } else if (mrb_integer_p(failed) && mrb_integer(failed) > 0) {
+      status = 1;
+    }
+  }
+
+  mrb_close(mrb);
+  return status;
+}
@@ -0,0 +1,20 @@
+#ifndef HARNESS_DRAGONRUBY_H
+#define HARNESS_DRAGONRUBY_H
+
+/* stand-in for DragonRuby's header: the mruby headers the extensions expect
+ * plus the part of drb_api_t they use */
+
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/class.h>
+#include <mruby/data.h>
+#include <mruby/hash.h>
+#include <mruby/string.h>
+#include <mruby/variable.h>
+
+struct drb_api_t {
+  void *(*drb_load_image)(const char *fname, int *w, int *h);
+  void (*drb_free_image)(void *pixels);
+};
+
+#endif
@@ -0,0 +1,99 @@
+def test_perlin_seed_is_reproducible(_args, assert)
+  a = Noise::PerlinNoise.new(width: 32, height: 32, octaves: 3, seed: 11)
+  b = Noise::PerlinNoise.new(width: 32, height: 32, octaves: 3, seed: 11)
+
+  32.times do |y|
+    32.times do |x|
+      assert.equal! a[x, y], b[x, y]
+      assert.true! a[x, y] >= 0 && a[x, y] <= 1
+    end
+  end
+end
+
+def test_perlin_accepts_xoroshiro(_args, assert)
+  noise = Noise::PerlinNoise.new(width: 16, height: 16, rand: Xoroshiro128.new(2))
+
+  assert.true! noise[3, 4].is_a?(Float)
+end
+
+def test_poisson_disk_keeps_its_distance(_args, assert)
+  pts = Noise.poisson_disk(width: 120, height: 80, radius: 6, seed: 1)
+
+  assert.equal! pts.size.even?, true
+  assert.true! pts.size > 20
+
+  points = pts.each_slice(2).to_a
+  points.each_with_index do |(x, y), i|
+    assert.true! x >= 0 && x < 120 && y >= 0 && y < 80
+    points[(i + 1)..-1].each do |(x2, y2)|
+      assert.true! (x - x2)**2 + (y - y2)**2 >= 36 - 1e-9
+    end
+  end
+
+  assert.equal! Noise.poisson_disk(width: 120, height: 80, radius: 6, seed: 1), pts
+end
+
+def test_poisson_disk_fills_areas_off_the_cell_grid(_args, assert)
+  # neither side is a whole number of grid cells
+  pts = Noise.poisson_disk(width: 9.9, height: 7.3, radius: 0.7, seed: 3)
+
+  assert.true! pts.size > 40
+  pts.each_slice(2) { |(x, y)| assert.true! x >= 0 && x < 9.9 && y >= 0 && y < 7.3 }
+end
+
+def test_cave_is_deterministic(_args, assert)
+  a = Noise.cave(width: 64, height: 48, seed: 9)
+  b = Noise.cave(width: 64, height: 48, seed: 9)
+
+  assert.equal! a.bytesize, 64 * 48
+  assert.equal! a, b
+  assert.true! a.bytes.all? { |c| c == 0 || c == 1 }
+end
+
+def test_cave_keep_largest_leaves_one_region(_args, assert)
+  grid = Noise.cave(width: 64, height: 48, seed: 9, keep_largest: true)
+  _labels, sizes = Noise.cave_regions(grid, 64)
+
+  assert.true! sizes.size <= 1
+end
+
+def test_perlin_rejects_bad_rand(_args, assert)
+  ['x', 1.5, Object.new].each do |rand|
+    raised = begin
+      Noise::PerlinNoise.new(width: 8, height: 8, rand: rand)
+      false
+    rescue TypeError
+      true
+    end
+    assert.true! raised, rand.inspect
+  end
+
+  seeded = Noise::PerlinNoise.new(width: 8, height: 8, rand: 3)
+  assert.equal! seeded[1, 2], Noise::PerlinNoise.new(width: 8, height: 8, seed: 3)[1, 2]
+end
+
+def test_cave_from_noise_rejects_a_seed(_args, assert)
+  noise = Noise::PerlinNoise.new(width: 32, height: 32, seed: 4)
+  grid = Noise.cave(width: 40, height: 30, noise: noise)
+
+  assert.equal! grid.bytesize, 40 * 30
+  assert.equal! Noise.cave(width: 40, height: 30, noise: noise), grid
+
+  [{ seed: 1 }, { rand: 1 }].each do |extra|
+    raised = begin
+      Noise.cave(width: 40, height: 30, noise: noise, **extra)
+      false
+    rescue ArgumentError
+      true
+    end
+    assert.true! raised, extra.inspect
+  end
+end
+
+def test_cave_birth_only_applies_to_floor(_args, assert)
+  # every cell starts as a wall with 8 wall neighbours: below survive, so
+  # one step clears them all even though 8 >= birth
+  grid = Noise.cave(width: 5, height: 4, fill: 1.0, steps: 1, birth: 2, survive: 9, seed: 1)
+
+  assert.equal! grid, "\0" * 20
+end
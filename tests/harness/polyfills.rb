@@ -0,0 +1,60 @@
+def test_integer_aref_wide_span(_args, assert)
+  value = 0x7f_ffff_ffff
+
+  assert.equal! value[0, 40], 0x7f_ffff_ffff
+  assert.equal! value[8..39], 0x7fff_ffff
+  assert.equal! 0b1010[1, 1], 1
+end
+
+def test_bit_layout_round_trip(_args, assert)
+  layout = BitLayout.new(flags: 0..3, kind: 4..9, hp: 10..19)
+  record = { flags: 5, kind: 33, hp: 1000 }
+
+  packed = layout.pack(record)
+  assert.equal! packed, 5 | (33 << 4) | (1000 << 10)
+  assert.equal! layout.unpack(packed), record
+  assert.equal! layout.fields, %i[flags kind hp]
+end
+
+def test_bit_layout_columns(_args, assert)
+  layout = BitLayout.new(a: 0..7, b: 8..15)
+  packed = layout.pack_all({ a: [1, 2, 3], b: [4, 5, 6] })
+
+  assert.equal! packed, [0x401, 0x502, 0x603]
+  assert.equal! layout.unpack_all(packed), { a: [1, 2, 3], b: [4, 5, 6] }
+end
+
+def test_bit_layout_rejects_wide_values(_args, assert)
+  layout = BitLayout.new(a: 0..3)
+  raised = begin
+    layout.pack({ a: 16 })
+    false
+  rescue ArgumentError
+    true
+  end
+
+  assert.true! raised
+end
+
+def test_integer_aref_out_of_range_bits(_args, assert)
+  assert.equal! 1[70, 1], 0
+  assert.equal! -1[70, 3], 0b111
+  assert.equal! 1[60, 10], 0
+  assert.equal! 0x4000_0000_0000_0000[60, 10], 0b100
+  assert.equal! 0b1010[-1, 3], 0b100
+  assert.equal! 0b1010[2..], 0b10
+end
+
+def test_bit_layout_rejects_ranges_past_bit_63(_args, assert)
+  [0..0x7fff_ffff_ffff_ffff, 60..64, 64..64, -1..3].each do |bits|
+    raised = begin
+      BitLayout.new(a: bits)
+      false
+    rescue ArgumentError
+      true
+    end
+    assert.true! raised, bits.inspect
+  end
+
+  assert.equal! BitLayout.new(top: 62..63).pack({ top: 1 }), 0x4000_0000_0000_0000
+end
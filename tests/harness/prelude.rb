@@ -0,0 +1,93 @@
+# DragonRuby-style test runner and a benchmark helper for the harness.
+# Tests are top-level `test_*(args, assert)` methods, as in tests/minheap.
+
+class Random
+  DEFAULT = Random.new unless const_defined?(:DEFAULT)
+end
+
+module Harness
+  class AssertionFailed < StandardError; end
+
+  class Assert
+    def ok!
+      true
+    end
+
+    def true!(value, message = nil)
+      raise AssertionFailed, message || "expected #{value.inspect} to be truthy" unless value
+    end
+
+    def false!(value, message = nil)
+      raise AssertionFailed, message || "expected #{value.inspect} to be falsey" if value
+    end
+
+    def equal!(actual, expected, message = nil)
+      return if actual == expected
+
+      raise AssertionFailed, message || "expected #{expected.inspect}, got #{actual.inspect}"
+    end
+
+    def not_equal!(actual, expected, message = nil)
+      return unless actual == expected
+
+      raise AssertionFailed, message || "expected anything but #{expected.inspect}"
+    end
+  end
+
+  def self.json(value)
+    case value
+    when String then value.inspect
+    when Hash then "{#{value.map { |k, v| "#{json(k.to_s)}:#{json(v)}" }.join(',')}}"
+    when nil then 'null'
+    else value.to_s
+    end
+  end
+
+  def self.report(record)
+    puts json(record)
+  end
+
+  def self.test_names
+    names = Object.new.methods
+    names += Object.new.private_methods if Object.new.respond_to?(:private_methods, true)
+    names.map(&:to_s).select { |name| name.start_with?('test_') }.uniq.sort
+  end
+
+  # runs every test_ method defined so far, once per script
+  def self.run_tests
+    @ran ||= []
+    @failed ||= 0
+    names = test_names - @ran
+    @ran += names
+
+    names.each do |name|
+      begin
+        send(name, nil, Assert.new)
+        report({ test: name, status: 'pass' })
+      rescue Exception => e
+        @failed += 1
+        report({ test: name, status: 'fail', error: e.class.to_s, message: e.message })
+      end
+    end
+  end
+
+  # best of `repeat` runs of a block doing `n` operations
+  def self.bench(name, n, repeat: 5)
+    best = nil
+    repeat.times do
+      start = clock_ns
+      yield n
+      elapsed = clock_ns - start
+      best = elapsed if best.nil? || elapsed < best
+    end
+
+    report({ bench: name, n: n, ns: best, ns_per_op: (best.to_f / n).round(3),
+             ops_per_sec: (n * 1_000_000_000.0 / best).round })
+  end
+
+  def self.finish
+    run_tests
+    report({ tests: @ran.size, failed: @failed })
+    @failed
+  end
+end
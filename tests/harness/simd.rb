@@ -0,0 +1,90 @@
+# runs every kernel under each isa the cpu supports and checks the results
+# against the scalar path. sizes are picked to leave vector tails.
+SIMD_FIXTURE = '/tmp/harness_simd.ppm'
+SIMD_W = 37
+SIMD_H = 5
+Harness.write_file(SIMD_FIXTURE, "P6\n#{SIMD_W} #{SIMD_H}\n255\n" +
+  Array.new(SIMD_W * SIMD_H) { |i| i % 3 == 0 || i % 7 == 0 ? [0, 0, 255] : [i % 256, 9, 9] }
+    .flatten.map(&:chr).join)
+
+def simd_kernel_results
+  noise = Noise::PerlinNoise.new(width: 67, height: 9, octaves: 3, seed: 5)
+  rows = Array.new(9) { |y| noise.row(y) }
+
+  buffer = BoxBuffer.new(Array.new(13) { |i| { x: i * 1.5, y: i, w: 3 + i, h: 2, anchor_x: 0.5, anchor_y: 0.25 } })
+  target = BoxBuffer.new(Array.new(13) { |i| { x: -i, y: i * 2.5, w: 1, h: i } })
+  buffer.translate!(1.25, -3.5)
+  buffer.scale!(0.75)
+  buffer.normalize!
+  buffer.lerp_to!(target, 0.3)
+
+  {
+    rows: rows,
+    boxes: buffer.to_primitives,
+    matches: ColorPicker.find_color(SIMD_FIXTURE, [0, 0, 255]),
+    histogram: ColorPicker.histogram(SIMD_FIXTURE),
+    bits: CounterRand.new(77).fill_at(3, 41, 1 << 40)
+  }
+end
+
+def simd_each_isa
+  previous = CExtSimd.isa
+  CExtSimd.supported.each do |isa|
+    CExtSimd.isa = isa
+    yield isa
+  end
+ensure
+  CExtSimd.isa = previous
+end
+
+def test_simd_supported_starts_with_scalar(_args, assert)
+  assert.equal! CExtSimd.supported.first, :scalar
+  assert.true! CExtSimd.supported.include?(CExtSimd.isa)
+end
+
+def test_simd_paths_match_scalar(_args, assert)
+  expected = nil
+
+  simd_each_isa do |isa|
+    results = simd_kernel_results
+    expected ||= results
+    assert.equal! results, expected, "#{isa} differs from scalar"
+  end
+end
+
+def test_simd_noise_rows_match_cells(_args, assert)
+  simd_each_isa do |isa|
+    rows = Noise::PerlinNoise.new(width: 19, height: 4, octaves: 2, seed: 8)
+    cells = Noise::PerlinNoise.new(width: 19, height: 4, octaves: 2, seed: 8)
+
+    4.times do |y|
+      assert.equal! rows.row(y), Array.new(19) { |x| cells[x, y] }, "#{isa} row #{y}"
+    end
+  end
+end
+
+def test_simd_find_color_positions(_args, assert)
+  expected = []
+  SIMD_H.times do |row|
+    SIMD_W.times do |x|
+      i = row * SIMD_W + x
+      expected << [x, SIMD_H - row - 1] if i % 3 == 0 || i % 7 == 0
+    end
+  end
+  expected = expected.sort_by { |x, y| [y, x] }.flatten
+
+  simd_each_isa do |isa|
+    assert.equal! ColorPicker.find_color(SIMD_FIXTURE, [0, 0, 255]), expected, isa.to_s
+  end
+end
+
+def test_simd_rejects_unsupported_isa(_args, assert)
+  raised = begin
+    CExtSimd.isa = :neon
+    false
+  rescue ArgumentError
+    true
+  end
+
+  assert.true! raised
+end
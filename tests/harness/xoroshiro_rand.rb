@@ -0,0 +1,110 @@
+def test_xoroshiro_seeded_sequences_repeat(_args, assert)
+  a = Xoroshiro128.new(1234)
+  b = Xoroshiro128.new(1234)
+
+  assert.equal! Array.new(16) { a.rand(1000) }, Array.new(16) { b.rand(1000) }
+end
+
+def test_xoroshiro_rand_bounds(_args, assert)
+  rng = Xoroshiro128.new(7)
+
+  1000.times do
+    assert.true! (0...10).include?(rng.rand(10))
+    assert.true! (1..6).include?(rng.rand(1..6))
+    f = rng.rand
+    assert.true! f >= 0 && f < 1
+  end
+end
+
+def test_xoroshiro_shuffle_and_sample(_args, assert)
+  rng = Xoroshiro128.new(99)
+  ary = (1..50).to_a
+
+  assert.equal! rng.shuffle!(ary.dup).sort, ary
+
+  picked = rng.sample(ary, 20)
+  assert.equal! picked.size, 20
+  assert.equal! picked.uniq.size, 20
+  assert.true! picked.all? { |v| ary.include?(v) }
+end
+
+def test_xoroshiro_alias_table_zero_weights(_args, assert)
+  table = Xoroshiro128::AliasTable.new([0, 1, 0])
+  rng = Xoroshiro128.new(5)
+
+  assert.equal! Array.new(100) { table.sample(rng) }.uniq, [1]
+end
+
+def test_xoroshiro_streams_snapshot_restore(_args, assert)
+  streams = Xoroshiro128::Streams.new(42, 4)
+  snapshot = streams.snapshot
+  first = Array.new(8) { |i| streams.rand(i % 4, 100) }
+
+  streams.restore(snapshot)
+  assert.equal! Array.new(8) { |i| streams.rand(i % 4, 100) }, first
+end
+
+def test_counter_rand_is_stateless(_args, assert)
+  rng = CounterRand.new(3)
+
+  assert.equal! rng.at(10), rng.at(10)
+  assert.equal! rng.at2(4, 5, 16), rng.at2(4, 5, 16)
+  assert.true! rng.fill_at(0, 100, 8).all? { |v| v >= 0 && v < 8 }
+end
+
+def test_xoroshiro_normal_moments(_args, assert)
+  rng = Xoroshiro128.new(11)
+  n = 20_000
+  xs = Array.new(n) { rng.normal }
+  mean = xs.inject(0.0) { |a, x| a + x } / n
+  var = xs.inject(0.0) { |a, x| a + (x - mean)**2 } / n
+
+  assert.true! mean.abs < 0.05, "mean #{mean}"
+  assert.true! (var - 1).abs < 0.05, "variance #{var}"
+  assert.true! xs.count { |x| x.abs > 3.0 }.between?(20, 90)
+
+  shifted = Xoroshiro128.new(11)
+  assert.equal! shifted.normal(10, 2), 10 + 2 * xs[0]
+end
+
+def test_xoroshiro_exponential_moments(_args, assert)
+  rng = Xoroshiro128.new(12)
+  n = 20_000
+  xs = Array.new(n) { rng.exponential }
+  mean = xs.inject(0.0) { |a, x| a + x } / n
+
+  assert.true! xs.all? { |x| x >= 0 }
+  assert.true! (mean - 1).abs < 0.05, "mean #{mean}"
+  assert.true! xs.count { |x| x > 7.697 }.between?(1, 30)
+  fast = Array.new(n) { rng.exponential(4) }.inject(0.0) { |a, x| a + x } / n
+  assert.true! (fast - 0.25).abs < 0.02, "mean #{fast}"
+end
+
+def test_xoroshiro_sample_small_k(_args, assert)
+  rng = Xoroshiro128.new(4)
+  ary = (1..1000).to_a
+
+  50.times do
+    picked = rng.sample(ary, 10)
+    assert.equal! picked.size, 10
+    assert.equal! picked.uniq.size, 10
+    assert.true! picked.all? { |v| v >= 1 && v <= 1000 }
+  end
+
+  assert.equal! rng.sample([1, 2, 3], 10).sort, [1, 2, 3]
+  assert.equal! rng.sample([], 2), []
+end
+
+def test_xoroshiro_streams_rejects_bad_counts(_args, assert)
+  [0, -1, 1 << 62].each do |count|
+    raised = begin
+      Xoroshiro128::Streams.new(1, count)
+      false
+    rescue ArgumentError
+      true
+    end
+    assert.true! raised, count.to_s
+  end
+
+  assert.equal! Xoroshiro128::Streams.new(1, 3).size, 3
+end
@@ -23,6 +23,63 @@ def test_minheap_custom_objects(_args, assert)
   assert.equal! heap.pop, [10, 'Bob']
 end
 
+def test_minheap_clear_keeps_capacity(_args, assert)
+  heap = MinHeap.new
+  100.times { |i| heap << (100 - i) }
+  capacity = heap.capacity
+
+  assert.equal! heap.clear, heap
+  assert.equal! heap.size, 0
+  assert.equal! heap.pop, nil
+  assert.equal! heap.capacity, capacity
+
+  heap << 3 << 1 << 2
+  assert.equal! heap.to_a.sort, [1, 2, 3]
+  assert.equal! heap.pop, 1
+end
+
+def test_minheap_reserve(_args, assert)
+  heap = MinHeap.new(5, 4)
+  assert.equal! heap.reserve(1000), heap
+  assert.true! heap.capacity >= 1000
+
+  capacity = heap.capacity
+  heap.reserve(10)
+  assert.equal! heap.capacity, capacity
+
+  998.times { |i| heap << i }
+  assert.equal! heap.capacity, capacity
+  assert.equal! heap.pop, 0
+  assert.equal! heap.pop, 1
+  assert.equal! heap.pop, 2
+
+  raised = begin
+    heap.reserve(-1)
+    false
+  rescue ArgumentError
+    true
+  end
+  assert.true! raised
+end
+
+def test_minheap_reuses_pooled_buffers(_args, assert)
+  before = CExtPool.stats['minheap']
+
+  # growing hands the smaller buffers back, the next heap picks them up
+  grown = MinHeap.new
+  64.times { |i| grown << i }
+  reused = MinHeap.new
+  32.times { |i| reused << i }
+
+  after = CExtPool.stats['minheap']
+  assert.true! after[:hits] >= before[:hits] + 2
+  assert.true! after[:hit_rate].between?(0.0, 1.0)
+  assert.equal! grown.size + reused.size, 96
+
+  assert.true! CExtPool.trim >= 0
+  assert.equal! CExtPool.stats['minheap'][:cached_bytes], 0
+end
+
 # This gives me some malloc errors - TODO Fix
 # def test_performance_test(_args, assert)
 #   puts 'Shuffling 100,000 numbers...'
@@ -0,0 +1 @@
+$gtk.ffi_misc.gtk_dlopen('libqtransforms')
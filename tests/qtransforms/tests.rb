@@ -0,0 +1,176 @@
+def make_primitives(count)
+  Array.new(count) do |i|
+    { x: i, y: i * 2, w: 10, h: 20, anchor_x: 0.5, anchor_y: 1, path: 'sprites/square.png' }
+  end
+end
+
+def test_shape_cache_matches_per_key_lookup(_args, assert)
+  primitives = make_primitives(64)
+  primitives << { path: 'sprites/square.png', h: 4, w: 8, y: 1, x: 2 }
+  primitives << { x: 1.5, y: 2.5 }
+
+  QTransforms.shape_cache = false
+  expected = primitives.map(&:normalize_posdata)
+
+  QTransforms.shape_cache = true
+  actual = primitives.map(&:normalize_posdata)
+
+  assert.equal! actual, expected
+end
+
+def test_shape_cache_reports_bad_values(_args, assert)
+  primitives = make_primitives(4)
+  primitives[2][:w] = 'wide'
+
+  message = begin
+    primitives.normalize_posdata!
+    nil
+  rescue TypeError => e
+    e.message
+  end
+
+  assert.true! message.include?('at index 2')
+end
+
+def test_boxbuffer_lerp_to_rejects_non_buffers(_args, assert)
+  buffer = BoxBuffer.new(make_primitives(2))
+
+  raised = begin
+    buffer.lerp_to!(make_primitives(2), 0.5)
+    false
+  rescue TypeError
+    true
+  end
+
+  assert.true! raised
+end
+
+def test_obb_overlap_with_zero_size_boxes(_args, assert)
+  box = { x: 0, y: 0, w: 10, h: 10, angle: 45 }
+
+  assert.true! QTransforms.obb_overlap?({ x: 5, y: 5, w: 0, h: 0 }, box)
+  assert.true! QTransforms.obb_overlap?(box, { x: 5, y: 2, w: 0, h: 6 })
+  assert.false! QTransforms.obb_overlap?({ x: 50, y: 5, w: 0, h: 0 }, box)
+end
+
+def test_boxbuffer_failed_load_leaves_it_empty(_args, assert)
+  buffer = BoxBuffer.new(make_primitives(3))
+  assert.equal! buffer.size, 3
+
+  bad = make_primitives(5)
+  bad[1][:x] = 'left'
+
+  [true, false].each do |cached|
+    QTransforms.shape_cache = cached
+    raised = begin
+      buffer.load bad
+      false
+    rescue TypeError
+      true
+    end
+
+    assert.true! raised
+    assert.equal! buffer.size, 0
+    assert.equal! buffer.to_primitives, []
+  end
+
+  QTransforms.shape_cache = true
+  buffer.load make_primitives(2)
+  assert.equal! buffer.to_primitives.map { |b| b[:y] }, [0, 2]
+end
+
+def spatial_brute_query(boxes, rect)
+  rx, ry, rw, rh = rect
+  boxes.each_with_index.select do |(x, y, w, h), _|
+    x < rx + rw && rx < x + w && y < ry + rh && ry < y + h
+  end.map { |_, i| i }
+end
+
+def test_spatial_indexes_match_brute_force(_args, assert)
+  [SpatialIndex::Grid.new(32), SpatialIndex::Quadtree.new(1024, 6)].each do |index|
+    boxes = Array.new(200) { [rand(1000), rand(1000), 1 + rand(80), 1 + rand(80)] }
+    index.build(boxes)
+    assert.equal! index.size, 200
+
+    # move every box a few times, so emptied buckets get dropped
+    3.times do
+      boxes.each_index do |i|
+        boxes[i] = [rand(1000), rand(1000), 1 + rand(80), 1 + rand(80)]
+        index.update(i, boxes[i])
+      end
+    end
+
+    30.times do
+      rect = [rand(1000), rand(1000), rand(200), rand(200)]
+      assert.equal! index.query(rect).sort, spatial_brute_query(boxes, rect), index.class.to_s
+    end
+
+    assert.true! index.remove(7)
+    assert.false! index.remove(7)
+    assert.false! index.query([boxes[7][0], boxes[7][1], 1, 1]).include?(7)
+    assert.equal! index.size, 199
+  end
+end
+
+def test_spatial_quadtree_pairs(_args, assert)
+  index = SpatialIndex::Quadtree.new(256)
+  index.build([[0, 0, 10, 10], [5, 5, 10, 10], [100, 100, 4, 4], [0, 0, 200, 200]])
+
+  assert.equal! index.each_overlapping_pair.each_slice(2).map(&:sort).sort,
+                [[0, 1], [0, 3], [1, 3], [2, 3]]
+end
+
+def test_spatial_rejects_sparse_ids(_args, assert)
+  index = SpatialIndex::Grid.new(16)
+  index.update(3, [0, 0, 4, 4])
+
+  raised = begin
+    index.update(1_000_000_000, [0, 0, 4, 4])
+    false
+  rescue ArgumentError
+    true
+  end
+
+  assert.true! raised
+  assert.equal! index.size, 1
+  assert.equal! index.query([0, 0, 8, 8]), [3]
+end
+
+def test_spatial_grid_handles_huge_boxes(_args, assert)
+  index = SpatialIndex::Grid.new(64)
+  index.update(0, [0, 0, 1e6, 1e6])
+  index.update(1, [100, 100, 8, 8])
+  index.update(2, [-5e5, 10, 4, 4])
+
+  assert.equal! index.query([50_000, 50_000, 1, 1]), [0]
+  assert.equal! index.query([96, 96, 16, 16]).sort, [0, 1]
+  assert.equal! index.each_overlapping_pair.to_a, [0, 1]
+
+  index.update(0, [0, 0, 1, 1])
+  assert.equal! index.query([50_000, 50_000, 1, 1]), []
+  assert.true! index.remove(0)
+
+  [Float::NAN, Float::INFINITY].each do |bad|
+    raised = begin
+      index.update(3, [0, 0, bad, 1])
+      false
+    rescue ArgumentError
+      true
+    end
+    assert.true! raised, bad.inspect
+  end
+  assert.equal! index.size, 2
+end
+
+def test_shape_cache_skips_unneeded_props(_args, assert)
+  [true, false].each do |cached|
+    QTransforms.shape_cache = cached
+    # warm the cache with the same shape first
+    { w: 3, h: 3, angle: 10 }.scale!(2)
+
+    hash = { w: 1, h: 1, angle: 'x' }
+    assert.equal! hash.scale!(2), { w: 2.0, h: 2.0, angle: 'x' }, "shape_cache=#{cached}"
+  end
+
+  QTransforms.shape_cache = true
+end
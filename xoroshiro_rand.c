@@ -1,12 +1,18 @@
 #include <mruby.h>
+#include <mruby/array.h>
 #include <mruby/class.h>
+#include <mruby/data.h>
 #include <mruby/istruct.h>
 #include <mruby/object.h>
 #include <mruby/range.h>
+#include <mruby/string.h>
 
+#include <math.h>
 #include <stdint.h>
 #include <string.h>
 
+#include "cext_simd.h"
+
 /* xoroshiro128+ [https://prng.di.unimi.it/xoroshiro128plus.c] */
 static inline uint64_t rotl(const uint64_t x, const uint8_t k) {
   return (x << k) | (x >> (64 - k));
@@ -82,7 +88,225 @@ _Bool xoroshiro128p_next_bool(struct xoroshiro128p_st *st) {
   return xoroshiro128p_next(st) >> 63;
 }
 
+/* unbiased integer in [0, n) [Lemire 2019, https://arxiv.org/abs/1805.10941] */
+uint64_t xoroshiro128p_next_bounded(struct xoroshiro128p_st *st, uint64_t n) {
+  unsigned __int128 m = (unsigned __int128)xoroshiro128p_next(st) * n;
+  uint64_t l = (uint64_t)m;
+
+  if (l < n) {
+    const uint64_t t = -n % n;
+    while (l < t) {
+      m = (unsigned __int128)xoroshiro128p_next(st) * n;
+      l = (uint64_t)m;
+    }
+  }
+
+  return m >> 64;
+}
+
+/* open (0, 1) double from the top 53 bits */
+double xoroshiro128p_next_open01(struct xoroshiro128p_st *st) {
+  return ((xoroshiro128p_next(st) >> 11) + 0.5) * 0x1.0p-53;
+}
+
+/* ziggurat [Marsaglia & Tsang 2000], 256 layers, tables built on register */
+#define ZIG_LAYERS 256
+
+/* the low bits of xoroshiro128+ are its weakest, so the layer comes from the
+ * top 8 bits and the open (0, 1) mantissa from the 53 bits below them */
+#define ZIG_LAYER(bits) ((size_t)((bits) >> 56))
+#define ZIG_UNIT(bits)                                                         \
+  (((((bits) >> 3) & ((UINT64_C(1) << 53) - 1)) + 0.5) * 0x1.0p-53)
+
+#define ZIG_NORM_R 3.6541528853610088
+#define ZIG_NORM_V 0.00492867323399
+
+#define ZIG_EXP_R 7.69711747013104972
+#define ZIG_EXP_V 0.0039496598225815571993
+
+static double zig_norm_x[ZIG_LAYERS + 1];
+static double zig_norm_f[ZIG_LAYERS + 1];
+static double zig_exp_x[ZIG_LAYERS + 1];
+static double zig_exp_f[ZIG_LAYERS + 1];
+
+static double zig_norm_pdf(double x) { return exp(-x * x / 2.0); }
+static double zig_norm_pdf_inv(double y) { return sqrt(-2.0 * log(y)); }
+static double zig_exp_pdf(double x) { return exp(-x); }
+static double zig_exp_pdf_inv(double y) { return -log(y); }
+
+static void zig_build_table(double *xs, double *fs, double r, double v,
+                            double (*pdf)(double), double (*pdf_inv)(double)) {
+  xs[0] = v / pdf(r);
+  xs[1] = r;
+
+  for (size_t i = 2; i < ZIG_LAYERS; ++i) {
+    double y = pdf(xs[i - 1]) + v / xs[i - 1];
+    xs[i] = y >= 1.0 ? 0.0 : pdf_inv(y);
+  }
+
+  xs[ZIG_LAYERS] = 0.0;
+
+  for (size_t i = 0; i <= ZIG_LAYERS; ++i)
+    fs[i] = pdf(xs[i]);
+}
+
+void xoroshiro128p_zig_init(void) {
+  zig_build_table(zig_norm_x, zig_norm_f, ZIG_NORM_R, ZIG_NORM_V,
+                  zig_norm_pdf, zig_norm_pdf_inv);
+  zig_build_table(zig_exp_x, zig_exp_f, ZIG_EXP_R, ZIG_EXP_V, zig_exp_pdf,
+                  zig_exp_pdf_inv);
+}
+
+double xoroshiro128p_next_normal(struct xoroshiro128p_st *st) {
+  for (;;) {
+    const uint64_t bits = xoroshiro128p_next(st);
+    const size_t i = ZIG_LAYER(bits);
+    const double u = 2.0 * ZIG_UNIT(bits) - 1.0;
+    const double x = u * zig_norm_x[i];
+
+    if (fabs(x) < zig_norm_x[i + 1])
+      return x;
+
+    if (i == 0) {
+      /* tail past R */
+      double tx, ty;
+      do {
+        tx = log(xoroshiro128p_next_open01(st)) / ZIG_NORM_R;
+        ty = log(xoroshiro128p_next_open01(st));
+      } while (-2.0 * ty < tx * tx);
+
+      return u < 0 ? tx - ZIG_NORM_R : ZIG_NORM_R - tx;
+    }
+
+    if (zig_norm_f[i + 1] + (zig_norm_f[i] - zig_norm_f[i + 1]) *
+                                xoroshiro128p_next_open01(st) <
+        zig_norm_pdf(x))
+      return x;
+  }
+}
+
+double xoroshiro128p_next_exponential(struct xoroshiro128p_st *st) {
+  for (;;) {
+    const uint64_t bits = xoroshiro128p_next(st);
+    const size_t i = ZIG_LAYER(bits);
+    const double x = ZIG_UNIT(bits) * zig_exp_x[i];
+
+    if (x < zig_exp_x[i + 1])
+      return x;
+
+    if (i == 0)
+      return ZIG_EXP_R - log(xoroshiro128p_next_open01(st));
+
+    if (zig_exp_f[i + 1] + (zig_exp_f[i] - zig_exp_f[i + 1]) *
+                               xoroshiro128p_next_open01(st) <
+        zig_exp_pdf(x))
+      return x;
+  }
+}
+
+/* counter-based generator: the output at index i is the i-th output of a
+ * splitmix64 [https://prng.di.unimi.it/splitmix64.c] stream keyed by the seed,
+ * so any index can be computed directly without sequential state */
+#define SPLITMIX64_GAMMA UINT64_C(0x9e3779b97f4a7c15)
+
+static inline uint64_t splitmix64_mix(uint64_t z) {
+  z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+  z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+  return z ^ (z >> 31);
+}
+
+struct ctr_rand_st {
+  uint64_t key;
+};
+
+static_assert(sizeof(struct ctr_rand_st) <= ISTRUCT_DATA_SIZE);
+
+void ctr_rand_init(struct ctr_rand_st *st, uint64_t seed) {
+  st->key = splitmix64_mix(seed + SPLITMIX64_GAMMA);
+}
+
+uint64_t ctr_rand_at(const struct ctr_rand_st *st, uint64_t idx) {
+  return splitmix64_mix(st->key + (idx + 1) * SPLITMIX64_GAMMA);
+}
+
+uint64_t ctr_rand_at2(const struct ctr_rand_st *st, uint64_t x, uint64_t y) {
+  uint64_t row = splitmix64_mix(st->key ^ (x * UINT64_C(0xd1b54a32d192ed03)));
+  return splitmix64_mix(row + (y + 1) * SPLITMIX64_GAMMA);
+}
+
+/* ctr_rand_at over start, start + 1, ... into out; the counters are
+ * independent, so the vector kernels run one per 64-bit lane. dispatched on
+ * the cpu at load time */
+typedef void (*ctr_rand_fill_fn)(const struct ctr_rand_st *st, uint64_t start,
+                                 size_t n, uint64_t *out);
+
+static void ctr_rand_fill_scalar(const struct ctr_rand_st *st, uint64_t start,
+                                 size_t n, uint64_t *out) {
+  CEXT_SCALAR_LOOP
+  for (size_t i = 0; i < n; ++i)
+    out[i] = ctr_rand_at(st, start + i);
+}
+
+#ifdef CEXT_SIMD_X86
+/* no 64-bit multiply below avx-512, so it is built from 32x32->64 halves.
+ * with two lanes that loses to the scalar imul, hence no sse2 variant */
+#define CTR_RAND_KERNEL(isa, target, vec, bits, lanes, pfx, set1)              \
+  target static inline vec ctr_rand_mul_##isa(vec a, uint64_t c) {             \
+    const vec cl = set1((int64_t)(c & 0xffffffff));                            \
+    const vec ch = set1((int64_t)(c >> 32));                                   \
+    const vec cross = pfx##_add_epi64(                                         \
+        pfx##_mul_epu32(pfx##_srli_epi64(a, 32), cl), pfx##_mul_epu32(a, ch)); \
+    return pfx##_add_epi64(pfx##_mul_epu32(a, cl),                             \
+                           pfx##_slli_epi64(cross, 32));                       \
+  }                                                                            \
+                                                                               \
+  target static void ctr_rand_fill_##isa(const struct ctr_rand_st *st,         \
+                                         uint64_t start, size_t n,             \
+                                         uint64_t *out) {                      \
+    uint64_t first[lanes];                                                     \
+    for (int l = 0; l < lanes; ++l)                                            \
+      first[l] = st->key + (start + l + 1) * SPLITMIX64_GAMMA;                 \
+                                                                               \
+    vec z = pfx##_loadu_si##bits((const vec *)first);                          \
+    const vec step = set1((int64_t)(lanes * SPLITMIX64_GAMMA));                \
+    size_t i = 0;                                                              \
+                                                                               \
+    for (; i + lanes <= n; i += lanes) {                                       \
+      vec v = pfx##_xor_si##bits(z, pfx##_srli_epi64(z, 30));                  \
+      v = ctr_rand_mul_##isa(v, UINT64_C(0xbf58476d1ce4e5b9));                 \
+      v = pfx##_xor_si##bits(v, pfx##_srli_epi64(v, 27));                      \
+      v = ctr_rand_mul_##isa(v, UINT64_C(0x94d049bb133111eb));                 \
+      v = pfx##_xor_si##bits(v, pfx##_srli_epi64(v, 31));                      \
+      pfx##_storeu_si##bits((vec *)&out[i], v);                                \
+      z = pfx##_add_epi64(z, step);                                            \
+    }                                                                          \
+                                                                               \
+    ctr_rand_fill_scalar(st, start + i, n - i, out + i);                       \
+  }
+
+CTR_RAND_KERNEL(avx2, CEXT_TARGET_AVX2, __m256i, 256, 4, _mm256,
+                _mm256_set1_epi64x)
+#endif
+
+static ctr_rand_fill_fn ctr_rand_fill = ctr_rand_fill_scalar;
+
+static void xoro_simd_select(enum cext_isa isa) {
+  ctr_rand_fill = CEXT_SIMD_PICK(isa, ctr_rand_fill_scalar,
+                                 ctr_rand_fill_scalar, ctr_rand_fill_avx2);
+}
+
 struct RClass *xoroshiro128p;
+struct RClass *xoroshiro128p_alias_table;
+struct RClass *ctr_rand;
+struct RClass *xoroshiro128p_streams;
+
+struct xoroshiro128p_st *xoro_rand_get_state(mrb_state *mrb, mrb_value rng) {
+  if (!mrb_obj_is_instance_of(mrb, rng, xoroshiro128p)) {
+    mrb_raisef(mrb, E_TYPE_ERROR, "expected %C, got %T", xoroshiro128p, rng);
+  }
+
+  return (struct xoroshiro128p_st *)ISTRUCT_PTR(rng);
+}
 
 mrb_value xoro_rand_alloc(mrb_state *mrb, mrb_value) {
   struct RIStruct *ris =
@@ -121,12 +345,10 @@ mrb_value xoro_rand_init(mrb_state *mrb, mrb_value self) {
   return self;
 }
 
-mrb_value xoro_rand_rand(mrb_state *mrb, mrb_value self) {
-  mrb_value arg = mrb_int_value(mrb, 0);
-  struct xoroshiro128p_st *st = (typeof(st))ISTRUCT_PTR(self);
-
-  mrb_get_args(mrb, "|o", &arg);
-
+/* shared by Xoroshiro128#rand and Xoroshiro128::Streams#rand, self is only
+ * used in error messages */
+mrb_value xoro_rand_value(mrb_state *mrb, struct xoroshiro128p_st *st,
+                          mrb_value arg, mrb_value self) {
   if (mrb_float_p(arg)) {
     arg = mrb_int_value(mrb, (int)mrb_float(arg));
   }
@@ -141,7 +363,7 @@ mrb_value xoro_rand_rand(mrb_state *mrb, mrb_value self) {
     if (i == 0)
       return mrb_float_value(mrb, xoroshiro128p_next_float(st));
 
-    return mrb_int_value(mrb, xoroshiro128p_next(st) % i);
+    return mrb_int_value(mrb, xoroshiro128p_next_bounded(st, i));
 
     mrb_raise(mrb, E_RUNTIME_ERROR, "\"unreachable\" control flow");
   }
@@ -169,7 +391,7 @@ mrb_value xoro_rand_rand(mrb_state *mrb, mrb_value self) {
       if (span == 0)
         return mrb_nil_value();
 
-      mrb_int offs = xoroshiro128p_next(st) % span;
+      mrb_int offs = xoroshiro128p_next_bounded(st, span);
       return mrb_int_value(mrb, ia + offs);
     }
 
@@ -189,6 +411,15 @@ mrb_value xoro_rand_rand(mrb_state *mrb, mrb_value self) {
              self);
 }
 
+mrb_value xoro_rand_rand(mrb_state *mrb, mrb_value self) {
+  mrb_value arg = mrb_int_value(mrb, 0);
+  struct xoroshiro128p_st *st = (typeof(st))ISTRUCT_PTR(self);
+
+  mrb_get_args(mrb, "|o", &arg);
+
+  return xoro_rand_value(mrb, st, arg, self);
+}
+
 mrb_value xoro_rand_rand_bool([[maybe_unused]] mrb_state *mrb, mrb_value self) {
   return mrb_bool_value(
       xoroshiro128p_next_bool((struct xoroshiro128p_st *)ISTRUCT_PTR(self)));
@@ -217,7 +448,542 @@ mrb_value xoro_rand_long_jump(mrb_state *mrb, mrb_value self) {
   return newv;
 }
 
+mrb_value xoro_rand_normal(mrb_state *mrb, mrb_value self) {
+  mrb_float mean = 0.0;
+  mrb_float sd = 1.0;
+  mrb_get_args(mrb, "|ff", &mean, &sd);
+
+  if (sd < 0.0)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR,
+               "negative standard deviation passed to %T#normal", self);
+
+  return mrb_float_value(
+      mrb, mean + sd * xoroshiro128p_next_normal(
+                           (struct xoroshiro128p_st *)ISTRUCT_PTR(self)));
+}
+
+mrb_value xoro_rand_exponential(mrb_state *mrb, mrb_value self) {
+  mrb_float rate = 1.0;
+  mrb_get_args(mrb, "|f", &rate);
+
+  if (!(rate > 0.0))
+    mrb_raisef(mrb, E_ARGUMENT_ERROR,
+               "non-positive rate passed to %T#exponential", self);
+
+  return mrb_float_value(mrb, xoroshiro128p_next_exponential(
+                                  (struct xoroshiro128p_st *)ISTRUCT_PTR(self)) /
+                                  rate);
+}
+
+void xoroshiro128p_shuffle(struct xoroshiro128p_st *st, mrb_value *data,
+                           size_t size) {
+  for (size_t i = size; i > 1; --i) {
+    size_t j = xoroshiro128p_next_bounded(st, i);
+
+    const mrb_value tmp = data[i - 1];
+    data[i - 1] = data[j];
+    data[j] = tmp;
+  }
+}
+
+mrb_value xoro_rand_shuffle_b(mrb_state *mrb, mrb_value self) {
+  mrb_value ary;
+  mrb_get_args(mrb, "A", &ary);
+
+  mrb_ary_modify(mrb, mrb_ary_ptr(ary));
+  xoroshiro128p_shuffle((struct xoroshiro128p_st *)ISTRUCT_PTR(self),
+                        RARRAY_PTR(ary), RARRAY_LEN(ary));
+
+  return ary;
+}
+
+/* open-addressing set of indices for Floyd's sampling, 0 marks a free slot */
+struct xoro_idx_set_t {
+  uint64_t *slots;
+  uint64_t mask;
+};
+
+/* returns false if idx was already present */
+static _Bool xoro_idx_set_add(struct xoro_idx_set_t *set, uint64_t idx) {
+  uint64_t h = (idx * UINT64_C(0x9e3779b97f4a7c15)) >> 32;
+
+  for (;; ++h) {
+    uint64_t *slot = &set->slots[h & set->mask];
+    if (*slot == 0) {
+      *slot = idx + 1;
+      return true;
+    }
+    if (*slot == idx + 1)
+      return false;
+  }
+}
+
+/* k distinct elements of data, in random order */
+mrb_value xoro_rand_sample_k(mrb_state *mrb, struct xoroshiro128p_st *st,
+                             const mrb_value *data, size_t size, size_t k) {
+  if (k > size)
+    k = size;
+
+  /* large k relative to size: partial Fisher-Yates over a copy */
+  if (k > size / 4) {
+    mrb_value res = mrb_ary_new_from_values(mrb, size, data);
+    mrb_value *ptr = RARRAY_PTR(res);
+
+    for (size_t i = 0; i < k; ++i) {
+      size_t j = i + xoroshiro128p_next_bounded(st, size - i);
+
+      const mrb_value tmp = ptr[i];
+      ptr[i] = ptr[j];
+      ptr[j] = tmp;
+    }
+
+    return mrb_ary_resize(mrb, res, k);
+  }
+
+  /* Floyd's algorithm, O(k) draws and memory */
+  size_t capa = 8;
+  while (capa < k * 2)
+    capa *= 2;
+
+  /* a String, so a raise can't leak it */
+  mrb_value vslots = mrb_str_new(mrb, nullptr, capa * sizeof(uint64_t));
+  struct xoro_idx_set_t set = {
+      .slots = (uint64_t *)RSTRING_PTR(vslots),
+      .mask = capa - 1,
+  };
+  memset(set.slots, 0, capa * sizeof(uint64_t));
+
+  mrb_value res = mrb_ary_new_capa(mrb, k);
+
+  for (size_t j = size - k; j < size; ++j) {
+    size_t t = xoroshiro128p_next_bounded(st, j + 1);
+    if (!xoro_idx_set_add(&set, t)) {
+      xoro_idx_set_add(&set, j);
+      t = j;
+    }
+    mrb_ary_push(mrb, res, data[t]);
+  }
+
+  /* Floyd's picks a uniform set, but not a uniform order */
+  xoroshiro128p_shuffle(st, RARRAY_PTR(res), k);
+
+  return res;
+}
+
+mrb_value xoro_rand_sample(mrb_state *mrb, mrb_value self) {
+  mrb_value ary;
+  mrb_int k = 0;
+  mrb_bool k_given = false;
+  mrb_get_args(mrb, "A|i?", &ary, &k, &k_given);
+
+  struct xoroshiro128p_st *st = (struct xoroshiro128p_st *)ISTRUCT_PTR(self);
+  const mrb_int size = RARRAY_LEN(ary);
+
+  if (!k_given) {
+    if (size == 0)
+      return mrb_nil_value();
+    return RARRAY_PTR(ary)[xoroshiro128p_next_bounded(st, size)];
+  }
+
+  if (k < 0)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "negative sample number (%i)", k);
+
+  return xoro_rand_sample_k(mrb, st, RARRAY_PTR(ary), size, k);
+}
+
+/* alias method [Vose 1991] */
+struct xoro_alias_table_t {
+  size_t size;
+  /* points past thresh, in the same allocation */
+  uint32_t *alias;
+  /* acceptance threshold against 32 random bits, up to 2^32 */
+  uint64_t thresh[];
+};
+
+void xoro_alias_free(mrb_state *mrb, struct xoro_alias_table_t *tbl) {
+  if (tbl == nullptr)
+    return;
+
+  mrb_free(mrb, tbl);
+}
+
+static const mrb_data_type xoro_alias_datatype = {
+    .struct_name = "Xoroshiro128::AliasTable",
+    .dfree = (void (*)(mrb_state *, void *))xoro_alias_free};
+
+struct xoro_alias_table_t *xoro_alias_build(mrb_state *mrb,
+                                            const mrb_value *weights,
+                                            size_t size) {
+  if (size == 0)
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "empty weight list");
+
+  if (size > UINT32_MAX)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "too many weights (%i)", (mrb_int)size);
+
+  /* a String, so a raise can't leak it; the worklists follow scaled */
+  mrb_value vscratch =
+      mrb_str_new(mrb, nullptr, size * (sizeof(double) + sizeof(uint32_t)));
+  double *scaled = (double *)RSTRING_PTR(vscratch);
+  double sum = 0.0;
+
+  for (size_t i = 0; i < size; ++i) {
+    mrb_value w = weights[i];
+    double d;
+
+    if (mrb_float_p(w)) {
+      d = mrb_float(w);
+    } else if (mrb_integer_p(w)) {
+      d = (double)mrb_integer(w);
+    } else {
+      mrb_raisef(mrb, E_TYPE_ERROR, "non-numeric weight %v at index %i", w,
+                 (mrb_int)i);
+    }
+
+    if (!(d >= 0.0) || isinf(d))
+      mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid weight %v at index %i", w,
+                 (mrb_int)i);
+
+    scaled[i] = d;
+    sum += d;
+  }
+
+  if (!(sum > 0.0) || isinf(sum))
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "weights must have a finite positive sum");
+
+  /* both worklists fit in one buffer, small from the front, large from the
+   * back */
+  uint32_t *work = (uint32_t *)(scaled + size);
+  size_t nsmall = 0;
+  size_t nlarge = 0;
+
+  for (size_t i = 0; i < size; ++i) {
+    scaled[i] = scaled[i] * (double)size / sum;
+    if (scaled[i] < 1.0)
+      work[nsmall++] = i;
+    else
+      work[size - ++nlarge] = i;
+  }
+
+  /* the only allocation the caller owns, so nothing leaks if it raises */
+  struct xoro_alias_table_t *tbl =
+      mrb_malloc(mrb, sizeof(struct xoro_alias_table_t) +
+                          size * (sizeof(uint64_t) + sizeof(uint32_t)));
+  tbl->size = size;
+  tbl->alias = (uint32_t *)(tbl->thresh + size);
+
+  while (nsmall > 0 && nlarge > 0) {
+    uint32_t s = work[--nsmall];
+    uint32_t l = work[size - nlarge];
+
+    tbl->thresh[s] = (uint64_t)(scaled[s] * 0x1.0p32);
+    tbl->alias[s] = l;
+
+    scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+    if (scaled[l] < 1.0) {
+      --nlarge;
+      work[nsmall++] = l;
+    }
+  }
+
+  /* leftovers are 1.0 up to rounding error */
+  while (nlarge > 0) {
+    uint32_t l = work[size - nlarge--];
+    tbl->thresh[l] = UINT64_C(1) << 32;
+    tbl->alias[l] = l;
+  }
+
+  while (nsmall > 0) {
+    uint32_t s = work[--nsmall];
+    tbl->thresh[s] = UINT64_C(1) << 32;
+    tbl->alias[s] = s;
+  }
+
+  return tbl;
+}
+
+[[clang::always_inline]] uint32_t
+xoro_alias_sample1(const struct xoro_alias_table_t *tbl,
+                   struct xoroshiro128p_st *st) {
+  const uint64_t bits = xoroshiro128p_next(st);
+  const uint32_t col = ((bits >> 32) * tbl->size) >> 32;
+  const uint64_t coin = bits & UINT32_MAX;
+
+  return coin < tbl->thresh[col] ? col : tbl->alias[col];
+}
+
+mrb_value xoro_alias_init(mrb_state *mrb, mrb_value self) {
+  const mrb_value *weights = nullptr;
+  mrb_int size = 0;
+  mrb_get_args(mrb, "a", &weights, &size);
+
+  struct xoro_alias_table_t *tbl = DATA_PTR(self);
+  if (tbl != nullptr && DATA_TYPE(self) == &xoro_alias_datatype)
+    xoro_alias_free(mrb, tbl);
+  mrb_data_init(self, nullptr, &xoro_alias_datatype);
+
+  tbl = xoro_alias_build(mrb, weights, size);
+  mrb_data_init(self, tbl, &xoro_alias_datatype);
+
+  return self;
+}
+
+struct xoro_alias_table_t *xoro_alias_get(mrb_state *mrb, mrb_value self) {
+  struct xoro_alias_table_t *tbl =
+      mrb_data_get_ptr(mrb, self, &xoro_alias_datatype);
+
+  if (tbl == nullptr)
+    mrb_raisef(mrb, E_RUNTIME_ERROR, "uninitialized %T", self);
+
+  return tbl;
+}
+
+mrb_value xoro_alias_sample(mrb_state *mrb, mrb_value self) {
+  mrb_value rng;
+  mrb_int n = 0;
+  mrb_bool n_given = false;
+  mrb_get_args(mrb, "o|i?", &rng, &n, &n_given);
+
+  const struct xoro_alias_table_t *tbl = xoro_alias_get(mrb, self);
+  struct xoroshiro128p_st *st = xoro_rand_get_state(mrb, rng);
+
+  if (!n_given)
+    return mrb_int_value(mrb, xoro_alias_sample1(tbl, st));
+
+  if (n < 0)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "negative sample count (%i)", n);
+
+  mrb_value ary = mrb_ary_new_capa(mrb, n);
+  for (mrb_int i = 0; i < n; ++i)
+    mrb_ary_push(mrb, ary, mrb_int_value(mrb, xoro_alias_sample1(tbl, st)));
+
+  return ary;
+}
+
+mrb_value xoro_alias_size(mrb_state *mrb, mrb_value self) {
+  return mrb_int_value(mrb, xoro_alias_get(mrb, self)->size);
+}
+
+mrb_value ctr_rand_new(mrb_state *mrb, mrb_value) {
+  mrb_int seed = 0;
+  mrb_get_args(mrb, "|i", &seed);
+
+  struct RIStruct *ris =
+      (struct RIStruct *)mrb_obj_alloc(mrb, MRB_TT_ISTRUCT, ctr_rand);
+  mrb_value val = mrb_obj_value(ris);
+
+  ctr_rand_init((struct ctr_rand_st *)&ris->inline_data, seed);
+
+  return val;
+}
+
+/* max == 0 gives a float in [0, 1), otherwise an integer in [0, max); the
+ * multiply-shift bias is at most max / 2^64 since a stateless draw can't
+ * reject */
+mrb_value ctr_rand_value(mrb_state *mrb, uint64_t bits, mrb_int max) {
+  if (max == 0)
+    return mrb_float_value(mrb, (bits >> 11) * 0x1.0p-53);
+
+  return mrb_int_value(
+      mrb, (mrb_int)(((unsigned __int128)bits * (uint64_t)max) >> 64));
+}
+
+static void ctr_rand_check_max(mrb_state *mrb, mrb_value self, mrb_int max) {
+  if (max < 0)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "negative maximum passed to %T", self);
+}
+
+mrb_value ctr_rand_m_at(mrb_state *mrb, mrb_value self) {
+  mrb_int idx;
+  mrb_int max = 0;
+  mrb_get_args(mrb, "i|i", &idx, &max);
+  ctr_rand_check_max(mrb, self, max);
+
+  return ctr_rand_value(
+      mrb, ctr_rand_at((struct ctr_rand_st *)ISTRUCT_PTR(self), idx), max);
+}
+
+mrb_value ctr_rand_m_at2(mrb_state *mrb, mrb_value self) {
+  mrb_int x;
+  mrb_int y;
+  mrb_int max = 0;
+  mrb_get_args(mrb, "ii|i", &x, &y, &max);
+  ctr_rand_check_max(mrb, self, max);
+
+  return ctr_rand_value(
+      mrb, ctr_rand_at2((struct ctr_rand_st *)ISTRUCT_PTR(self), x, y), max);
+}
+
+mrb_value ctr_rand_m_fill_at(mrb_state *mrb, mrb_value self) {
+  mrb_int start;
+  mrb_int n;
+  mrb_int max = 0;
+  mrb_get_args(mrb, "ii|i", &start, &n, &max);
+  ctr_rand_check_max(mrb, self, max);
+
+  if (n < 0)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "negative count (%i)", n);
+
+  const struct ctr_rand_st *st = (struct ctr_rand_st *)ISTRUCT_PTR(self);
+  mrb_value ary = mrb_ary_new_capa(mrb, n);
+  int ai = mrb_gc_arena_save(mrb);
+  uint64_t bits[64];
+
+  for (mrb_int i = 0; i < n; i += 64) {
+    const size_t chunk = n - i < 64 ? n - i : 64;
+    ctr_rand_fill(st, start + i, chunk, bits);
+
+    for (size_t j = 0; j < chunk; ++j) {
+      mrb_ary_push(mrb, ary, ctr_rand_value(mrb, bits[j], max));
+      mrb_gc_arena_restore(mrb, ai);
+    }
+  }
+
+  return ary;
+}
+
+/* a family of generators spaced 2^64 draws apart, packed in one buffer */
+struct xoro_streams_t {
+  size_t count;
+  struct xoroshiro128p_st states[];
+};
+
+void xoro_streams_free(mrb_state *mrb, struct xoro_streams_t *streams) {
+  if (streams == nullptr)
+    return;
+
+  mrb_free(mrb, streams);
+}
+
+static const mrb_data_type xoro_streams_datatype = {
+    .struct_name = "Xoroshiro128::Streams",
+    .dfree = (void (*)(mrb_state *, void *))xoro_streams_free};
+
+mrb_value xoro_streams_init(mrb_state *mrb, mrb_value self) {
+  mrb_int seed;
+  mrb_int count;
+  mrb_get_args(mrb, "ii", &seed, &count);
+
+  if (count <= 0)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "non-positive stream count (%i)", count);
+  if ((size_t)count > (SIZE_MAX - sizeof(struct xoro_streams_t)) /
+                          sizeof(struct xoroshiro128p_st))
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "too many streams (%i)", count);
+
+  struct xoro_streams_t *streams = DATA_PTR(self);
+  if (streams != nullptr && DATA_TYPE(self) == &xoro_streams_datatype)
+    xoro_streams_free(mrb, streams);
+  mrb_data_init(self, nullptr, &xoro_streams_datatype);
+
+  streams = mrb_malloc(mrb, sizeof(struct xoro_streams_t) +
+                                count * sizeof(struct xoroshiro128p_st));
+  streams->count = count;
+
+  xoroshiro128p_init(&streams->states[0], seed);
+  for (mrb_int i = 1; i < count; ++i) {
+    streams->states[i] = streams->states[i - 1];
+    xoroshiro128p_jump(&streams->states[i]);
+  }
+
+  mrb_data_init(self, streams, &xoro_streams_datatype);
+
+  return self;
+}
+
+struct xoro_streams_t *xoro_streams_get(mrb_state *mrb, mrb_value self) {
+  struct xoro_streams_t *streams =
+      mrb_data_get_ptr(mrb, self, &xoro_streams_datatype);
+
+  if (streams == nullptr)
+    mrb_raisef(mrb, E_RUNTIME_ERROR, "uninitialized %T", self);
+
+  return streams;
+}
+
+struct xoroshiro128p_st *xoro_streams_at(mrb_state *mrb,
+                                         struct xoro_streams_t *streams,
+                                         mrb_int idx) {
+  if (idx < 0 || (size_t)idx >= streams->count)
+    mrb_raisef(mrb, E_INDEX_ERROR, "stream index %i outside of 0...%i", idx,
+               (mrb_int)streams->count);
+
+  return &streams->states[idx];
+}
+
+mrb_value xoro_streams_rand(mrb_state *mrb, mrb_value self) {
+  mrb_int idx;
+  mrb_value arg = mrb_int_value(mrb, 0);
+  mrb_get_args(mrb, "i|o", &idx, &arg);
+
+  struct xoroshiro128p_st *st =
+      xoro_streams_at(mrb, xoro_streams_get(mrb, self), idx);
+
+  return xoro_rand_value(mrb, st, arg, self);
+}
+
+mrb_value xoro_streams_rand_bool(mrb_state *mrb, mrb_value self) {
+  mrb_int idx;
+  mrb_get_args(mrb, "i", &idx);
+
+  return mrb_bool_value(xoroshiro128p_next_bool(
+      xoro_streams_at(mrb, xoro_streams_get(mrb, self), idx)));
+}
+
+mrb_value xoro_streams_fill(mrb_state *mrb, mrb_value self) {
+  mrb_int idx;
+  mrb_int n;
+  mrb_value arg = mrb_int_value(mrb, 0);
+  mrb_get_args(mrb, "ii|o", &idx, &n, &arg);
+
+  if (n < 0)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "negative count (%i)", n);
+
+  struct xoroshiro128p_st *st =
+      xoro_streams_at(mrb, xoro_streams_get(mrb, self), idx);
+
+  mrb_value ary = mrb_ary_new_capa(mrb, n);
+  int ai = mrb_gc_arena_save(mrb);
+
+  for (mrb_int i = 0; i < n; ++i) {
+    mrb_ary_push(mrb, ary, xoro_rand_value(mrb, st, arg, self));
+    mrb_gc_arena_restore(mrb, ai);
+  }
+
+  return ary;
+}
+
+mrb_value xoro_streams_size(mrb_state *mrb, mrb_value self) {
+  return mrb_int_value(mrb, xoro_streams_get(mrb, self)->count);
+}
+
+/* raw native-endian state dump, count * 16 bytes */
+mrb_value xoro_streams_snapshot(mrb_state *mrb, mrb_value self) {
+  const struct xoro_streams_t *streams = xoro_streams_get(mrb, self);
+
+  return mrb_str_new(mrb, (const char *)streams->states,
+                     streams->count * sizeof(struct xoroshiro128p_st));
+}
+
+mrb_value xoro_streams_restore(mrb_state *mrb, mrb_value self) {
+  const char *buf;
+  mrb_int len;
+  mrb_get_args(mrb, "s", &buf, &len);
+
+  struct xoro_streams_t *streams = xoro_streams_get(mrb, self);
+  const size_t expected = streams->count * sizeof(struct xoroshiro128p_st);
+
+  if ((size_t)len != expected)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR,
+               "snapshot size mismatch: got %i bytes, expected %i", len,
+               (mrb_int)expected);
+
+  memcpy(streams->states, buf, expected);
+
+  return self;
+}
+
 void drb_register_c_extensions_with_api(mrb_state *mrb, void *) {
+  xoroshiro128p_zig_init();
+
   xoroshiro128p = mrb_define_class_id(mrb, mrb_intern_lit(mrb, "Xoroshiro128"),
                                       mrb->object_class);
   mrb_define_class_method_id(mrb, xoroshiro128p,
@@ -241,5 +1007,67 @@ void drb_register_c_extensions_with_api(mrb_state *mrb, void *) {
   mrb_define_method_id(mrb, xoroshiro128p, mrb_intern_lit(mrb, "long_jump"),
                        xoro_rand_long_jump, MRB_ARGS_NONE());
 
+  mrb_define_method_id(mrb, xoroshiro128p, mrb_intern_lit(mrb, "normal"),
+                       xoro_rand_normal, MRB_ARGS_OPT(2));
+  mrb_define_method_id(mrb, xoroshiro128p, mrb_intern_lit(mrb, "exponential"),
+                       xoro_rand_exponential, MRB_ARGS_OPT(1));
+
+  mrb_define_method_id(mrb, xoroshiro128p, mrb_intern_lit(mrb, "shuffle!"),
+                       xoro_rand_shuffle_b, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, xoroshiro128p, mrb_intern_lit(mrb, "sample"),
+                       xoro_rand_sample, MRB_ARGS_ARG(1, 1));
+
   MRB_SET_INSTANCE_TT(xoroshiro128p, MRB_TT_ISTRUCT);
+
+  xoroshiro128p_streams = mrb_define_class_under_id(
+      mrb, xoroshiro128p, mrb_intern_lit(mrb, "Streams"), mrb->object_class);
+  MRB_SET_INSTANCE_TT(xoroshiro128p_streams, MRB_TT_DATA);
+
+  mrb_define_method_id(mrb, xoroshiro128p_streams,
+                       mrb_intern_lit(mrb, "initialize"), xoro_streams_init,
+                       MRB_ARGS_REQ(2));
+  mrb_define_method_id(mrb, xoroshiro128p_streams, mrb_intern_lit(mrb, "rand"),
+                       xoro_streams_rand, MRB_ARGS_ARG(1, 1));
+  mrb_define_method_id(mrb, xoroshiro128p_streams,
+                       mrb_intern_lit(mrb, "rand_bool"), xoro_streams_rand_bool,
+                       MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, xoroshiro128p_streams, mrb_intern_lit(mrb, "fill"),
+                       xoro_streams_fill, MRB_ARGS_ARG(2, 1));
+  mrb_define_method_id(mrb, xoroshiro128p_streams, mrb_intern_lit(mrb, "size"),
+                       xoro_streams_size, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, xoroshiro128p_streams,
+                       mrb_intern_lit(mrb, "snapshot"), xoro_streams_snapshot,
+                       MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, xoroshiro128p_streams,
+                       mrb_intern_lit(mrb, "restore"), xoro_streams_restore,
+                       MRB_ARGS_REQ(1));
+
+  ctr_rand = mrb_define_class_id(mrb, mrb_intern_lit(mrb, "CounterRand"),
+                                 mrb->object_class);
+  mrb_define_class_method_id(mrb, ctr_rand, mrb_intern_lit(mrb, "new"),
+                             ctr_rand_new, MRB_ARGS_OPT(1));
+  mrb_define_method_id(mrb, ctr_rand, mrb_intern_lit(mrb, "at"), ctr_rand_m_at,
+                       MRB_ARGS_ARG(1, 1));
+  mrb_define_method_id(mrb, ctr_rand, mrb_intern_lit(mrb, "at2"),
+                       ctr_rand_m_at2, MRB_ARGS_ARG(2, 1));
+  mrb_define_method_id(mrb, ctr_rand, mrb_intern_lit(mrb, "fill_at"),
+                       ctr_rand_m_fill_at, MRB_ARGS_ARG(2, 1));
+
+  MRB_SET_INSTANCE_TT(ctr_rand, MRB_TT_ISTRUCT);
+
+  xoroshiro128p_alias_table = mrb_define_class_under_id(
+      mrb, xoroshiro128p, mrb_intern_lit(mrb, "AliasTable"), mrb->object_class);
+  MRB_SET_INSTANCE_TT(xoroshiro128p_alias_table, MRB_TT_DATA);
+
+  mrb_define_method_id(mrb, xoroshiro128p_alias_table,
+                       mrb_intern_lit(mrb, "initialize"), xoro_alias_init,
+                       MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, xoroshiro128p_alias_table,
+                       mrb_intern_lit(mrb, "sample"), xoro_alias_sample,
+                       MRB_ARGS_ARG(1, 1));
+  mrb_define_method_id(mrb, xoroshiro128p_alias_table,
+                       mrb_intern_lit(mrb, "size"), xoro_alias_size,
+                       MRB_ARGS_NONE());
+
+  cext_simd_init(mrb, "xoroshiro_rand", xoro_simd_select);
 }